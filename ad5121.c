@@ -2,9 +2,10 @@
 
 #include <avr/io.h>
 
-#include "nuts_bolts.h"
+#include "system.h"
 #include "ad5121.h"
 #include "spi.h"
+#include "stepper.h"
 
 #define AD_CMD_WRITE_RDAC	0x10
 #define AD_CMD_RDAC_TO_EEPROM	0x70
@@ -56,6 +57,7 @@ void ad5121_write_pot(enum AD5121_ID dev_id, uint8_t val)
   struct ad5121_dev dev = devs[dev_id];
   uint8_t cmd[] = {AD_CMD_WRITE_RDAC, val};
 
+  ST_PREP_LOCK(); // The SPI bus is shared with the SRAM
   spi_set_mode(0, 1);
 
   /* Assert CS pin */
@@ -65,6 +67,7 @@ void ad5121_write_pot(enum AD5121_ID dev_id, uint8_t val)
 
   /* Deassert CS pin */
   *(dev.cs_port) |= 1 << dev.cs_pin;
+  ST_PREP_UNLOCK();
 
 }
 
@@ -74,6 +77,7 @@ uint8_t ad5121_read_pot(enum AD5121_ID dev_id)
   uint8_t cmd[] = {AD_CMD_READ, AD_MASK_READ_RDAC};
   uint8_t result[2] = {0};
 
+  ST_PREP_LOCK();
   spi_set_mode(0, 1);
 
   /* Assert CS pin */
@@ -91,6 +95,7 @@ uint8_t ad5121_read_pot(enum AD5121_ID dev_id)
 
   /* Deassert CS pin */
   *(dev.cs_port) |= 1 << dev.cs_pin;
+  ST_PREP_UNLOCK();
 
   return result[1];
 }
@@ -100,6 +105,7 @@ void ad5121_store_pot(enum AD5121_ID dev_id)
   struct ad5121_dev dev = devs[dev_id];
   uint8_t cmd[] = {AD_CMD_RDAC_TO_EEPROM, 0x01};
 
+  ST_PREP_LOCK();
   spi_set_mode(0, 1);
 
   /* Assert CS pin */
@@ -109,4 +115,5 @@ void ad5121_store_pot(enum AD5121_ID dev_id)
 
   /* Deassert CS pin */
   *(dev.cs_port) |= 1 << dev.cs_pin;
+  ST_PREP_UNLOCK();
 }
@@ -2,6 +2,7 @@
 #include "system.h"
 #include "adc.h"
 #include "nuts_bolts.h"
+#include "isr_timing.h"
 #include "settings.h"
 
 #define ADMUX_SELECTION_MASK    0x7
@@ -9,6 +10,27 @@
 
 channel_t active_channel = 0;
 
+#ifdef FORCE_OVERSAMPLING
+static channel_t next_channel;  // Next channel of the round robin, which the force is interleaved with
+
+static const uint8_t force_fir_taps[] = { FORCE_FIR_TAPS };
+#define FORCE_FIR_LENGTH (sizeof(force_fir_taps)/sizeof(force_fir_taps[0]))
+
+// Force oversampling and filter state. Only touched by the ADC ISR.
+static uint16_t force_sum;  // Sum of the samples of the current decimated value
+static uint8_t force_count;  // Samples in force_sum
+static uint16_t force_history[FORCE_FIR_LENGTH];  // Decimated values, newest first
+static uint32_t force_divisor;  // Gain of the CIC and FIR filters. Set in adc_init().
+
+// Latest filtered force. The ADC ISR bumps seq after each update, so readers retry on a change
+// instead of disabling interrupts.
+static struct {
+  volatile uint8_t seq;
+  volatile uint16_t value;
+  volatile uint32_t time;
+} force;
+#endif
+
 uint8_t channel_map[VOLTAGE_SENSOR_COUNT] = {
     X_ADC,
     Y_ADC,
@@ -51,18 +73,68 @@ void setup_adc_channel(uint8_t channel)
 
 }
 
+#ifdef FORCE_OVERSAMPLING
+// Adds a force sample. Every FORCE_OVERSAMPLING samples, filters the decimated value and publishes
+// the result.
+static void adc_force_sample(uint16_t sample)
+{
+  force_sum += sample;
+  if (++force_count < FORCE_OVERSAMPLING) { return; }
+
+  memmove(&force_history[1], &force_history[0], sizeof(uint16_t) * (FORCE_FIR_LENGTH - 1));
+  force_history[0] = force_sum;
+  force_sum = 0;
+  force_count = 0;
+
+  uint32_t filtered = 0;
+  uint8_t idx;
+  for (idx = 0; idx < FORCE_FIR_LENGTH; idx++) {
+    filtered += (uint32_t)force_fir_taps[idx] * force_history[idx];
+  }
+  force.value = (filtered + (force_divisor >> 1)) / force_divisor;
+  force.time = masterclock;
+  force.seq++;
+}
+
+
+uint16_t adc_get_force(uint32_t *time)
+{
+  uint8_t seq;
+  uint16_t value;
+  do {
+    seq = force.seq;
+    value = force.value;
+    *time = force.time;
+  } while (seq != force.seq);
+  return(value);
+}
+#endif
+
+
 ISR(ADC_vect)
 {
+  ISR_TIMING_START();
   // Store raw ADC reading
   raw_adc_readings[active_channel] = ADC;
   
-  // Update the active channel
-  active_channel = (active_channel == REV) ? X : active_channel + 1;
+  #ifdef FORCE_OVERSAMPLING
+    // Every other conversion is the force. The rest round robin through the other channels.
+    if (active_channel == FORCE) {
+      adc_force_sample(raw_adc_readings[FORCE]);
+      active_channel = next_channel;
+      next_channel = (next_channel == C) ? REV : ((next_channel == REV) ? X : next_channel + 1);
+    } else {
+      active_channel = FORCE;
+    }
+  #else
+    // Update the active channel
+    active_channel = (active_channel == REV) ? X : active_channel + 1;
+  #endif
   
   // Setup the ADC to read from the next channel and
   // trigger an interupt once ADC conversion is completed
   setup_adc_channel(channel_map[active_channel]);
-
+  ISR_TIMING_STOP(ISR_TIMING_ADC);
 }
 
 void adc_init()
@@ -92,6 +164,14 @@ void adc_init()
   // Set ADC reference
   ADMUX |= (1 << REFS0);
 
+  #ifdef FORCE_OVERSAMPLING
+    force_divisor = 0;
+    uint8_t idx;
+    for (idx = 0; idx < FORCE_FIR_LENGTH; idx++) { force_divisor += force_fir_taps[idx]; }
+    force_divisor *= FORCE_OVERSAMPLING;
+    next_channel = Y;
+  #endif
+
   // Start cycling through the ADC channels
   active_channel = X;
   setup_adc_channel(active_channel);
@@ -18,4 +18,10 @@ uint16_t raw_adc_readings[VOLTAGE_SENSOR_COUNT];
 
 void adc_init();
 
+#ifdef FORCE_OVERSAMPLING
+// Returns the latest filtered force reading, in counts, and sets time to the masterclock time of
+// its last sample. Safe to call from any context, interrupts included.
+uint16_t adc_get_force(uint32_t *time);
+#endif
+
 #endif
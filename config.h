@@ -36,9 +36,37 @@
 // Check the gap between magazines and activate alarm if magazine is missing
 #define MAG_GAP_CHECK_ENABLE 1
 
+// Learns the carousel magazine edges with a $MC calibration sweep and keeps them in EEPROM. A
+// carousel probe then rapids to MAGAZINE_SEEK_MARGIN short of the first learned edge on its way
+// and only probes the rest of the way at the programmed feed rate. The sensor is watched during
+// both moves, so a magazine that is not on the map still stops the carousel where it used to.
+// The carousel circumference is the C max travel ($15). Comment to disable.
+#define MAGAZINE_MAP_SIZE 32     // Max magazines on the map. 4 bytes of RAM and EEPROM each.
+#define MAGAZINE_SEEK_MARGIN 2.0 // Distance before a learned edge that is probed at feed rate (mm)
+
+// Adds G38.6 scan probing. Unlike G38.2, the move runs through to its target at the programmed feed
+// rate and records every rising and falling edge of the P word sensor with its step position. The
+// edges are reported in one batch when the move completes. The sensor interrupts latch edges into a
+// RAM ring, which is drained into the SPI SRAM above the planner spill ring when SPI is enabled
+// ($44). Without SPI, a scan holds at most PROBE_SCAN_RING-1 edges. Comment to disable.
+#define PROBE_SCAN_RING 16 // Edges latched in RAM. Power of two. 17 bytes each.
+
 // Serial baud rate
 #define BAUD_RATE 38400
 
+// Adds a binary framed host protocol next to ASCII. The host switches over with $K after it
+// connects, and a reset goes back to ASCII. Frames carry sequence numbers and a CRC-16, are
+// acknowledged in bulk and can be resent. Moves are sent with fixed-point machine coordinates
+// and skip the g-code parser. See frame.h for the format. Comment to disable.
+#define BINARY_FRAMING
+
+// Report output that doesn't fit the serial write buffer spills into the top of the SPI SRAM when SPI
+// is enabled ($44), and is fed back to the buffer by the main program as it drains. Without SPI, or
+// once the spill is full, output waits for room but keeps preparing step segments meanwhile. Either
+// way a long report never starves the steppers. Status reports never wait. They are held back until
+// the buffer has room, and replaced by a newer one meanwhile. Comment to disable the spill.
+#define TX_SPILL_SIZE 4096 // Bytes of SPI SRAM. Power of two.
+
 // Default cpu mappings. Grbl officially supports the Arduino Uno only. Other processor types
 // may exist from user-supplied templates or directly user-defined in cpu_map.h
 //#define CPU_MAP_ATMEGA2560  //Arduino Mega 2560
@@ -59,6 +87,30 @@
 #define CMD_VOLTAGE_REPORT '|'
 #define CMD_LINE_START '@'    //special start, not picked off, to ensure proper sequencing.
 #define CMD_EDGE_REPORT '%'
+#define CMD_JOG_CANCEL 0x85 // Decelerates an active $J jog to a stop and discards the queued jogs.
+
+// Feed and rapid override commands. Picked off the serial stream like the runtime commands above,
+// these scale the programmed feed rates and the rapid rate of every buffered block while running.
+// Extended ASCII codes are used, since they never appear in g-code or the KeyMe line protocol.
+#define CMD_FEED_OVR_RESET 0x90         // Restores feed override value to 100%.
+#define CMD_FEED_OVR_COARSE_PLUS 0x91
+#define CMD_FEED_OVR_COARSE_MINUS 0x92
+#define CMD_FEED_OVR_FINE_PLUS  0x93
+#define CMD_FEED_OVR_FINE_MINUS  0x94
+#define CMD_RAPID_OVR_RESET 0x95        // Restores rapid override value to 100%.
+#define CMD_RAPID_OVR_MEDIUM 0x96
+#define CMD_RAPID_OVR_LOW 0x97
+
+// Feed and rapid override limits and increments, in percent of the programmed rate. Feed overrides
+// are still limited by the axis maximum rates. Homing and force servo motions are never overridden.
+#define DEFAULT_FEED_OVERRIDE           100 // 100%. Don't change this value.
+#define MAX_FEED_RATE_OVERRIDE          200 // Percent of programmed feed rate (100-255). Usually 120% or 200%
+#define MIN_FEED_RATE_OVERRIDE           10 // Percent of programmed feed rate (1-100). Usually 50% or 1%
+#define FEED_OVERRIDE_COARSE_INCREMENT   10 // (1-99). Usually 10%.
+#define FEED_OVERRIDE_FINE_INCREMENT      1 // (1-99). Usually 1%.
+#define DEFAULT_RAPID_OVERRIDE  100 // 100%. Don't change this value.
+#define RAPID_OVERRIDE_MEDIUM    50 // Percent of rapid (1-99). Usually 50%.
+#define RAPID_OVERRIDE_LOW       25 // Percent of rapid (1-99). Usually 25%.
 
 // If homing is enabled, homing init lock sets Grbl into an alarm state upon power up. This forces
 // the user to perform the homing cycle (or override the locks) before doing anything else. This is
@@ -92,6 +144,13 @@
 // greater.
 #define N_HOMING_LOCATE_CYCLE 1 // Integer (1-128)
 
+// Homes in a single pass at the seek rates, without the debounce delay and slow locate passes. The
+// limit pin interrupt latches the step position of each switch edge, so stopping a few steps past
+// it does not matter. The edge trips late at seek speed, by the calibrated edge offset of the axis
+// ($55-$58), which is applied to the latched position. Calibrate each offset as the difference
+// between the home positions found with and without this option. Uncomment to enable.
+// #define HOMING_EDGE_LATCH
+
 // Number of blocks Grbl executes upon startup. These blocks are stored in EEPROM, where the size
 // and addresses are defined in settings.h. With the current settings, up to 3 startup blocks may
 // be stored and executed in order. These startup blocks would typically be used to set the g-code
@@ -132,6 +191,15 @@
 // step smoothing. See stepper.c for more details on the AMASS system works.
 #define ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING  // Default enabled. Comment to disable.
 
+// Runs the step segment generator in stepper.c in fixed-point arithmetic instead of floating point.
+// The AVR has no FPU, so every soft-float operation in st_prep_buffer() costs hundreds of cycles. The
+// fixed-point units track distances in 1/256 steps, speeds, accelerations and segment time in 16.16
+// scaled integers and segment timing in CPU cycles, so the per-segment ramp loop and step rate math
+// run entirely in integer arithmetic. Velocity profiles are still computed from the planner's float
+// block data, but only once per block or re-plan. Step counts per block are identical to the float
+// build and block execution times agree to within 0.1%.
+// #define FIXED_POINT_SEGMENT_PREP // Default disabled. Uncomment to enable.
+
 // Sets which axis the tool length offset is applied. Assumes the spindle is always parallel with
 // the selected axis with the tool oriented toward the negative direction. In other words, a positive
 // tool length offset value is subtracted from the current location.
@@ -167,6 +235,12 @@
 // NOTE: Arcs are now generated by a chordal tolerance
 #define N_ARC_CORRECTION 20 // Integer (1-255)
 
+// Plans each G2/G3 arc as a single planner block instead of chopping it into line blocks in mc_arc().
+// The segment generator traces the arc itself, with a chord per step segment kept within the $21
+// arc tolerance, so arcs no longer use up the planner buffer and the serial link. Arc speed is also
+// limited by the centripetal acceleration. Planner blocks take 13 bytes more each. Comment to disable.
+#define NATIVE_ARCS
+
 // Time delay increments performed during a dwell. The default value is set at 50ms, which provides
 // a maximum time delay of roughly 55 minutes, more than enough for most any application. Increasing
 // this delay will increase the maximum dwell time linearly, but also reduces the responsiveness of
@@ -192,6 +266,25 @@
 // up with planning new incoming motions as they are executed.
 // #define BLOCK_BUFFER_SIZE 18  // Uncomment to override default in planner.h.
 
+// Extends the planner look-ahead past the block buffer into the external 23K256 SPI SRAM. The block
+// buffer becomes a hot window in internal RAM, which the stepper executes from. Newer blocks are
+// planned just the same, but wait in a spill ring in the SPI SRAM and are prefetched into the hot
+// window as blocks retire. Dense short-segment paths, like key profile cuts, get enough look-ahead
+// distance to reach their nominal speeds. Each block takes sizeof(plan_block_t) bytes of the 32KB
+// SRAM, and planner.c checks that the ring fits below the serial write spill.
+// NOTE: The hot window is 32 blocks instead of 48 (see cpu_map), which is all the planner has when
+// SPI is disabled ($44). Comment to disable on machines that run without SPI.
+#define PLANNER_SPILL_SIZE 256 // Blocks in SPI SRAM. Default 256.
+
+// Folds nearly collinear moves into the previous planner block, if it is not executing yet, so dense
+// toolpaths take fewer blocks, junctions and planner passes. A move is merged when its direction
+// changes by less than PLANNER_MERGE_MIN_COS allows and the merged line stays within the $54 merge
+// tolerance of every original line end. The line number of each merged move is still reported when
+// its part of the merged block completes. Only moves with the same feed rate are merged, and
+// never homing, probing, force servo or jog motions. Comment to disable.
+#define PLANNER_MERGE_MARKS 64     // Merged line ends in flight. 4 bytes each. Default 64.
+#define PLANNER_MERGE_MIN_COS 0.99 // Cosine of the largest merged direction change (8 deg).
+
 // Governs the size of the intermediary step segment buffer between the step execution algorithm
 // and the planner blocks. Each segment is set of steps executed at a constant velocity over a
 // fixed time defined by ACCELERATION_TICKS_PER_SECOND. They are computed such that the planner
@@ -200,6 +293,13 @@
 // before having to come back and refill this buffer, currently at ~50msec of step moves.
 // #define SEGMENT_BUFFER_SIZE 6 // Uncomment to override default in stepper.h.
 
+// Also prepares step segments from a 1kHz interrupt, Timer1 compare B next to the systick, so the
+// segment buffer stays topped up while the main program is held up in the g-code parser, EEPROM
+// writes, delays or long reports. The interrupt re-enables interrupts, so the stepper and serial
+// interrupts preempt it. It skips its turn while the main program prepares segments, changes the
+// planner or uses the SPI bus, which the planner spill prefetch shares. Uncomment to enable.
+// #define SEGMENT_PREP_ISR
+
 // Line buffer size from the serial input stream to be executed. Also, governs the size of
 // each of the startup blocks, as they are each stored as a string of this size. Make sure
 // to account for the available EEPROM at the defined memory address in settings.h and for
@@ -229,6 +329,26 @@
 // work well and are cheap to find) and wire in a low-pass circuit into each limit pin.
 //#define ENABLE_SOFTWARE_DEBOUNCE // Default disabled. Uncomment to enable.
 
+// Records the duration of the step, serial, ADC and feedback pin change interrupts into log-scale
+// histograms, timed by free running Timer5 at 0.5usec resolution. The $T command prints the count,
+// min, max, 99th percentile and histogram of each, then clears them. Costs about 360 bytes of RAM
+// and roughly 40 cycles per instrumented interrupt. Comment to disable.
+#define ISR_TIMING_HISTOGRAM // Default enabled. Comment to disable.
+
+// Runs every step tick through the one step ISR body with all sensor checks, in place of the
+// variant selected from the armed checks. Only meant as the baseline when timing the variants
+// with $T. Default disabled. Uncomment to enable.
+//#define STEP_ISR_SINGLE_VARIANT
+
+// Samples the load cell on every other ADC conversion, at about 4.8kHz instead of 1.6kHz, and
+// filters it in the ADC interrupt. Each FORCE_OVERSAMPLING samples are summed into one decimated
+// value (a first order CIC filter), and the decimated values are run through an FIR filter with
+// the FORCE_FIR_TAPS taps. The latest force and its masterclock time are published lock-free to
+// the force servo and the step ISR. The main loop does no filtering, and the force no longer
+// waits on the 10ms signals poll. Comment to filter the raw readings with the 3-tap Hanning filter.
+#define FORCE_OVERSAMPLING 16  // Samples per decimated value. Power of two, 64 at most.
+#define FORCE_FIR_TAPS 1, 2, 1 // FIR taps, newest first. Hanning by default.
+
 // ---------------------------------------------------------------------------------------
 
 // TODO: Install compile-time option to send numeric status codes rather than strings.
@@ -20,6 +20,9 @@
 
 #include "system.h"
 #include "counters.h"
+#include "stepper.h"
+#include "magazine.h"
+#include "isr_timing.h"
 
 uint32_t alignment_debounce_timer=0;
 #define PROBE_DEBOUNCE_DELAY_MS 25
@@ -35,6 +38,10 @@ void counters_init()
   FDBK_PORT |= FDBK_MASK;   // Enable internal pull-up resistors. Normal high operation.
   counters.state = FDBK_PIN&FDBK_MASK; //record initial state
 
+  // The alignment sensor is always interrupt driven, to catch magazine edges.
+  FDBK_PCMSK |= (1<<ALIGN_SENSE_BIT);
+  PCICR |= (1 << FDBK_INT);   // Enable Pin Change Interrupt
+
   counters_enable(0); //default to no encoder
 }
 
@@ -43,13 +50,11 @@ void counters_enable(int enable)
 {
   if (enable) {
     FDBK_PCMSK |= FDBK_MASK;    // Enable specific pins of the Pin Change Interrupt
-    PCICR |= (1 << FDBK_INT);   // Enable Pin Change Interrupt
   }
   else {
-    FDBK_PCMSK &= ~FDBK_MASK;    // Disable specific pins of the Pin Change Interrupt
-    PCICR &= ~(1 << FDBK_INT);   // Disable Pin Change Interrupt
+    FDBK_PCMSK = (FDBK_PCMSK & ~FDBK_MASK) | (1<<ALIGN_SENSE_BIT); // Keep the alignment sensor
   }
-
+  counters.enabled = enable;
 }
 
 
@@ -80,6 +85,7 @@ int debounce(uint32_t* bounce_clock, uint16_t lockout_ms) {
 
 
 ISR(FDBK_INT_vect) {
+  ISR_TIMING_START();
   uint8_t state =  FDBK_PIN&FDBK_MASK;
   uint8_t change = (state^counters.state);
 
@@ -107,11 +113,17 @@ ISR(FDBK_INT_vect) {
 
   //count conveyor axis alignment pulses.
   if (change & (1<<ALIGN_SENSE_BIT)) { //sensor changed
-    if (debounce(&alignment_debounce_timer, PROBE_DEBOUNCE_DELAY_MS)){
+    if (counters.enabled && debounce(&alignment_debounce_timer, PROBE_DEBOUNCE_DELAY_MS)){
       if (!(state & MAGAZINE_ALIGNMENT_MASK)) { //low is on.
         counters.counts[C_AXIS]++;
       }
     }
   }
   counters.state = state;
+
+  // Magazine edges, unless the stepper ISR is mid-tick and will service it itself.
+  if (change & (1<<ALIGN_SENSE_BIT)) {
+    if (!st_defer_edge(EDGE_SOURCE_MAGAZINE)) { magazine_pin_change(); }
+  }
+  ISR_TIMING_STOP(ISR_TIMING_FDBK);
 }
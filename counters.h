@@ -29,6 +29,7 @@ typedef struct  counters {
   uint8_t state;
   uint8_t anew; //new a encode
   uint8_t bold; //old b encoder
+  uint8_t enabled; //count pulses
 } counters_t;
 
 extern counters_t counters;
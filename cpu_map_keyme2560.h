@@ -9,9 +9,13 @@
 #define SERIAL_UDRE USART0_UDRE_vect
 
 // Increase Buffers to make use of extra SRAM
-#define RX_BUFFER_SIZE          255
+#define RX_BUFFER_SIZE          256
 #define TX_BUFFER_SIZE          128
+#ifdef PLANNER_SPILL_SIZE
+#define BLOCK_BUFFER_SIZE       32  // Hot window. The look-ahead continues in the SPI SRAM.
+#else
 #define BLOCK_BUFFER_SIZE       48
+#endif
 #define LINE_BUFFER_SIZE        255
 
 /* SPI PORTS */
@@ -128,6 +132,14 @@
 #define LIMIT_ENABLE    LIMIT_MASK
 #define LIMIT_INT_vect  INT0_vect
 #define LIMIT_INT2_vect INT1_vect
+#define LIMIT_INT3_vect INT2_vect
+#define LIMIT_INT4_vect INT3_vect
+
+// Free running timer for the ISR timing histograms
+#define ISR_TIMING_TCCRA   TCCR5A
+#define ISR_TIMING_TCCRB   TCCR5B
+#define ISR_TIMING_TCNT    TCNT5
+#define ISR_TIMING_CS      (1<<CS51) // 1/8 prescaler, 0.5usec per tick
 
 #define TIMING_DDR DDRA
 #define TIMING_PORT PORTA
@@ -55,6 +55,7 @@
   #define DEFAULT_SOFT_LIMIT_ENABLE 0 // false
   #define DEFAULT_HARD_LIMIT_ENABLE 0  // false
   #define DEFAULT_HOMING_ENABLE 0  // false
+  #define DEFAULT_REPORT_BUFFERS 0 // false
   #define DEFAULT_HOMING_DIR_MASK 0 // move positive dir
   #define DEFAULT_HOMING_FEED_RATE 25.0 // mm/min
   #define DEFAULT_HOMING_SEEK_RATE 500.0 // mm/min
@@ -96,6 +97,7 @@
   #define DEFAULT_SOFT_LIMIT_ENABLE 0 // false
   #define DEFAULT_HARD_LIMIT_ENABLE 0  // false
   #define DEFAULT_HOMING_ENABLE 1  // false
+  #define DEFAULT_REPORT_BUFFERS 0 // false
   #define DEFAULT_HOMING_DIR_MASK 0 // move positive dir (negative with keyme mods)
   #define DEFAULT_HOMING_FEED_RATE 100.0 // mm/min
   #define DEFAULT_X_HOMING_SEEK_RATE 200.0 // mm/min
@@ -119,6 +121,21 @@
   #define DEFAULT_Y_MICROSTEPS 2
   #define DEFAULT_Z_MICROSTEPS 1
   #define DEFAULT_C_MICROSTEPS 2
+  #define DEFAULT_X_JERK 0.0 // mm/sec^3. 0 keeps trapezoid profiles.
+  #define DEFAULT_Y_JERK 0.0
+  #define DEFAULT_Z_JERK 0.0
+  #define DEFAULT_C_JERK 0.0
+  #define DEFAULT_MERGE_TOLERANCE 0.002 // mm. 0 disables merging of collinear moves.
+  #define DEFAULT_X_HOMING_EDGE_OFFSET 0.0 // mm. Calibrated per machine.
+  #define DEFAULT_Y_HOMING_EDGE_OFFSET 0.0
+  #define DEFAULT_Z_HOMING_EDGE_OFFSET 0.0
+  #define DEFAULT_C_HOMING_EDGE_OFFSET 0.0
+  #define DEFAULT_FORCE_SERVO_KP 0.0 // (mm/min)/count. 0 keeps the bang-bang force servo.
+  #define DEFAULT_FORCE_SERVO_KI 0.0
+  #define DEFAULT_FORCE_SERVO_KD 0.0
+  #define DEFAULT_FORCE_SERVO_BAND 2 // counts
+  #define DEFAULT_STATUS_REPORT_INTERVAL 0 // ms. 0 reports on request only.
+  #define DEFAULT_STATUS_REPORT_MASK (STATUS_FIELD_POSITION|STATUS_FIELD_STEPS|STATUS_FIELD_OVERRIDES)
 #endif
 
 #ifdef DEFAULTS_BENCH
@@ -153,6 +170,7 @@
   #define DEFAULT_SOFT_LIMIT_ENABLE 0 // false
   #define DEFAULT_HARD_LIMIT_ENABLE 0  // false
   #define DEFAULT_HOMING_ENABLE 1  // false
+  #define DEFAULT_REPORT_BUFFERS 0 // false
   #define DEFAULT_HOMING_DIR_MASK 0 // move positive dir
   #define DEFAULT_HOMING_FEED_RATE 10.0 // mm/min
   #define DEFAULT_HOMING_SEEK_RATE 20.0 // mm/min
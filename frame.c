@@ -0,0 +1,251 @@
+/*
+  Not part of Grbl. KeyMe specific.
+*/
+
+#include <util/crc16.h>
+#include "system.h"
+#include "frame.h"
+#include "serial.h"
+#include "protocol.h"
+#include "gcode.h"
+#include "motion_control.h"
+#include "planner.h"
+#include "report.h"
+
+uint8_t frame_mode;
+
+static struct {
+  uint8_t buffer[FRAME_BUFFER_SIZE];
+  uint8_t length;
+  uint8_t escaped;
+  uint8_t overflow;
+  uint8_t expected;     // Sequence number of the next frame to execute
+  uint8_t nak_sent;     // Frames are dropped without another NAK until the expected one arrives
+  uint8_t ack_pending;  // Frames executed since the last acknowledgement
+  uint8_t tx_open;      // A device frame is being sent, and needs its CRC and delimiter
+  uint16_t tx_crc;
+} frame;
+
+
+static void frame_end();
+
+void frame_init()
+{
+  frame_end(); // Finish a text frame cut short by a reset, so the host stays in sync.
+  memset(&frame, 0, sizeof(frame));
+  frame_mode = false;
+}
+
+void frame_start()
+{
+  frame_init();
+  frame_mode = true;
+}
+
+// Bytes that can't be sent as they are. Keep in step with the runtime commands picked off by
+// the serial receive interrupt.
+static uint8_t frame_is_reserved(uint8_t data)
+{
+  switch (data) {
+    case FRAME_END: case FRAME_ESC: case '\n': case '\r':
+    case CMD_STATUS_REPORT: case CMD_LIMIT_REPORT: case CMD_COUNTER_REPORT:
+    case CMD_VOLTAGE_REPORT: case CMD_CYCLE_START: case CMD_FEED_HOLD: case CMD_RESET:
+    case CMD_JOG_CANCEL: case CMD_FEED_OVR_RESET: case CMD_FEED_OVR_COARSE_PLUS:
+    case CMD_FEED_OVR_COARSE_MINUS: case CMD_FEED_OVR_FINE_PLUS: case CMD_FEED_OVR_FINE_MINUS:
+    case CMD_RAPID_OVR_RESET: case CMD_RAPID_OVR_MEDIUM: case CMD_RAPID_OVR_LOW:
+      return(true);
+  }
+  return(false);
+}
+
+static void frame_send_byte(uint8_t data)
+{
+  if (frame_is_reserved(data)) {
+    serial_sendchar(FRAME_ESC);
+    data ^= FRAME_ESC_XOR;
+  }
+  serial_sendchar(data);
+}
+
+static void frame_put(uint8_t data)
+{
+  frame.tx_crc = _crc_xmodem_update(frame.tx_crc, data);
+  frame_send_byte(data);
+}
+
+static void frame_begin(uint8_t opcode)
+{
+  serial_sendchar(FRAME_END);
+  frame.tx_crc = 0;
+  frame.tx_open = true;
+  frame_put(opcode);
+}
+
+static void frame_end()
+{
+  if (!frame.tx_open) { return; }
+  uint16_t crc = frame.tx_crc;
+  frame_send_byte(crc >> 8);
+  frame_send_byte(crc & 0xff);
+  serial_sendchar(FRAME_END);
+  frame.tx_open = false;
+}
+
+static void frame_send(uint8_t opcode, uint8_t *payload, uint8_t length)
+{
+  frame_end(); // Ends an unfinished text line. The host gets the rest in the next text frame.
+  frame_begin(opcode);
+  uint8_t idx;
+  for (idx = 0; idx < length; idx++) { frame_put(payload[idx]); }
+  frame_end();
+}
+
+void frame_write(uint8_t data)
+{
+  if (!frame.tx_open) { frame_begin(FRAME_OP_TEXT); }
+  frame_put(data);
+  if (data == '\n') { frame_end(); }
+}
+
+static void frame_nak()
+{
+  if (frame.nak_sent) { return; }
+  frame.nak_sent = true;
+  frame_send(FRAME_OP_NAK, &frame.expected, 1);
+}
+
+void frame_flush_ack()
+{
+  if (!frame.ack_pending) { return; }
+  frame.ack_pending = 0;
+  // Carry the free planner blocks and read buffer bytes, like the ASCII ok with $63 set
+  uint16_t blocks = plan_get_block_buffer_available();
+  uint8_t ack[4] = { frame.expected-1, blocks & 0xff, blocks >> 8, serial_get_rx_buffer_available() };
+  frame_send(FRAME_OP_ACK, ack, 4);
+}
+
+// Payload: axis mask, line number (uint16), feed rate in mm/min (uint16, 0 for a rapid) and the
+// machine position of each axis in the mask in microns (int32). All little endian, like the AVR.
+// Skips the g-code parser. The modal state is left as it is, only the parser position follows.
+static uint8_t frame_execute_move(uint8_t *payload, uint8_t length)
+{
+  if (length < 5) { return(STATUS_INVALID_STATEMENT); }
+  if (sys.state == STATE_ALARM) { return(STATUS_ALARM_LOCK); }
+
+  uint8_t axes = payload[0];
+  linenumber_t line_number = payload[1] | ((uint16_t)payload[2] << 8);
+  uint16_t feed_rate = payload[3] | ((uint16_t)payload[4] << 8);
+  if (line_number > LINENUMBER_MAX) { return(STATUS_GCODE_INVALID_LINE_NUMBER); }
+  payload += 5;
+  length -= 5;
+
+  float target[N_AXIS];
+  uint8_t idx;
+  for (idx = 0; idx < N_AXIS; idx++) {
+    if (axes & bit(idx)) {
+      if (length < sizeof(int32_t)) { return(STATUS_INVALID_STATEMENT); }
+      int32_t microns;
+      memcpy(&microns, payload, sizeof(int32_t));
+      target[idx] = 0.001*microns;
+      payload += sizeof(int32_t);
+      length -= sizeof(int32_t);
+    } else {
+      target[idx] = gc_state.position[idx];
+    }
+  }
+  if (length) { return(STATUS_INVALID_STATEMENT); }
+
+  mc_line(target, feed_rate ? feed_rate : -1.0, false, line_number);
+  memcpy(gc_state.position, target, sizeof(target));
+  return(STATUS_OK);
+}
+
+static uint8_t frame_execute(uint8_t opcode, uint8_t *payload, uint8_t length)
+{
+  switch (opcode) {
+    case FRAME_OP_LINE:
+    {
+      // Drop whitespace and capitalize, like the ASCII protocol. Comments are not supported.
+      // The line is built over the frame from the start, which never overtakes the payload.
+      char *line = (char*)frame.buffer;
+      uint8_t idx, count = 0;
+      for (idx = 0; idx < length; idx++) {
+        char c = payload[idx];
+        if (c > ' ') { line[count++] = (c >= 'a' && c <= 'z') ? (c - 'a' + 'A') : c; }
+      }
+      line[count] = 0;
+      uint8_t status;
+      while ((status = protocol_dispatch_line(line)) == STATUS_IDLE_WAIT);
+      return(status);
+    }
+    case FRAME_OP_MOVE: return(frame_execute_move(payload, length));
+    case FRAME_OP_ASCII: return(STATUS_OK);
+  }
+  return(STATUS_INVALID_STATEMENT);
+}
+
+static void frame_process()
+{
+  if (frame.length < 4) {
+    frame_nak();
+    return;
+  }
+  uint16_t crc = 0;
+  uint8_t idx;
+  for (idx = 0; idx < frame.length-2; idx++) { crc = _crc_xmodem_update(crc, frame.buffer[idx]); }
+  if (crc != (((uint16_t)frame.buffer[idx] << 8) | frame.buffer[idx+1])) {
+    frame_nak();
+    return;
+  }
+
+  uint8_t seq = frame.buffer[0];
+  uint8_t opcode = frame.buffer[1];
+  uint8_t ahead = seq - frame.expected;
+  if (ahead) {
+    // A resend of a frame that already executed needs another acknowledgement. A frame from
+    // the future means one went missing.
+    if (ahead & 0x80) { frame.ack_pending = max(frame.ack_pending, 1); }
+    else { frame_nak(); }
+    return;
+  }
+  frame.expected++;
+  frame.nak_sent = false;
+
+  uint8_t status = frame_execute(opcode, &frame.buffer[2], frame.length-4);
+  if (sys.abort) { return; }
+  if (status != STATUS_OK) {
+    uint8_t report[2] = { seq, status };
+    frame_send(FRAME_OP_STATUS, report, 2);
+  }
+
+  frame.ack_pending++;
+  if (opcode == FRAME_OP_ASCII) {
+    frame_flush_ack();
+    frame_init();
+  } else if (frame.ack_pending >= FRAME_ACK_INTERVAL) {
+    frame_flush_ack();
+  }
+}
+
+void frame_receive(uint8_t data)
+{
+  if (data == FRAME_END) {
+    // Empty frames are the leading delimiters. A frame too long for the buffer is bad.
+    if (frame.overflow) { frame_nak(); }
+    else if (frame.length) { frame_process(); }
+    frame.length = 0;
+    frame.escaped = false;
+    frame.overflow = false;
+    return;
+  }
+  if (data == FRAME_ESC) {
+    frame.escaped = true;
+    return;
+  }
+  if (frame.escaped) {
+    data ^= FRAME_ESC_XOR;
+    frame.escaped = false;
+  }
+  if (frame.length == FRAME_BUFFER_SIZE) { frame.overflow = true; }
+  else { frame.buffer[frame.length++] = data; }
+}
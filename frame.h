@@ -0,0 +1,65 @@
+/*
+  Not part of Grbl. KeyMe specific.
+
+  Binary framed host protocol. Entered with $K, left with a reset or an ASCII frame.
+
+  Frames are SLIP style, delimited by FRAME_END. Bytes that would collide with FRAME_END,
+  FRAME_ESC, a line ending or a runtime command character are sent as FRAME_ESC followed by the
+  byte XOR FRAME_ESC_XOR, so runtime commands keep working while frames are streamed.
+
+  Host frame:   END seq opcode payload.. crc_hi crc_lo END
+  Device frame: END opcode payload.. crc_hi crc_lo END
+
+  The CRC is CRC-16/XMODEM over everything between the delimiters but the CRC itself. Frames
+  are executed in sequence order. The device acknowledges the last executed sequence number
+  once the receive buffer runs dry or every FRAME_ACK_INTERVAL frames. A bad or out of order
+  frame is answered with one NAK carrying the expected sequence number, and the host resends
+  from there. Frames that fail report their status, everything acknowledged succeeded.
+
+  All other output, like reports, messages and $ settings, goes out one line per text frame,
+  starting with the ok of $K. The per-line checksum byte of the ASCII protocol is left off, the
+  CRC covers the line instead. No raw byte is ever sent between frames.
+*/
+
+#ifndef frame_h
+#define frame_h
+
+#include "system.h"
+
+#define FRAME_END      0xC0
+#define FRAME_ESC      0xDB
+#define FRAME_ESC_XOR  0x40
+
+#define FRAME_BUFFER_SIZE 128 // Decoded host frame. Sequence number, opcode, payload and CRC.
+#define FRAME_ACK_INTERVAL 8  // Executed frames between acknowledgements while streaming
+
+// Host opcodes
+#define FRAME_OP_LINE  0x01 // ASCII g-code or $ line, without the line ending.
+#define FRAME_OP_MOVE  0x02 // Linear move. See frame_execute_move().
+#define FRAME_OP_ASCII 0x03 // Go back to the ASCII protocol.
+
+// Device opcodes
+#define FRAME_OP_ACK    0x80 // seq, blocks (uint16), rx: Last executed frame and free buffers.
+#define FRAME_OP_NAK    0x81 // seq: Expected frame. Resend from here.
+#define FRAME_OP_STATUS 0x82 // seq, status: Frame that did not execute with STATUS_OK.
+#define FRAME_OP_TEXT   0x83 // ASCII output up to and including its line ending.
+
+// Set while the host streams frames instead of ASCII lines
+extern uint8_t frame_mode;
+
+// Returns to the ASCII protocol. Called on reset.
+void frame_init();
+
+// Switches to the binary protocol. Called by $K, whose ok is the first text frame.
+void frame_start();
+
+// Feeds one received byte to the frame decoder. Complete frames are executed right away.
+void frame_receive(uint8_t data);
+
+// Sends an ASCII output byte in a text frame. Called by serial_write() in frame mode.
+void frame_write(uint8_t data);
+
+// Sends the pending acknowledgement. Called once the receive buffer is empty.
+void frame_flush_ack();
+
+#endif
@@ -123,6 +123,16 @@ uint8_t gc_execute_line(char *line)
   uint8_t mantissa = 0; // NOTE: For mantissa values > 255, variable type must be changed to uint16_t.
   uint8_t retval = STATUS_OK;
 
+  // Jog commands are passed in with their '$J=' prefix by system_execute_line(). A jog is always
+  // a G1 move in units per minute mode, regardless of the current parser state.
+  uint8_t jog_motion = false;
+  if (line[0] == '$') {
+    jog_motion = true;
+    char_counter = 3; // Skip '$J='
+    gc_block.modal.motion = MOTION_MODE_LINEAR;
+    gc_block.modal.feed_rate = FEED_RATE_MODE_UNITS_PER_MIN;
+  }
+
   while (line[char_counter] != 0) { // Loop until no more g-code words in line. 
     // Import the next g-code word, expecting a letter followed by a value. Otherwise, error out.
     letter = line[char_counter];
@@ -149,6 +159,9 @@ uint8_t gc_execute_line(char *line)
          NOTE: Modal group numbers are defined in Table 4 of NIST RS274-NGC v3, pg.20 */
          
       case 'G':
+        // Jogs only accept units, distance mode and machine coordinate commands.
+        if (jog_motion && !(int_value == 20 || int_value == 21 || int_value == 66 || int_value == 90 ||
+                            int_value == 91 || int_value == 53)) { FAIL(STATUS_INVALID_JOG_COMMAND); }
         // Determine 'G' command and its modal group
         switch(int_value) {
           case 10: case 28: case 30: case 92: 
@@ -209,6 +222,11 @@ uint8_t gc_execute_line(char *line)
                   case 20:  // G38.2
                     gc_block.modal.motion = MOTION_MODE_PROBE; 
                     break;
+                  #ifdef PROBE_SCAN_RING
+                  case 60:  // G38.6 Scan. Records every sensor edge along the move.
+                    gc_block.modal.motion = MOTION_MODE_PROBE_SCAN;
+                    break;
+                  #endif
                   // NOTE: If G38.3+ are enabled, change mantissa variable type to uint16_t.
                   // case 30: gc_block.modal.motion = MOTION_MODE_PROBE_NO_ERROR; break; // G38.3 Not supported.
                   // case 40: // Not supported.
@@ -278,6 +296,7 @@ uint8_t gc_execute_line(char *line)
 
       case 'M':
       
+        if (jog_motion) { FAIL(STATUS_INVALID_JOG_COMMAND); } // [No M commands in a jog]
         // Determine 'M' command and its modal group
         if (mantissa > 0) { FAIL(STATUS_GCODE_COMMAND_VALUE_NOT_INTEGER); } // [No Mxx.x commands]
         switch(int_value) {
@@ -424,7 +443,8 @@ uint8_t gc_execute_line(char *line)
     // a feed rate, we simply move on and the state feed rate value gets updated to zero and remains undefined.
   } else { // = G94
     // - In units per mm mode: If F word passed, ensure value is in mm/min, otherwise push last state value.
-    if (gc_state.modal.feed_rate == FEED_RATE_MODE_UNITS_PER_MIN) { // Last state is also G94
+    // NOTE: A jog is always G94 and must pass its own F word, so it converts like a G94 block.
+    if (gc_state.modal.feed_rate == FEED_RATE_MODE_UNITS_PER_MIN || jog_motion) { // Last state is also G94
       if (bit_istrue(value_words,bit(WORD_F))) {
         if (gc_block.modal.units == UNITS_MODE_INCHES) { gc_block.values.f *= MM_PER_INCH; }
         else if (gc_block.modal.units == UNITS_MODE_STEP) {gc_block.values.f = single_step_speed; } //TODO: not sure about this yet.
@@ -793,7 +813,7 @@ uint8_t gc_execute_line(char *line)
             }
           }
           break;
-        case MOTION_MODE_PROBE:
+        case MOTION_MODE_PROBE: case MOTION_MODE_PROBE_SCAN:
           if (bit_istrue(value_words, bit(WORD_P)))
             bit_false(value_words, bit(WORD_P));
           else
@@ -813,6 +833,21 @@ uint8_t gc_execute_line(char *line)
   
   // [21. Program flow ]: No error check required.
 
+  // [Jogging ]: F word missing. Axis words missing. Any other word. A jog is executed right here and
+  // never updates the parser modal state, only its position.
+  if (jog_motion) {
+    if (bit_isfalse(value_words,bit(WORD_F))) { FAIL(STATUS_GCODE_UNDEFINED_FEED_RATE); } // [F word missing]
+    if (axis_command != AXIS_COMMAND_MOTION_MODE) { FAIL(STATUS_GCODE_NO_AXIS_WORDS); } // [No axis words]
+    bit_false(value_words,(bit(WORD_F)|bit(WORD_X)|bit(WORD_Y)|bit(WORD_Z)|bit(WORD_C)));
+    if (value_words) { FAIL(STATUS_INVALID_JOG_COMMAND); } // [Only F and axis words allowed]
+
+    retval = mc_jog(gc_block.values.xyz, gc_block.values.f);
+    if (retval == STATUS_OK) {
+      memcpy(gc_state.position, gc_block.values.xyz, sizeof(gc_block.values.xyz)); // gc.position[] = target[];
+    }
+    return(retval);
+  }
+
   // [0. Non-specific error-checks]: Complete unused value words check, i.e. IJK used when in arc
   // radius mode, or axis words that aren't used in the block.  
   bit_false(value_words,(bit(WORD_N)|bit(WORD_F)|bit(WORD_S)|bit(WORD_T))); // Remove single-meaning value words. 
@@ -950,6 +985,13 @@ uint8_t gc_execute_line(char *line)
           mc_arc(gc_state.position, gc_block.values.xyz, gc_block.values.ijk, gc_block.values.r, 
             gc_state.feed_rate, gc_state.modal.feed_rate, axis_0, axis_1, axis_linear, gc_block.values.n);  
           break;
+        #ifdef PROBE_SCAN_RING
+        case MOTION_MODE_PROBE_SCAN:
+          probe_scan_sensor(gc_block.values.xyz, gc_state.feed_rate,
+          gc_state.modal.feed_rate, gc_block.values.n, gc_block.values.p);
+          retval = STATUS_QUIET_OK;
+          break;
+        #endif
         case MOTION_MODE_PROBE:          
           probe_move_to_sensor(gc_block.values.xyz, gc_state.feed_rate,
           gc_state.modal.feed_rate, gc_block.values.n, gc_block.values.p); 
@@ -68,6 +68,7 @@
 #define MOTION_MODE_CCW_ARC 3  // G3
 #define MOTION_MODE_PROBE 4 // G38.2
 #define MOTION_MODE_NONE 5 // G80
+#define MOTION_MODE_PROBE_SCAN 6 // G38.6 (KeyMe)
 
 // Modal Group G2: Plane select
 #define PLANE_SELECT_XY 0 // G17 (Default: Must be zero)
@@ -0,0 +1,66 @@
+/*
+  Not part of Grbl. KeyMe specific.
+*/
+
+#include "system.h"
+#include "isr_timing.h"
+
+static isr_timing_t isr_timing[N_ISR_TIMING];
+
+static void isr_timing_clear(isr_timing_t *timing)
+{
+  memset(timing, 0, sizeof(isr_timing_t));
+  timing->min = 0xffff;
+}
+
+void isr_timing_init()
+{
+  uint8_t id;
+  for (id = 0; id < N_ISR_TIMING; id++) {
+    isr_timing_clear(&isr_timing[id]);
+  }
+
+  #ifdef ISR_TIMING_HISTOGRAM
+    ISR_TIMING_TCCRA = 0; // Normal mode, free running
+    ISR_TIMING_TCCRB = ISR_TIMING_CS;
+  #endif
+}
+
+void isr_timing_record(uint8_t id, uint16_t start)
+{
+  uint16_t ticks = ISR_TIMING_TCNT - start;
+  isr_timing_t *timing = &isr_timing[id];
+
+  timing->count++;
+  if (ticks < timing->min) { timing->min = ticks; }
+  if (ticks > timing->max) { timing->max = ticks; }
+
+  // Bucket from the two most significant bits of the duration
+  uint8_t bucket = ticks;
+  if (ticks >= 4) {
+    uint8_t octave = 1;
+    while (ticks >= 4) {
+      ticks >>= 1;
+      octave++;
+    }
+    bucket = 2*octave + (ticks & 1);
+  }
+  if (timing->bucket[bucket] != 0xffff) { timing->bucket[bucket]++; }
+}
+
+void isr_timing_read(uint8_t id, isr_timing_t *timing)
+{
+  uint8_t sreg = SREG;
+  cli();
+  memcpy(timing, &isr_timing[id], sizeof(isr_timing_t));
+  isr_timing_clear(&isr_timing[id]);
+  SREG = sreg;
+}
+
+uint16_t isr_timing_bucket_limit(uint8_t bucket)
+{
+  if (bucket < 3) { return bucket; }
+  if (bucket >= ISR_TIMING_BUCKETS-1) { return 0xffff; }
+  bucket++; // Limit is one below the start of the next bucket
+  return ((2 + (bucket & 1)) << ((bucket >> 1) - 1)) - 1;
+}
@@ -0,0 +1,50 @@
+/*
+  Not part of Grbl. KeyMe specific.
+*/
+
+#ifndef isr_timing_h
+#define isr_timing_h
+
+enum e_isr_timing {
+  ISR_TIMING_STEP = 0,
+  ISR_TIMING_SERIAL_RX,
+  ISR_TIMING_SERIAL_UDRE,
+  ISR_TIMING_ADC,
+  ISR_TIMING_FDBK,
+  N_ISR_TIMING
+};
+
+// Half-octave buckets over the 16-bit tick range. Buckets 0-3 hold 0-3 ticks, then each
+// octave is split in two: [4,5], [6,7], [8,11], [12,15], ... [49152,65535].
+#define ISR_TIMING_BUCKETS 32
+#define ISR_TIMING_TICKS_PER_USEC 2
+
+typedef struct {
+  uint32_t count;  // Interrupts recorded
+  uint16_t min;    // Shortest duration (ticks)
+  uint16_t max;    // Longest duration (ticks)
+  uint16_t bucket[ISR_TIMING_BUCKETS];  // Saturating counts per duration bucket
+} isr_timing_t;
+
+#ifdef ISR_TIMING_HISTOGRAM
+  // Place at the top of an ISR, and ISR_TIMING_STOP() at each exit with interrupts disabled.
+  #define ISR_TIMING_START() uint16_t isr_timing_start = ISR_TIMING_TCNT
+  #define ISR_TIMING_STOP(id) isr_timing_record((id), isr_timing_start)
+#else
+  #define ISR_TIMING_START()
+  #define ISR_TIMING_STOP(id)
+#endif
+
+// Starts the free running timer and clears the histograms
+void isr_timing_init();
+
+// Adds one interrupt duration. Must be called with interrupts disabled.
+void isr_timing_record(uint8_t id, uint16_t start);
+
+// Copies the histogram of an interrupt and clears it
+void isr_timing_read(uint8_t id, isr_timing_t *timing);
+
+// Longest duration (ticks) that falls in a bucket
+uint16_t isr_timing_bucket_limit(uint8_t bucket);
+
+#endif
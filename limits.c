@@ -30,12 +30,17 @@
 #include "signals.h"
 #include "magazine.h"
 #include "nuts_bolts.h"
+#include "probe.h"
 
 #define HOMING_AXIS_SEARCH_SCALAR  1.1  // Axis search distance multiplier. Must be > 1.
 #define MAX_FORCE_SERVO_CYCLES 10
 #define MIN_FORCE_SERVO_CYCLES 2
 #define LONG_FORCE_SERVO_DELAY 1000
 #define SHORT_FORCE_SERVO_DELAY 200
+#define FORCE_SERVO_PID_PERIOD 10 // Control loop period (ms)
+#define FORCE_SERVO_PID_LOOKAHEAD 4 // Control periods of motion kept planned ahead
+#define FORCE_SERVO_PID_SETTLE 5 // Control periods within the settle band to finish
+#define FORCE_SERVO_PID_TIMEOUT 5000 // Gives up on the target force after this long (ms)
 
 limit_t limits={0};
 
@@ -65,6 +70,11 @@ void limits_init()
   homing_line_number = 1;
   servo_line_number = 1;
   limits_configure(); 
+
+  // Interrupt on any edge of the limit pins. Limits are acted upon only while the steppers run.
+  limits.pin_state = LIMIT_PIN & LIMIT_MASK;
+  LIMIT_ICR = LIMIT_INT;
+  LIMIT_PCMSK |= LIMIT_ENABLE;
 }
 
 
@@ -79,63 +89,171 @@ void limits_configure(){
 
 
 void limits_enable(uint8_t axes, uint8_t expected) {
-  //    LIMIT_PCMSK |= LIMIT_MASK; // Enable specific pins of the Pin Change Interrupt
+  uint8_t sreg = SREG;
+  cli();
   limits.expected = bit_istrue(settings.flags,BITFLAG_INVERT_LIMIT_PINS)?~expected:expected;
   limits.active = axes<<LIMIT_BIT_SHIFT;
   limits.mag_gap_check = settings.mag_gap_enabled;
-  memcpy(sys.probe_position, sys.position, sizeof(float) * N_AXIS);
+  limits.stop_mask = 0;
+  st_select_isr_variant();
+  st_get_position(sys.probe_position);
+  if (st_is_running()) { limits_pin_change(); } // Re-evaluate against the new expected state.
+  SREG = sreg;
 }
 
 
 void limits_disable()
 {
-  //LIMIT_PCMSK &= ~LIMIT_MASK;  // Disable specific pins of the Pin Change Interrupt
+  uint8_t sreg = SREG;
+  cli();
   limits.expected = 0;
   limits.active = 0;
+  limits.stop_mask = 0;
+  SREG = sreg;
+}
+
+
+void limits_pin_change()
+{
+  uint8_t pins = LIMIT_PIN & LIMIT_MASK;
+  uint8_t changed = pins ^ limits.pin_state;
+  limits.pin_state = pins;
+
+  // Latch where and when each changed switch tripped, for homing and sensor reports.
+  if (changed) {
+    uint32_t now = masterclock;
+    uint8_t idx;
+    for (idx=0; idx<N_AXIS; idx++) {
+      if (changed & bit(idx+LIMIT_BIT_SHIFT)) {
+        limits.edge_position[idx] = st_get_axis_position(idx);
+        limits.edge_time[idx] = now;
+      }
+    }
+  }
+
+  // The key sensors share the gripper limit pin.
+  if (probe.isprobing) { probe_check(); }
+
+  // Switches are only acted upon while moving. The key sensors toggle freely when idle.
+  if (!st_is_running()) { return; }
+
+  // LIMIT_PIN - Input buffer of port to which home sensors are connected
+  // limits.expected - approach set in limits.c. limits.expected stores what the pins in LIMIT_PIN
+  // should be when the axes are moving and have not reached the home sensor
+  // limits.active - active bit is set in limits.active if axis is homing
+  // If home sensor is reached in LIMIT_PIN and the pin is different than
+  // that of limits.expected and the axis is homing as set in limits.active,
+  // then set the bit for that pin in must_stop, to indicate that the corresponding
+  // axis should stop
+
+  //Disable magazine gap checking if carousel has finished homing, but other axes are still homing
+  if( !(limits.ishoming & (1 << C_AXIS)) && limits.ishoming){
+    limits.mag_gap_check = 0 ;
+  }
+
+  uint8_t must_stop = ((pins ^ limits.expected) & limits.active);
+  limits.stop_mask = (must_stop >> LIMIT_BIT_SHIFT);
+  if (must_stop) {
+    #ifdef HOMING_EDGE_LATCH
+      // Latch the edge position of the axes done homing. Later edges, like switch bounce, don't count.
+      // An axis starting on its switch stops without an edge, as st_wake_up() evaluates the pins
+      // once. Its last edge is stale, so it is latched where it stands.
+      uint8_t homed = (must_stop >> LIMIT_BIT_SHIFT) & limits.ishoming;
+      uint8_t axis;
+      for (axis=0; axis<N_AXIS; axis++) {
+        if (homed & bit(axis)) {
+          if (changed & bit(axis+LIMIT_BIT_SHIFT)) { limits.home_position[axis] = limits.edge_position[axis]; }
+          else { limits.home_position[axis] = st_get_axis_position(axis); }
+        }
+      }
+    #endif
+
+    // If an axis is done homing, clear the corresponding bit in limits.ishoming     
+    limits.ishoming &= ~(must_stop >> LIMIT_BIT_SHIFT);
+
+    // The other homing axes keep going at their own rates. See limits_plan_homing().
+    if (!limits.ishoming)
+      request_report(REQUEST_STATUS_REPORT | REQUEST_LIMIT_REPORT, 0);
+
+    //if limits made but not homing , servoing, or alarmed already: critical alarm.
+    if (!(sys.state & (STATE_ALARM | STATE_HOMING)) && !(sys.state & (STATE_ALARM | STATE_FORCESERVO)) &&
+         bit_isfalse(SYS_EXEC,EXEC_ALARM)) {
+      mc_reset(); // Initiate system kill.
+      // Indicate hard limit critical event, print limits
+      sys.alarm |= ALARM_HARD_LIMIT;
+      request_report(REQUEST_LIMIT_REPORT, (EXEC_ALARM | EXEC_CRIT_EVENT));
+    }
+  }
 }
 
+
+// Limit pin edge interrupt. All four limit pins share one handler.
+ISR(LIMIT_INT_vect)
+{
+  if (st_defer_edge(EDGE_SOURCE_LIMITS)) { return; }
+  limits_pin_change();
+}
+#ifdef LIMIT_INT2_vect // Pin maps with one external interrupt per switch
+ISR(LIMIT_INT2_vect, ISR_ALIASOF(LIMIT_INT_vect));
+ISR(LIMIT_INT3_vect, ISR_ALIASOF(LIMIT_INT_vect));
+ISR(LIMIT_INT4_vect, ISR_ALIASOF(LIMIT_INT_vect));
+#endif
+
 // Called from limits_go_home
-void limits_update_homing_values(uint8_t cycle_mask, float * homing_rate, float * min_seek_rate, uint8_t * axislock, float * max_travel, uint8_t * n_active_axis)
+void limits_update_homing_values(uint8_t cycle_mask, float * axis_rate, float * min_seek_rate, uint8_t * axislock, float * axis_travel)
 {
   uint8_t idx;
   for (idx = 0; idx < N_AXIS; idx++) {
     if (bit_istrue(cycle_mask, bit(idx))) {
-      (*n_active_axis)++;
       *axislock |= (1 << (X_STEP_BIT + idx)); //assumes axes are in bit order.
-      *max_travel = max(*max_travel, settings.max_travel[idx]);
-      *min_seek_rate = min(*min_seek_rate, settings.homing_seek_rate[idx]);
+      // Ensure homing switches engaged by over-estimating max travel.
+      axis_travel[idx] = settings.max_travel[idx]*HOMING_AXIS_SEARCH_SCALAR + settings.homing_pulloff;
+      axis_rate[idx] = settings.homing_seek_rate[idx];
+      *min_seek_rate = min(*min_seek_rate, axis_rate[idx]);
     }
   }
-  *max_travel *= HOMING_AXIS_SEARCH_SCALAR; // Ensure homing switches engaged by over-estimating max travel.
-  *max_travel += settings.homing_pulloff;
-  *homing_rate = *min_seek_rate * sqrt(*n_active_axis); //Adjust so individual axes all move at homing rate.
 
   return;
 }
 
 // Called from limits_go_home
-void limits_plan_homing(uint8_t cycle_mask, float homing_rate, float max_travel, uint8_t axislock, uint8_t approach, float* target, uint8_t flipped)
+// All cycle axes are planned as a single line, scaled so each axis moves at its own axis_rate and
+// covers at least its own travel by the time the line ends. The stepper ISR holds each axis at
+// its switch, without changing the step rate of the others, so no axis waits on another and the
+// cycle takes as long as its slowest axis.
+void limits_plan_homing(uint8_t cycle_mask, float * axis_rate, float * axis_travel, uint8_t axislock, uint8_t approach, float* target, uint8_t flipped)
 {
   uint8_t idx;
   
   // Set target location and rate for active axes.
   // and reset homing axis locks based on cycle mask.
 
-  // limit travel distance to the length of the largest flag
-  float travel = approach ? max_travel : MAXFLAGLEN;
+  // Time the slowest axis needs to cover its travel. On pulloff, travel is limited to the length
+  // of the largest flag.
+  float homing_time = 0;
+  for (idx = 0; idx < N_AXIS; idx++) {
+    if (bit_istrue(cycle_mask, bit(idx))) {
+      float travel = approach ? axis_travel[idx] : MAXFLAGLEN;
+      homing_time = max(homing_time, travel/axis_rate[idx]);
+    }
+  }
 
-  // set target for moving axes based on direction
+  // set target for moving axes based on direction, and the line rate for the axis rates
+  float homing_rate = 0;
   for (idx = 0; idx < N_AXIS; idx++) {
     if (bit_istrue(cycle_mask, bit(idx))) {
+      float travel = axis_rate[idx]*homing_time;
       if ((flipped & (1 << idx)) ^ approach) {
         target[idx] = -travel;
       } else {
         target[idx] = travel;
       }
+      homing_rate += axis_rate[idx]*axis_rate[idx];
     } else {
       target[idx] = 0;
     }
   }
+  homing_rate = sqrt(homing_rate);
 
   // Perform homing cycle. Planner buffer should be empty, as required to initiate the homing cycle.
   plan_buffer_line(target, homing_rate, false, LINENUMBER_EMPTY_BLOCK);  // Bypass mc_line(). Directly plan homing motion.
@@ -175,51 +293,33 @@ void limits_go_home(uint8_t cycle_mask)
 {
   if (sys.abort || !cycle_mask) { return; } // Block if system reset has been issued.
 
-  float homing_rate;
   // Initialize homing in search mode to quickly engage the specified cycle_mask limit switches.
   uint8_t approach = ~0;  //approach has all bits set (negative dir) or none (positive)
   uint8_t idx;
-  uint8_t n_cycle = (2 * N_HOMING_LOCATE_CYCLE);
+  #ifdef HOMING_EDGE_LATCH
+    uint8_t n_cycle = 0; // Approach only. See HOMING_EDGE_LATCH.
+  #else
+    uint8_t n_cycle = (2 * N_HOMING_LOCATE_CYCLE);
+  #endif
   float target[N_AXIS];
 
   uint8_t flipped = settings.homing_dir_mask >> X_DIRECTION_BIT;  //assumes keyme configuration.
   //replace with an instance of `if (bitistrue(h_d_m,X_DIRECTION_BIT)) { flipped|=1<<X_AXIS;}` 
   //for each axis if the bits line up differently
 
-  // Determine travel distance to the furthest homing switch based on user max travel settings.
+  // Determine travel distance to each homing switch based on user max travel settings.
   float min_seek_rate = 1e9; //arbitrary maximum=1km/s, will be reduced by axis setting below
-  float max_travel = 0;
-  uint8_t n_active_axis = 0;
+  float axis_rate[N_AXIS];
+  float axis_travel[N_AXIS];
   uint8_t axislock = 0;
 
-  limits_update_homing_values(cycle_mask, &homing_rate, &min_seek_rate, &axislock, &max_travel, &n_active_axis);
+  limits_update_homing_values(cycle_mask, axis_rate, &min_seek_rate, &axislock, axis_travel);
   plan_reset(); // Reset planner buffer to zero planner current position and to clear previous motions.
 
   do {
-    limits_plan_homing(cycle_mask, homing_rate, max_travel, axislock, approach, target, flipped);
+    limits_plan_homing(cycle_mask, axis_rate, axis_travel, axislock, approach, target, flipped);
 
     do {
-      // If the home speed needs to be adjusted when an axis finishes homing,
-      // calculate new homing values and reset the plan buffer
-      if (bit_istrue(sys.state, STATE_HOME_ADJUST)) {
-       
-        limits_disable();
-        st_reset();
-        plan_reset(); // Reset planner buffer to zero planner current position and to clear previous motions.
-
-        min_seek_rate = 1e9; //arbitrary maximum=1km/s, will be reduced by axis setting below
-        max_travel = 0;
-        n_active_axis = 0;
-        axislock = 0;
-        
-        limits_update_homing_values(limits.ishoming, &homing_rate, &min_seek_rate, &axislock, &max_travel, &n_active_axis);
-
-        limits_plan_homing(limits.ishoming, homing_rate, max_travel, axislock, approach, target, flipped);
-
-        // Clear the STATE_HOME_ADJUST flag when homing is adjusted
-        bit_false(sys.state, STATE_HOME_ADJUST);
-      }
-
       st_prep_buffer(); // Check and prep segment buffer. NOTE: Should take no longer than 200us.
       // Check only for user reset. Keyme: fixed to allow protocol_execute_runtime() in this loop.
       protocol_execute_runtime();
@@ -248,12 +348,14 @@ void limits_go_home(uint8_t cycle_mask)
       protocol_execute_runtime();
     }
 
-    delay_ms(settings.homing_debounce_delay); // Delay to allow transient dynamics to dissipate.
+    #ifndef HOMING_EDGE_LATCH
+      delay_ms(settings.homing_debounce_delay); // Delay to allow transient dynamics to dissipate.
+    #endif
 
 
     // Reverse direction and reset homing rate for locate cycle(s).
     approach = ~approach; //toggle all bits
-    homing_rate = settings.homing_feed_rate * sqrt(n_active_axis);
+    for (idx = 0; idx < N_AXIS; idx++) { axis_rate[idx] = settings.homing_feed_rate; }
 
   } while (n_cycle-- > 0);
 
@@ -273,6 +375,14 @@ void limits_go_home(uint8_t cycle_mask)
     // direction, rather than the traditional positive. Leave non-homed positions as zero and
     // do not move them.
     if (cycle_mask & bit(idx)) {
+      #ifdef HOMING_EDGE_LATCH
+        // Position past the true trip point, from the latched edge onwards. The edge offset is
+        // along the approach direction, the direction of the last homing target.
+        float edge_offset = settings.homing_edge_offset[idx];
+        if (target[idx] < 0) { edge_offset = -edge_offset; }
+        int32_t overrun = lround(edge_offset*settings.steps_per_mm[idx]) +
+                          (st_get_axis_position(idx) - limits.home_position[idx]);
+      #endif
       if ( settings.homing_dir_mask & get_direction_mask(idx) ) {
         target[idx] = settings.max_travel[idx];
         sys.position[idx] = lround((settings.homing_pulloff+settings.max_travel[idx])*settings.steps_per_mm[idx]);
@@ -282,6 +392,10 @@ void limits_go_home(uint8_t cycle_mask)
         memcpy(sys.probe_position, sys.position, sizeof(uint32_t) * N_AXIS); //Set probe position to position
         target[idx] = 0;
       }
+      #ifdef HOMING_EDGE_LATCH
+        sys.position[idx] += overrun;
+        sys.probe_position[idx] = sys.position[idx];
+      #endif
       if (settings.homing_pulloff == 0.0) {request_eol_report(); } //force report if we are not going to move 
     } else { // Non-active cycle axis. Set target to not move during pull-off.
       target[idx] = (float)sys.position[idx]/settings.steps_per_mm[idx];
@@ -308,30 +422,37 @@ void limits_go_home(uint8_t cycle_mask)
 
 // Performs a soft limit check. Called from mc_line() only. Assumes the machine has been homed,
 // the workspace volume is in all positive space, and the system is in normal operation.
-void limits_soft_check(float *target)
+// Returns true if the target is outside the machine travel on any axis with hard stops.
+uint8_t limits_travel_exceeded(float *target)
 {
   uint8_t idx;
   for (idx=0; idx<N_AXIS; idx++) {
     if ((target[idx] < 0 || target[idx] > settings.max_travel[idx])  &&
         (get_step_mask(idx)&HARDSTOP_MASK)) {   //if rotary axis, don't check
+      return(true);
+    }
+  }
+  return(false);
+}
 
-      // Force feed hold if cycle is active. All buffered blocks are guaranteed to be within 
-      // workspace volume so just come to a controlled stop so position is not lost. When complete
-      // enter alarm mode.
-      if (sys.state == STATE_CYCLE) {
-        SYS_EXEC |= EXEC_FEED_HOLD;
-        do {
-          protocol_execute_runtime();
-          if (sys.abort) { return; }
-        } while ( sys.state != STATE_IDLE || sys.state != STATE_QUEUED);
-      }
-
-      mc_reset(); // Issue system reset and ensure spindle is shutdown.
-      sys.alarm |= ALARM_SOFT_LIMIT;
-      SYS_EXEC |= (EXEC_ALARM | EXEC_CRIT_EVENT); // Indicate soft limit critical event
-      protocol_execute_runtime(); // Execute to enter critical event loop and system abort
-      return;
+void limits_soft_check(float *target)
+{
+  if (limits_travel_exceeded(target)) {
+    // Force feed hold if cycle is active. All buffered blocks are guaranteed to be within 
+    // workspace volume so just come to a controlled stop so position is not lost. When complete
+    // enter alarm mode.
+    if (sys.state == STATE_CYCLE) {
+      SYS_EXEC |= EXEC_FEED_HOLD;
+      do {
+        protocol_execute_runtime();
+        if (sys.abort) { return; }
+      } while ( sys.state != STATE_IDLE || sys.state != STATE_QUEUED);
     }
+
+    mc_reset(); // Issue system reset and ensure spindle is shutdown.
+    sys.alarm |= ALARM_SOFT_LIMIT;
+    SYS_EXEC |= (EXEC_ALARM | EXEC_CRIT_EVENT); // Indicate soft limit critical event
+    protocol_execute_runtime(); // Execute to enter critical event loop and system abort
   }
 }
 
@@ -373,11 +494,145 @@ void limits_plan_force_servo(float servo_rate)
   limits_enable(axislock,~approach);  
   // Set the isservoing flag
   limits.isservoing = 1;
+  st_select_isr_variant();
 
   st_prep_buffer(); // Prep and fill segment buffer from newly planned block.
   st_wake_up(); // Initiate motion
 }
 
+// Keeps the segment buffer of the PID force servo fed and runs the runtime protocol. Returns
+// false on a reset or abort.
+static uint8_t limits_force_servo_pid_service()
+{
+  st_prep_buffer();
+  // The steppers run dry whenever the loop brings the gripper to rest. That cycle stop is the
+  // servo's own, not the cycle end protocol_execute_runtime() would take it for. A stop with
+  // motion still planned is left to it.
+  if (!plan_get_current_block()) { bit_false(SYS_EXEC, EXEC_CYCLE_STOP); }
+  protocol_execute_runtime();
+  if (SYS_EXEC & EXEC_RESET) {
+    protocol_execute_runtime();
+    return(false);
+  }
+  if (sys.abort) { return(false); }
+  if (!(sys.state & STATE_ALARM)) { sys.state = STATE_FORCESERVO; }
+  // Carry on with the planned motion after such a stop, e.g. when the segment prep fell behind.
+  if (plan_get_current_block() && !st_is_running()) { st_wake_up(); }
+  return(true);
+}
+
+// Real-time gripper position in steps. The stepper ISR keeps running meanwhile, so the position
+// is read with st_get_position(), which can't catch a segment folding into sys.position.
+static int32_t limits_force_servo_position()
+{
+  int32_t position[N_AXIS];
+  st_get_position(position);
+  return(position[Z_AXIS]);
+}
+
+// Continuous force servo. Every FORCE_SERVO_PID_PERIOD, a PID loop on the load cell force error
+// sets the gripper velocity, and the motion for that period is queued in the planner. A few
+// periods are kept planned ahead, so the gripper runs smoothly, follows the new velocity within
+// a few periods and comes to a controlled stop if the loop stops feeding the planner. Finishes
+// once the force stays within the settle band ($62) for FORCE_SERVO_PID_SETTLE periods. Like
+// the bang-bang servo, stops without an alarm at the gripper's maximum travel, so the host can
+// decide whether to continue, and travels at most MAXSERVODIST opening. Fails with an alarm only
+// if the time runs out first.
+static void limits_force_servo_pid()
+{
+  float max_rate = settings.homing_seek_rate[Z_AXIS];
+  int32_t max_servo_steps = MAXSERVODIST*settings.steps_per_mm[Z_AXIS];
+  float dt = FORCE_SERVO_PID_PERIOD/1000.0; // (sec)
+  float integral = 0; // (count*sec)
+  uint16_t last_force = FORCE_VAL;
+  uint8_t settled = 0;
+  uint8_t max_reached = false;
+
+  plan_reset();
+  float target[N_AXIS] = {0};
+  // The gripper is never planned past its maximum travel, so it decelerates to a stop there. It
+  // opens by at most MAXSERVODIST, as the bang-bang servo does.
+  // NOTE: plan_reset() zeroed the planner position, so this is relative to where it is now.
+  float max_target = (max_servo_steps - limits_force_servo_position())/settings.steps_per_mm[Z_AXIS];
+
+  // Stop at the gripper limit switch, like the bang-bang servo does.
+  limits_enable(1 << Z_AXIS, 0);
+
+  linenumber_insert(LINENUMBER_SPECIAL_SERVO | ((servo_line_number * 4) + FORCE_SERVO_START));
+  request_eol_report();
+  protocol_execute_runtime();
+
+  uint32_t start_time = masterclock;
+  uint32_t tick_time = start_time;
+  do {
+    // Keep the segment buffer fed in between control periods.
+    do {
+      if (!limits_force_servo_pid_service()) { return; }
+    } while ((masterclock - tick_time) < FORCE_SERVO_PID_PERIOD);
+    tick_time += FORCE_SERVO_PID_PERIOD;
+
+    // Sample the force. The regular ADC sampling is paused while servoing.
+    signals_update_force();
+    uint16_t force = FORCE_VAL;
+    int16_t error = (int16_t)limits.bump_grip_force - (int16_t)force;
+    if (abs(error) <= settings.force_servo_band) { settled++; }
+    else { settled = 0; }
+    if (settled >= FORCE_SERVO_PID_SETTLE) { break; }
+    if (limits_force_servo_position() >= max_servo_steps) {
+      // Stop at max reach, but do not throw an alarm. Like st_force_check().
+      max_reached = true;
+      request_report(REQUEST_STATUS_REPORT | REQUEST_LIMIT_REPORT, 0);
+      break;
+    }
+
+    // Gripper velocity. Positive travel increases the force. The derivative is taken of the force,
+    // rather than of the error, so changing the target doesn't kick the gripper, and the integral
+    // is not wound up beyond what the gripper can follow.
+    float rate = settings.force_servo_kp*error + settings.force_servo_kd*((int16_t)last_force - (int16_t)force)/dt;
+    last_force = force;
+    if (settings.force_servo_ki > 0) {
+      integral += error*dt;
+      float integral_limit = max_rate/settings.force_servo_ki;
+      integral = min(max(integral, -integral_limit), integral_limit);
+      rate += settings.force_servo_ki*integral;
+    }
+    rate = min(max(rate, -max_rate), max_rate);
+
+    // Queue the motion of this period, once the planned motion runs short.
+    if (plan_block_count() < FORCE_SERVO_PID_LOOKAHEAD) {
+      target[Z_AXIS] = min(max(target[Z_AXIS] + rate*(dt/60.0), -(MAXSERVODIST)), max_target);
+      plan_buffer_line(target, fabs(rate), false, LINENUMBER_EMPTY_BLOCK);
+      st_prep_buffer();
+      if (!st_is_running()) { st_wake_up(); }
+    }
+  } while ((masterclock - start_time) < FORCE_SERVO_PID_TIMEOUT);
+
+  // Let the queued motion run out rather than cutting it off. The planner brings the gripper to
+  // rest at its end, at most FORCE_SERVO_PID_LOOKAHEAD periods later.
+  while (plan_get_current_block() || st_is_running()) {
+    if (!limits_force_servo_pid_service()) { return; }
+  }
+  limits_disable();
+
+  // Target force not reached in time.
+  if (!max_reached && (settled < FORCE_SERVO_PID_SETTLE)) {
+    sys.alarm |= ALARM_FORCESERVO_FAIL;
+    SYS_EXEC |= EXEC_CRIT_EVENT;
+    protocol_execute_runtime();
+    return;
+  }
+
+  st_reset(); // Reset step segment buffer. The steppers are already at rest.
+  plan_reset(); // Reset planner buffer. Zero planner positions. Ensure servo motion is cleared.
+  linenumber_insert(LINENUMBER_SPECIAL_SERVO | ((servo_line_number * 4) + FORCE_SERVO_BUSY));
+  request_eol_report();
+  protocol_execute_runtime();
+  request_eol_report(); // Need to report once more to report the "DONE" linenumber
+  servo_line_number++; // Increment for next time we peform this process
+  plan_sync_position();
+}
+
+
 // Move gripper to limits.bump_grip_force.
 void limits_force_servo()
 {
@@ -395,72 +650,77 @@ void limits_force_servo()
   // values when not force servoing.
   signals.pause = 1;
 
-  // Delays are used to compensate for the settling time
-  // of the load cell ADC reading
-  uint16_t delay = 0; 
+  if (settings.force_servo_kp > 0) {
+    limits_force_servo_pid();
+    if (sys.abort) { return; }
+  } else {
+    // Delays are used to compensate for the settling time
+    // of the load cell ADC reading
+    uint16_t delay = 0; 
 
- // Keep track of completed cycles
-  uint8_t cycles = 0; 
+   // Keep track of completed cycles
+    uint8_t cycles = 0; 
   
-  // Initially, move to the desired force at a fast rate
-  limits_plan_force_servo(servo_rate);
+    // Initially, move to the desired force at a fast rate
+    limits_plan_force_servo(servo_rate);
 
-  // After servoing at a fast rate, 
-  // delay for LONG_FORCE_SERVO_DELAY ms 
-  delay = LONG_FORCE_SERVO_DELAY;
+    // After servoing at a fast rate, 
+    // delay for LONG_FORCE_SERVO_DELAY ms 
+    delay = LONG_FORCE_SERVO_DELAY;
 
-  linenumber_insert(LINENUMBER_SPECIAL_SERVO | ((servo_line_number * 4) + FORCE_SERVO_START));
-  request_eol_report();
-  protocol_execute_runtime();
+    linenumber_insert(LINENUMBER_SPECIAL_SERVO | ((servo_line_number * 4) + FORCE_SERVO_START));
+    request_eol_report();
+    protocol_execute_runtime();
 
-  // Perform force servoing cyles
-  do {
-    // Stay in this loop while moving the gripper motor
-    // Similair to homing procedure
+    // Perform force servoing cyles
     do {
-      // Check for user reset and allow protocol_execute_runtime() in this loop.
-      protocol_execute_runtime();
-      if (SYS_EXEC & EXEC_RESET) {
+      // Stay in this loop while moving the gripper motor
+      // Similair to homing procedure
+      do {
+        // Check for user reset and allow protocol_execute_runtime() in this loop.
         protocol_execute_runtime();
-        return;
-      }
+        if (SYS_EXEC & EXEC_RESET) {
+          protocol_execute_runtime();
+          return;
+        }
       
-      // Check if we never reached limit switch.  Call it a probe fail.
-      if (SYS_EXEC & EXEC_CYCLE_STOP) {
-        sys.alarm |= ALARM_FORCESERVO_FAIL;
-        SYS_EXEC |= EXEC_CRIT_EVENT;
-        protocol_execute_runtime();
-        return;
-      }
-    } while (limits.isservoing);  // Stepper isr sets this flag when
-                                  // limits.bump_grip_force is reached
-
-    limits_disable();
-    st_reset(); // Immediately force kill steppers and reset step segment buffer.
-    plan_reset(); // Reset planner buffer. Zero planner positions. Ensure homing motion is cleared.
-    linenumber_insert(LINENUMBER_SPECIAL_SERVO | ((servo_line_number * 4) + FORCE_SERVO_BUSY));
-    request_eol_report();
-    protocol_execute_runtime();
-    request_eol_report(); // Need to report once more to report the "DONE" linenumber
+        // Check if we never reached limit switch.  Call it a probe fail.
+        if (SYS_EXEC & EXEC_CYCLE_STOP) {
+          sys.alarm |= ALARM_FORCESERVO_FAIL;
+          SYS_EXEC |= EXEC_CRIT_EVENT;
+          protocol_execute_runtime();
+          return;
+        }
+      } while (limits.isservoing);  // Stepper isr sets this flag when
+                                    // limits.bump_grip_force is reached
+
+      limits_disable();
+      st_reset(); // Immediately force kill steppers and reset step segment buffer.
+      plan_reset(); // Reset planner buffer. Zero planner positions. Ensure homing motion is cleared.
+      linenumber_insert(LINENUMBER_SPECIAL_SERVO | ((servo_line_number * 4) + FORCE_SERVO_BUSY));
+      request_eol_report();
+      protocol_execute_runtime();
+      request_eol_report(); // Need to report once more to report the "DONE" linenumber
 
-    servo_line_number++; // Increment for next time we peform this process
+      servo_line_number++; // Increment for next time we peform this process
   
-    plan_sync_position(); // Sync planner position to current machine position for pull-off move.
+      plan_sync_position(); // Sync planner position to current machine position for pull-off move.
       
-    delay_ms(delay);
+      delay_ms(delay);
 
-    // Increment cycle counter
-    cycles++;      
+      // Increment cycle counter
+      cycles++;      
   
-    // Step at the slowest speed possible
-    limits_plan_force_servo(1);
+      // Step at the slowest speed possible
+      limits_plan_force_servo(1);
 
-    // After servoing at slow rate, 
-    // delay for SHORT_FORCE_SERVO_DELAY ms
-    delay = SHORT_FORCE_SERVO_DELAY;
+      // After servoing at slow rate, 
+      // delay for SHORT_FORCE_SERVO_DELAY ms
+      delay = SHORT_FORCE_SERVO_DELAY;
      
-  } while ((cycles <= MIN_FORCE_SERVO_CYCLES) | ((cycles <= MAX_FORCE_SERVO_CYCLES) \
-          && (abs(limits.bump_grip_force - FORCE_VAL) > GRIPPER_FORCE_THRESHOLD)));
+    } while ((cycles <= MIN_FORCE_SERVO_CYCLES) | ((cycles <= MAX_FORCE_SERVO_CYCLES) \
+            && (abs(limits.bump_grip_force - FORCE_VAL) > GRIPPER_FORCE_THRESHOLD)));
+  }
 
   linenumber_insert(LINENUMBER_SPECIAL_SERVO | ((servo_line_number * 4) + FORCE_SERVO_DONE));
   request_eol_report();
@@ -470,5 +730,6 @@ void limits_force_servo()
   signals.pause = 0;
 
   limits.mag_gap_check = settings.mag_gap_enabled; // Start checking magazine gaps on carousel again
+  st_select_isr_variant();
 }
 
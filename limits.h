@@ -38,6 +38,13 @@ typedef struct {
   volatile uint8_t isservoing;
   uint8_t mag_gap_check;  // KeyMe specific
   uint16_t bump_grip_force;  // KeyMe specific: Value must be 0-1023
+  volatile uint8_t stop_mask;  // Step bits of axes held at their limit. Applied by the stepper ISR.
+  uint8_t pin_state;  // Limit pin state at the last edge
+  int32_t edge_position[N_AXIS];  // Axis position (steps) at the last edge of its limit pin
+  uint32_t edge_time[N_AXIS];  // masterclock at the last edge of its limit pin
+  #ifdef HOMING_EDGE_LATCH
+    int32_t home_position[N_AXIS];  // Axis position (steps) at the edge that ended its homing pass
+  #endif
 } limit_t;
 
 extern limit_t limits;
@@ -50,12 +57,19 @@ void limits_configure();
 void limits_enable(uint8_t axes,uint8_t expected);
 void limits_disable();
 
+// Services a limit pin edge. Called from the limit pin interrupts, or from the stepper ISR when
+// the edge was deferred. Must be called with interrupts disabled.
+void limits_pin_change();
+
 // Perform one portion of the homing cycle based on the input settings.
 void limits_go_home(uint8_t cycle_mask);
 
 // Check for soft limit violations
 void limits_soft_check(float *target);
 
+// Returns true if the target lies outside the machine travel. Used to reject jogs without an alarm.
+uint8_t limits_travel_exceeded(float *target);
+
 // Perform force servo cycle
 void limits_force_servo();
 #endif
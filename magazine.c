@@ -9,8 +9,12 @@
 #include "protocol.h"
 #include "stepper.h"
 #include "report.h"
-#include "gqueue.h"
+#include "ring.h"
 #include "probe.h"
+#include "planner.h"
+#include "motion_control.h"
+#include "eeprom.h"
+#include "gcode.h"
 
 enum magazine_edge_type {
   E_MAGAZINE_EDGE_TYPE_RISING = 0,
@@ -31,26 +35,87 @@ static struct {
 struct edge_event {
   bool state;
   int32_t position;
+  uint32_t time;  // masterclock at the edge
 };
 
-DECLARE_QUEUE(edge_events, struct edge_event, MAX_EDGE_EVENTS);
+RING_DECLARE(edge_events, struct edge_event, MAX_EDGE_EVENTS);
+
+#ifdef MAGAZINE_MAP_SIZE
+// Magazine edges learned by the calibration sweep, in C steps modulo one revolution. The on
+// edge is where a magazine trips the sensor moving +C, the off edge where it does moving -C.
+static struct {
+  uint16_t revolution;  // Carousel circumference in C steps when the map was learned
+  uint8_t count;
+  uint16_t on_edge[MAGAZINE_MAP_SIZE];
+  uint16_t off_edge[MAGAZINE_MAP_SIZE];
+} magazine_map;
+
+static volatile struct {
+  bool active;
+  bool open;      // An on edge is waiting for its off edge
+  bool overflow;  // More magazines than MAGAZINE_MAP_SIZE
+  int32_t start;
+} map_calibration;
+
+// Carousel circumference in C steps, or 0 when it does not fit the map
+static uint16_t magazine_map_revolution()
+{
+  float revolution = settings.max_travel[C_AXIS]*settings.steps_per_mm[C_AXIS];
+  if (revolution < 1 || revolution > 0xFFFF) { return 0; }
+  return lround(revolution);
+}
+
+static uint16_t magazine_map_wrap(int32_t position)
+{
+  position %= magazine_map.revolution;
+  if (position < 0) { position += magazine_map.revolution; }
+  return position;
+}
+
+// Records an edge during the calibration sweep. Called from magazine_pin_change().
+static void magazine_map_record(const bool magazine_alignment_on)
+{
+  const int32_t position = st_get_axis_position(C_AXIS);
+
+  if (magazine_alignment_on) {
+    // Only the first revolution is learned. The rest of the sweep closes the last magazine.
+    if (position - map_calibration.start >= magazine_map.revolution) { return; }
+    if (magazine_map.count == MAGAZINE_MAP_SIZE) {
+      map_calibration.overflow = true;
+      return;
+    }
+    magazine_map.on_edge[magazine_map.count++] = magazine_map_wrap(position);
+    map_calibration.open = true;
+  } else if (map_calibration.open) {
+    // An off edge before the first on edge belongs to a magazine the sweep started on
+    magazine_map.off_edge[magazine_map.count-1] = magazine_map_wrap(position);
+    map_calibration.open = false;
+  }
+}
+#endif
 
 
 void magazine_init()
 {
   // Set the magazine alignment position to the current position
-  memcpy(sys.probe_position, sys.position, sizeof(int32_t) * N_AXIS);
+  st_get_position(sys.probe_position);
 
-  queue_init(&edge_events, sizeof(struct edge_event), MAX_EDGE_EVENTS);
+  edge_events_init();
   mag_state.delta_pos_limit = settings.mag_gap_limit * settings.steps_per_mm[C_AXIS];
+
+#ifdef MAGAZINE_MAP_SIZE
+  // Start without a map until one has been learned
+  if (!memcpy_from_eeprom_with_checksum((char*)&magazine_map, EEPROM_ADDR_MAGAZINE_MAP,
+                                        sizeof(magazine_map))) {
+    magazine_map.count = 0;
+  }
+#endif
 }
 
 void magazine_report_edge_events()
 {
-  while (!queue_is_empty(&edge_events)) {
-    struct edge_event evt = {0};
-
-    queue_dequeue(&edge_events, &evt);
+  while (!edge_events_is_empty()) {
+    struct edge_event evt = edge_events_get();
     report_sensor_edge((uint8_t)MAG_SENSOR, evt.state, evt.position);
   }
 }
@@ -63,37 +128,50 @@ static void magazine_edge_detector(const bool magazine_alignment_on)
   if (magazine_alignment_on != mag_state.on_probe) {
     struct edge_event evt = {0};
     evt.state = magazine_alignment_on;
-    evt.position = sys.position[C_AXIS];
+    evt.position = st_get_axis_position(C_AXIS);
+    evt.time = masterclock;
 
-    queue_enqueue(&edge_events, &evt);
+    // Edges past a full queue are lost. Their reports would be out of date anyway.
+    if (!edge_events_is_full()) { edge_events_put(evt); }
     request_report(REQUEST_EDGE_REPORT, 0);
   }
 
   mag_state.on_probe = magazine_alignment_on;
 }
 
-// Monitors the gap in units between mags and throws an alarm if the gap is larger than a
-// specified threshold. Additionally, magazine slop can be calculated
-// if turned on via compiler flag
-void magazine_gap_monitor()
+void magazine_pin_change()
 {
   const bool magazine_alignment_on = magazine_get_state();
 
-  // When the probe is detected, copy the current carousel position
-  // into the probe position
-  if (magazine_alignment_on) {
-    sys.probe_position[C_AXIS] = sys.position[C_AXIS];
+  if (settings.mag_gap_enabled) {
+    // Copy the carousel position into the probe position on both edges. The off edge marks
+    // the end of the magazine, which is where the gap to the next one is measured from.
+    sys.probe_position[C_AXIS] = st_get_axis_position(C_AXIS);
+
+    magazine_edge_detector(magazine_alignment_on);
   }
 
-  magazine_edge_detector(magazine_alignment_on);
+#ifdef MAGAZINE_MAP_SIZE
+  if (map_calibration.active) { magazine_map_record(magazine_alignment_on); }
+#endif
+
+  // The alignment sensor doubles as the carousel probe
+  if (probe.isprobing) { probe_check(); }
+  probe_carousel_monitor();
+}
 
-  if (limits.mag_gap_check == 0) {
+// Monitors the gap in units between mags and throws an alarm if the gap is larger than a
+// specified threshold.
+void magazine_gap_check()
+{
+  // No gap while a magazine is in front of the sensor
+  if (magazine_get_state()) {
     return;
   }
 
   // Activate alarm if the gap between the current position and the previous
   // probe position becomes too large. Only do this when the system has already homed
-  const int32_t cur_pos = sys.position[C_AXIS];
+  const int32_t cur_pos = st_get_axis_position(C_AXIS);
   const int32_t probe_pos = sys.probe_position[C_AXIS];
   const int32_t delta_pos = abs(cur_pos - probe_pos);
 
@@ -106,3 +184,95 @@ void magazine_gap_monitor()
   }
 
 }
+
+
+#ifdef MAGAZINE_MAP_SIZE
+uint8_t magazine_map_calibrate()
+{
+  const uint16_t revolution = magazine_map_revolution();
+  if (!revolution) { return(STATUS_SETTING_DISABLED); }
+
+  float target[N_AXIS];
+  uint8_t idx;
+  for (idx = 0; idx < N_AXIS; idx++) { target[idx] = plan_get_position(idx); }
+  target[C_AXIS] += 1.1*settings.max_travel[C_AXIS];
+
+  // Forget the old map until the sweep has learned a complete one
+  magazine_map.revolution = revolution;
+  magazine_map.count = 0;
+  map_calibration.open = false;
+  map_calibration.overflow = false;
+  map_calibration.start = st_get_axis_position(C_AXIS);
+  map_calibration.active = true;
+
+  mc_line(target, settings.homing_seek_rate[C_AXIS], false, LINENUMBER_EMPTY_BLOCK);
+  SYS_EXEC |= EXEC_CYCLE_START;
+  protocol_buffer_synchronize();
+
+  map_calibration.active = false;
+  gc_sync_position();
+  if (sys.abort) {
+    magazine_map.count = 0;
+    return(STATUS_ABORT);
+  }
+
+  // A magazine still open at the end of the sweep is wider than a tenth of the carousel
+  if (map_calibration.open || map_calibration.overflow) {
+    magazine_map.count = 0;
+    return(STATUS_OVERFLOW);
+  }
+
+  memcpy_to_eeprom_with_checksum(EEPROM_ADDR_MAGAZINE_MAP, (char*)&magazine_map,
+                                 sizeof(magazine_map));
+  magazine_report_map();
+  return(STATUS_OK);
+}
+
+void magazine_report_map()
+{
+  uint8_t idx;
+  for (idx = 0; idx < magazine_map.count; idx++) {
+    report_magazine_map_entry(idx, magazine_map.on_edge[idx], magazine_map.off_edge[idx]);
+  }
+}
+
+bool magazine_map_approach(float *target, float *approach)
+{
+  // A map learned for another circumference is stale
+  if (!magazine_map.count || magazine_map.revolution != magazine_map_revolution()) {
+    return false;
+  }
+  // Already on a magazine. The probe stops right where it starts.
+  if (magazine_get_state()) { return false; }
+
+  const float steps_per_mm = settings.steps_per_mm[C_AXIS];
+  uint8_t idx;
+  for (idx = 0; idx < N_AXIS; idx++) {
+    approach[idx] = plan_get_position(idx);
+    if (idx != C_AXIS && lround(target[idx]*settings.steps_per_mm[idx]) !=
+                         lround(approach[idx]*settings.steps_per_mm[idx])) {
+      return false;
+    }
+  }
+
+  const int32_t position = lround(approach[C_AXIS]*steps_per_mm);
+  const int32_t travel = lround(target[C_AXIS]*steps_per_mm) - position;
+  const uint16_t phase = magazine_map_wrap(position);
+
+  // Distance to the first edge the sensor will see in the direction of travel
+  int32_t nearest = magazine_map.revolution;
+  for (idx = 0; idx < magazine_map.count; idx++) {
+    int32_t distance = (travel > 0) ? (int32_t)magazine_map.on_edge[idx] - phase
+                                    : (int32_t)phase - magazine_map.off_edge[idx];
+    if (distance < 0) { distance += magazine_map.revolution; }
+    nearest = min(nearest, distance);
+  }
+
+  // Nothing to gain if the edge is already close, or past the target where the probe fails anyway
+  nearest -= lround(MAGAZINE_SEEK_MARGIN*steps_per_mm);
+  if (nearest <= 0 || nearest >= labs(travel)) { return false; }
+
+  approach[C_AXIS] += ((travel > 0) ? nearest : -nearest)/steps_per_mm;
+  return true;
+}
+#endif
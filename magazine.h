@@ -5,17 +5,34 @@
 #ifndef magazine_h
 #define magazine_h
 
-#define MAX_EDGE_EVENTS 2
+#define MAX_EDGE_EVENTS 4 // Ring size, a power of two. Holds one less.
 
 // Magazine allignment pin initialization routine
 void magazine_init();
 
 #define magazine_get_state() (!(MAGAZINE_ALIGNMENT_PIN & MAGAZINE_ALIGNMENT_MASK))
 
-// Monitors the gap in units between mags and throws an alarm if the gap is larger than a
-// specified threshold.
-void magazine_gap_monitor();
+// Services an edge of the magazine alignment sensor. Called from the pin change interrupt, or
+// from the stepper ISR when the edge was deferred. Must be called with interrupts disabled.
+void magazine_pin_change();
+
+// Throws an alarm if the gap between mags is larger than a specified threshold. Called by the
+// stepper ISR at the end of each segment while limits.mag_gap_check is set.
+void magazine_gap_check();
 
 void magazine_report_edge_events(void);
 
+#ifdef MAGAZINE_MAP_SIZE
+// Sweeps the carousel a little over one revolution, learns the edges of every magazine and
+// stores them in EEPROM. Reports the new map. Returns a status code.
+uint8_t magazine_map_calibrate();
+
+// Reports the learned magazine edges, in C steps modulo one carousel revolution.
+void magazine_report_map();
+
+// Fills approach with the point MAGAZINE_SEEK_MARGIN short of the first learned magazine edge
+// on the way to a carousel-only target. Returns false when the map does not cover the move.
+bool magazine_map_approach(float *target, float *approach);
+#endif
+
 #endif
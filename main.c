@@ -40,6 +40,8 @@
 #include "ad5121.h"
 #include "motor_driver.h"
 #include "sram.h"
+#include "isr_timing.h"
+#include "frame.h"
 
 // Declare system global variable structure
 system_t sys = {
@@ -68,6 +70,7 @@ int main(void)
   ALWAYS_KEEP(version_string);
 
   // Initialize system upon power-up.
+  isr_timing_init(); // Start the ISR timing clock before any instrumented interrupt is enabled
   serial_init();   // Setup serial baud rate and interrupts
 
   settings_init(); // Load grbl settings from EEPROM
@@ -87,6 +90,7 @@ int main(void)
     /* Setup SPI control register and pins */
     spi_init();
     sram_init();
+    serial_enable_tx_spill();
     if (settings.spi_motor_drivers) {
       motor_drv_init();
     }
@@ -117,6 +121,9 @@ int main(void)
 
     // Reset Grbl primary systems.
     serial_reset_read_buffer(); // Clear serial read buffer
+    #ifdef BINARY_FRAMING
+      frame_init(); // Back to the ASCII protocol
+    #endif
     gc_init(); // Set g-code parser to default state
     linenumber_init();  //reset line numbering buffer
     spindle_init();
@@ -127,6 +134,7 @@ int main(void)
     st_reset(); // Clear stepper subsystem variables.
     signals_init();
     systick_init();  // Init systick and systick callbacks
+    report_status_stream_start();
 
     /* Initialize digital potentiometers */
     if (settings.use_spi && !settings.lc_daughter_card) {
@@ -135,7 +143,8 @@ int main(void)
     }
 
     // Register first signals update callback
-    systick_register_callback(500, signals_callback); // Start polling ADCs 0.5 seconds after init
+    // Start polling ADCs 0.5 seconds after init, then every signals callback period
+    systick_register_periodic_callback(500, signals.callback_period, signals_callback);
 
     // Sync cleared gcode and planner positions to current system position.
     plan_sync_position();
@@ -144,6 +153,8 @@ int main(void)
     // Reset system variables.
     sys.abort = false;
     SYS_EXEC = 0;
+    sys.f_override = sysflags.f_override = DEFAULT_FEED_OVERRIDE; // Set to 100%
+    sys.r_override = sysflags.r_override = DEFAULT_RAPID_OVERRIDE; // Set to 100%
     if (bit_istrue(settings.flags,BITFLAG_AUTO_START)) { sys.flags |= SYSFLAG_AUTOSTART; }
     else { sys.flags &= ~SYSFLAG_AUTOSTART; }
 
@@ -33,6 +33,28 @@
 #include "report.h"
 #include "counters.h"
 
+// Waits for room in the planner buffer, auto-cycle starting when it's full. Returns false if the
+// motion must not be planned, in check gcode mode or on a system abort.
+static uint8_t mc_ready_planner()
+{
+  // If in check gcode mode, prevent motion by blocking planner. Soft limits still work.
+  if (sys.state == STATE_CHECK_MODE) { return(false); }
+
+  // Never mix g-code motions with jog blocks. Let the jog finish or get cancelled first.
+  if (sys.state == STATE_JOG) { protocol_buffer_synchronize(); }
+
+  // If the buffer is full: good! That means we are well ahead of the robot. 
+  // Remain in this loop until there is room in the buffer.
+  do {
+    protocol_execute_runtime(); // Check for any run-time commands
+    if (sys.abort) { return(false); } // Bail, if system abort.
+    if ( plan_check_full_buffer() ) { protocol_auto_cycle_start(); } // Auto-cycle start when buffer is full.
+    else { break; }
+  } while (1);
+  return(true);
+}
+
+
 // Execute linear motion in absolute millimeter coordinates. Feed rate given in millimeters/second
 // unless invert_feed_rate is true. Then the feed_rate means that the motion should be completed in
 // (1 minute)/feed_rate time.
@@ -46,9 +68,6 @@ void mc_line(float *target, float feed_rate, uint8_t invert_feed_rate, linenumbe
   // from everywhere in Grbl.
   if (bit_istrue(settings.flags,BITFLAG_SOFT_LIMIT_ENABLE)) { limits_soft_check(target); }    
 
-  // If in check gcode mode, prevent motion by blocking planner. Soft limits still work.
-  if (sys.state == STATE_CHECK_MODE) { return; }
-  
   // NOTE: Backlash compensation may be installed here. It will need direction info to track when
   // to insert a backlash line motion(s) before the intended line motion and will require its own
   // plan_check_full_buffer() and check for system abort loop. Also for position reporting 
@@ -63,14 +82,7 @@ void mc_line(float *target, float feed_rate, uint8_t invert_feed_rate, linenumbe
   // doesn't update the machine position values. Since the position values used by the g-code
   // parser and planner are separate from the system machine positions, this is doable.
 
-  // If the buffer is full: good! That means we are well ahead of the robot. 
-  // Remain in this loop until there is room in the buffer.
-  do {
-    protocol_execute_runtime(); // Check for any run-time commands
-    if (sys.abort) { return; } // Bail, if system abort.
-    if ( plan_check_full_buffer() ) { protocol_auto_cycle_start(); } // Auto-cycle start when buffer is full.
-    else { break; }
-  } while (1);
+  if (!mc_ready_planner()) { return; }
 
   plan_buffer_line(target, feed_rate, invert_feed_rate, line_number);
   
@@ -80,6 +92,69 @@ void mc_line(float *target, float feed_rate, uint8_t invert_feed_rate, linenumbe
 }
 
 
+// Plan a jog motion in absolute millimeter coordinates. Jogs start executing immediately and are
+// tagged in the planner, so a jog cancel can flush them without touching anything else. Unlike
+// mc_line(), a target outside the soft limits is rejected with an error instead of an alarm,
+// since jogs are interactive. Returns a status code for the jog line.
+uint8_t mc_jog(float *target, float feed_rate)
+{
+  if (bit_istrue(settings.flags,BITFLAG_SOFT_LIMIT_ENABLE)) {
+    if (limits_travel_exceeded(target)) { return(STATUS_TRAVEL_EXCEEDED); }
+  }
+
+  // Wait for room in the buffer when streaming jogs. If the jog in motion gets cancelled
+  // meanwhile, drop this one too, since it was sent before the cancel.
+  uint8_t was_jogging = (sys.state == STATE_JOG);
+  while ( plan_check_full_buffer() ) {
+    protocol_execute_runtime(); // Check for any run-time commands
+    if (sys.abort) { return(STATUS_ABORT); } // Bail, if system abort.
+    if (sys.state != STATE_JOG) { return(STATUS_OK); }
+  }
+
+  // The planner tags blocks as jogs by the system state, so it must be set before planning.
+  sys.state = STATE_JOG;
+  plan_buffer_line(target, feed_rate, false, LINENUMBER_EMPTY_BLOCK);
+
+  // Start motion right away, unless already moving or the jog had no length.
+  if (!was_jogging) {
+    if (plan_get_current_block() == NULL) { sys.state = STATE_IDLE; }
+    else {
+      st_prep_buffer();
+      st_wake_up();
+    }
+  }
+  return(STATUS_OK);
+}
+
+
+#ifdef NATIVE_ARCS
+// Soft limit check of an arc planned as a single block. Besides the target, checks each quadrant
+// point of the circle the arc sweeps past, since the arc bulges out to those between its ends.
+static void mc_arc_soft_check(float *position, float *target, float *offset, float radius,
+  float angular_travel, uint8_t axis_0, uint8_t axis_1)
+{
+  limits_soft_check(target);
+  float point[N_AXIS];
+  memcpy(point, target, sizeof(point));
+  float start_angle = atan2(-offset[axis_1], -offset[axis_0]);
+  uint8_t quadrant;
+  for (quadrant = 0; quadrant < 4; quadrant++) {
+    float turn = quadrant*(0.5*M_PI) - start_angle; // CCW turn from the start to the quadrant point
+    if (angular_travel < 0) { turn = -turn; }
+    turn = fmod(turn, 2*M_PI);
+    if (turn < 0) { turn += 2*M_PI; }
+    if (turn < fabs(angular_travel)) {
+      point[axis_0] = position[axis_0] + offset[axis_0];
+      point[axis_1] = position[axis_1] + offset[axis_1];
+      if (quadrant & 0x01) { point[axis_1] += (quadrant == 1) ? radius : -radius; }
+      else { point[axis_0] += (quadrant == 0) ? radius : -radius; }
+      limits_soft_check(point);
+    }
+  }
+}
+#endif
+
+
 // Execute an arc in offset mode format. position == current xyz, target == target xyz, 
 // offset == offset from current xyz, axis_XXX defines circle plane in tool space, axis_linear is
 // the direction of helical travel, radius == circle radius, isclockwise boolean. Used
@@ -105,6 +180,18 @@ void mc_arc(float *position, float *target, float *offset, float radius, float f
     if (angular_travel <= 0) { angular_travel += 2*M_PI; }
   }
 
+  #ifdef NATIVE_ARCS
+    // Plan the arc as a single block and let the segment generator trace it. See plan_buffer_arc().
+    UNUSED(axis_linear); // Helical travel is planned along with the arc.
+    if (bit_istrue(settings.flags,BITFLAG_SOFT_LIMIT_ENABLE)) {
+      mc_arc_soft_check(position, target, offset, radius, angular_travel, axis_0, axis_1);
+      if (sys.abort) { return; }
+    }
+    if (!mc_ready_planner()) { return; }
+    plan_buffer_arc(target, feed_rate, invert_feed_rate, line_number, offset, angular_travel, axis_0, axis_1);
+    if (!sys.state) { sys.state = STATE_QUEUED; }
+  #else
+
   // NOTE: Segment end points are on the arc, which can lead to the arc diameter being smaller by up to
   // (2x) settings.arc_tolerance. For 99% of users, this is just fine. If a different arc segment fit
   // is desired, i.e. least-squares, midpoint on arc, just change the mm_per_arc_segment calculation.
@@ -186,6 +273,7 @@ void mc_arc(float *position, float *target, float *offset, float radius, float f
   }
   // Ensure last segment arrives at target location.
   mc_line(target, feed_rate, invert_feed_rate, line_number);
+  #endif
 }
 
 
@@ -291,7 +379,7 @@ void mc_reset()
     // NOTE: If steppers are kept enabled via the step idle delay setting, this also keeps
     // the steppers enabled by avoiding the go_idle call altogether, unless the motion state is
     // violated, by which, all bets are off.
-    if (sys.state & (STATE_CYCLE | STATE_HOLD | STATE_HOMING | STATE_FORCESERVO | STATE_PROBING)) {
+    if (sys.state & (STATE_CYCLE | STATE_HOLD | STATE_HOMING | STATE_FORCESERVO | STATE_PROBING | STATE_JOG)) {
       sys.alarm |= ALARM_ABORT_CYCLE;  //killed while in motion
       SYS_EXEC |= EXEC_ALARM; // Flag main program to execute alarm state.
       st_go_idle(); // Force kill steppers. Position has likely been lost.
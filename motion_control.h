@@ -27,6 +27,9 @@
 // (1 minute)/feed_rate time.
 void mc_line(float *target, float feed_rate, uint8_t invert_feed_rate, linenumber_t line_number);
 
+// Execute a '$J=' jog motion in absolute millimeter coordinates and mm/min. Returns a status code.
+uint8_t mc_jog(float *target, float feed_rate);
+
 // Execute an arc in offset mode format. position == current xyz, target == target xyz, 
 // offset == offset from current xyz, axis_XXX defines circle plane in tool space, axis_linear is
 // the direction of helical travel, radius == circle radius, isclockwise boolean. Used
@@ -5,6 +5,7 @@
 #include "report.h"
 #include "spi.h"
 #include "settings.h"
+#include "stepper.h"
 
 #define ADDRESS_IDX     4U
 #define ADDRESS_MASK    0x70
@@ -55,6 +56,7 @@ void _motor_drv_write_reg(enum stepper_e stepper, enum address_e address, uint16
   /* Write to the specified address of stepper. The 12 least significant
   bits are data bits to be written into the register specified by address.
   The 4 most significant bits are masked with the RW bit and address*/
+  ST_PREP_LOCK(); // The SPI bus is shared with the SRAM
   spi_set_mode(0, 0);
 
   uint8_t data_out[2] = {(address << ADDRESS_IDX) | ((data & 0x0F00) >> 8),
@@ -64,11 +66,13 @@ void _motor_drv_write_reg(enum stepper_e stepper, enum address_e address, uint16
   bit_true(SCS_PORT, 1 << scs_pin_lookup[stepper]);
   spi_transact_array(data_out, data_in, 2);
   bit_false(SCS_PORT, 1 << scs_pin_lookup[stepper]);
+  ST_PREP_UNLOCK();
 
 }
 
 uint16_t _motor_drv_read_reg(enum stepper_e stepper, enum address_e address)
 {
+  ST_PREP_LOCK();
   spi_set_mode(0, 0);
 
   uint8_t data_out[2] = {REG_RW | (address << ADDRESS_IDX), 0};
@@ -77,6 +81,7 @@ uint16_t _motor_drv_read_reg(enum stepper_e stepper, enum address_e address)
   bit_true(SCS_PORT, 1 << scs_pin_lookup[stepper]);
   spi_transact_array(data_out, data_in, 2);
   bit_false(SCS_PORT, 1 << scs_pin_lookup[stepper]);
+  ST_PREP_UNLOCK();
 
   data_in[0] &= ~(REG_RW | ADDRESS_MASK);
 
@@ -29,6 +29,8 @@
 #include "settings.h"
 #include "report.h"
 #include "magazine.h"
+#include "sram.h"
+#include <stddef.h>
 
 #define SOME_LARGE_VALUE 1.0E+38 // Used by rapids and acceleration maximization calculations. Just needs
                                  // to be larger than any feasible (mm/min)^2 or mm/sec^2 value.
@@ -37,7 +39,32 @@ static plan_block_t block_buffer[BLOCK_BUFFER_SIZE];  // A ring buffer for motio
 static uint8_t block_buffer_tail;     // Index of the block to process now
 static uint8_t block_buffer_head;     // Index of the next block to be pushed
 static uint8_t next_buffer_head;      // Index of the next buffer head
-static uint8_t block_buffer_planned;  // Index of the optimally planned block
+static uint16_t block_buffer_planned; // Offset from the tail of the optimally planned block
+
+#ifdef PLANNER_SPILL_SIZE
+  // Blocks past the hot window wait in a ring in the SPI SRAM. The spill ring is only in use
+  // while the block buffer is full, so the spilled blocks always directly follow the hot ones.
+  #define PLAN_SPILL_ADDRESS    0 // SRAM address of the spill ring
+  _Static_assert(PLAN_SPILL_ADDRESS+(uint32_t)PLANNER_SPILL_SIZE*sizeof(plan_block_t) <= TX_SPILL_ADDRESS,
+                 "PLANNER_SPILL_SIZE overlaps the serial write spill in the SPI SRAM");
+  #define PLAN_PROFILE_OFFSET   offsetof(plan_block_t,entry_speed_sqr)
+  #define PLAN_PROFILE_SIZE     (offsetof(plan_block_t,millimeters)+sizeof(float)-PLAN_PROFILE_OFFSET)
+  static uint16_t spill_tail;         // Index of the oldest spilled block
+  static uint16_t spill_count;        // Number of spilled blocks
+  static uint8_t spill_enabled;       // Set when the SPI bus and SRAM are available
+  static plan_block_t spill_block[2]; // Scratch copies of spilled blocks being planned
+  #define plan_scratch(block_offset) (&spill_block[(block_offset)&1])
+#else
+  #define plan_scratch(block_offset) NULL
+#endif
+
+#ifdef PLANNER_MERGE_MARKS
+  // Path lengths from the block start to each merged line end, in block order. Consumed by the
+  // stepper as it passes them, to report the line numbers of merged lines on time.
+  static float merge_marks[PLANNER_MERGE_MARKS];
+  static uint8_t merge_mark_tail;
+  static uint8_t merge_mark_count;
+#endif
 
 // Define planner variables
 typedef struct {
@@ -46,9 +73,29 @@ typedef struct {
                                      // i.e. arcs, canned cycles, and backlash compensation.
   float previous_unit_vec[N_AXIS];   // Unit vector of previous path line segment
   float previous_nominal_speed_sqr;  // Nominal speed of previous path line segment
+
+  #ifdef PLANNER_MERGE_MARKS
+    // The last block, as needed to merge the next line into it. See plan_merge_last_block().
+    uint8_t merge_ok;                // Set when the last block may take another line
+    float merge_feed_rate;           // Feed rate the last block was programmed with
+    int32_t merge_start[N_AXIS];     // Start of the last block in absolute steps
+    float merge_unit_vec[N_AXIS];    // Unit vector of the path line segment before the last block
+    float merge_nominal_speed_sqr;   // Nominal speed of the path line segment before the last block
+    uint8_t merge_count;             // Line ends merged into the last block
+    float merge_length;              // Path length of the lines merged into the last block (mm)
+    float merge_error;               // Bound of the path error of the last block (mm)
+  #endif
 } planner_t;
 static planner_t pl;
 
+// Arc of a block being planned. See plan_buffer_arc().
+typedef struct {
+  float *offset;          // Arc center relative to the planner position (mm)
+  float angular_travel;   // Angle to turn (rad). Positive is counter-clockwise.
+  uint8_t axis_0;         // Plane axes
+  uint8_t axis_1;
+} plan_arc_t;
+
 
 uint8_t plan_get_block_index(plan_block_t* block_p){
   return block_p-block_buffer;
@@ -64,7 +111,7 @@ uint8_t plan_next_block_index(uint8_t block_index)
 
 
 // Returns the index of the previous block in the ring buffer
-static uint8_t plan_prev_block_index(uint8_t block_index) 
+static uint8_t plan_prev_block_index(uint8_t block_index)
 {
   if (block_index == 0) { block_index = BLOCK_BUFFER_SIZE; }
   block_index--;
@@ -72,6 +119,87 @@ static uint8_t plan_prev_block_index(uint8_t block_index)
 }
 
 
+// Returns the number of blocks in the hot window ring buffer
+static uint8_t plan_hot_block_count()
+{
+  if (block_buffer_head >= block_buffer_tail) { return(block_buffer_head-block_buffer_tail); }
+  return(BLOCK_BUFFER_SIZE-(block_buffer_tail-block_buffer_head));
+}
+
+
+// Returns the number of blocks in the planner, including the spilled ones
+uint16_t plan_block_count()
+{
+  #ifdef PLANNER_SPILL_SIZE
+    return(plan_hot_block_count()+spill_count);
+  #else
+    return(plan_hot_block_count());
+  #endif
+}
+
+
+uint16_t plan_get_block_buffer_available()
+{
+  // One slot of the hot window always stays empty to tell a full ring from an empty one
+  uint16_t capacity = BLOCK_BUFFER_SIZE-1;
+  #ifdef PLANNER_SPILL_SIZE
+    if (spill_enabled) { capacity += PLANNER_SPILL_SIZE; }
+  #endif
+  return(capacity-plan_block_count());
+}
+
+
+#ifdef PLANNER_SPILL_SIZE
+// Returns the SRAM address of the spilled block at the given offset from the buffer tail.
+static uint16_t plan_spill_address(uint16_t block_offset)
+{
+  uint16_t spill_index = spill_tail + (block_offset - plan_hot_block_count());
+  if (spill_index >= PLANNER_SPILL_SIZE) { spill_index -= PLANNER_SPILL_SIZE; }
+  return(PLAN_SPILL_ADDRESS + spill_index*sizeof(plan_block_t));
+}
+#endif
+
+
+// Returns the block at the given offset from the buffer tail. A spilled block is read into the
+// scratch block, all of it or only its profile fields used by the planner passes.
+static plan_block_t *plan_get_block(uint16_t block_offset, plan_block_t *scratch, uint8_t profile_only)
+{
+  #ifdef PLANNER_SPILL_SIZE
+    if (block_offset >= plan_hot_block_count()) {
+      uint16_t addr = plan_spill_address(block_offset);
+      if (profile_only) {
+        sram_read(addr+PLAN_PROFILE_OFFSET, (uint8_t*)scratch+PLAN_PROFILE_OFFSET, PLAN_PROFILE_SIZE);
+      } else {
+        sram_read(addr, scratch, sizeof(plan_block_t));
+      }
+      return(scratch);
+    }
+  #else
+    UNUSED(scratch);
+    UNUSED(profile_only);
+  #endif
+  uint16_t block_index = block_buffer_tail + block_offset;
+  if (block_index >= BLOCK_BUFFER_SIZE) { block_index -= BLOCK_BUFFER_SIZE; }
+  return(&block_buffer[block_index]);
+}
+
+
+// Writes back the profile fields of a block returned by plan_get_block(). Nothing to do for
+// blocks in the hot window, which are changed in place.
+static void plan_put_block_profile(uint16_t block_offset, plan_block_t *block)
+{
+  #ifdef PLANNER_SPILL_SIZE
+    if (block_offset >= plan_hot_block_count()) {
+      sram_write(plan_spill_address(block_offset)+PLAN_PROFILE_OFFSET,
+                 (uint8_t*)block+PLAN_PROFILE_OFFSET, PLAN_PROFILE_SIZE);
+    }
+  #else
+    UNUSED(block_offset);
+    UNUSED(block);
+  #endif
+}
+
+
 /*                            PLANNER SPEED DEFINITION                                              
                                      +--------+   <- current->nominal_speed
                                     /          \                                
@@ -118,11 +246,14 @@ static uint8_t plan_prev_block_index(uint8_t block_index)
       the buffer is full or empty. As described for standard ring buffers, this block is always empty.
   - next_buffer_head: Points to next planner buffer block after the buffer head block. When equal to the 
       buffer tail, this indicates the buffer is full.
-  - block_buffer_planned: Points to the first buffer block after the last optimally planned block for normal
-      streaming operating conditions. Use for planning optimizations by avoiding recomputing parts of the 
+  - block_buffer_planned: Offset from the tail of the first buffer block after the last optimally planned
+      block for normal streaming operating conditions. Use for planning optimizations by avoiding recomputing parts of the 
       planner buffer that don't change with the addition of a new block, as describe above. In addition, 
       this block can never be less than block_buffer_tail and will always be pushed forward and maintain 
       this requirement when encountered by the plan_discard_current_block() routine during a cycle.
+  - Spill ring: With PLANNER_SPILL_SIZE, the blocks after a full block buffer are kept in a ring in the
+      SPI SRAM. The planner passes run over both, addressed by their offset from the tail. The stepper only
+      ever sees the block buffer, which is refilled from the spill ring as blocks are discarded.
   
   NOTE: Since the planner only computes on what's in the planner buffer, some motions with lots of short 
   line segments, like G2/3 arcs or complex curves, may seem to move slow. This is because there simply isn't
@@ -135,38 +266,43 @@ static uint8_t plan_prev_block_index(uint8_t block_index)
   for the planner to compute over. It also increases the number of computations the planner has to perform
   to compute an optimal plan, so select carefully. The Arduino 328p memory is already maxed out, but future
   ARM versions should have enough memory and speed for look-ahead blocks numbering up to a hundred or more.
+  (4) Enable the spill ring, which gives the KeyMe board a few hundred blocks of look-ahead in SPI SRAM.
 
 */
 static void planner_recalculate() 
 {   
-  // Initialize block index to the last block in the planner buffer.
-  uint8_t block_index = plan_prev_block_index(block_buffer_head);
+  // Initialize block offset to the last block in the planner buffer.
+  uint16_t block_count = plan_block_count();
+  if (block_count == 0) { return; } // Nothing to plan. Offsets below assume a non-empty buffer.
+  uint16_t block_offset = block_count-1;
         
   // Bail. Can't do anything with one only one plan-able block.
-  if (block_index == block_buffer_planned) { return; }
+  if (block_offset == block_buffer_planned) { return; }
       
   // Reverse Pass: Coarsely maximize all possible deceleration curves back-planning from the last
   // block in buffer. Cease planning when the last optimal planned or tail pointer is reached.
   // NOTE: Forward pass will later refine and correct the reverse pass to create an optimal plan.
+  // NOTE: Spilled blocks are read into alternating scratch blocks, so current and next never alias.
   float entry_speed_sqr;
   plan_block_t *next;
-  plan_block_t *current = &block_buffer[block_index];
+  plan_block_t *current = plan_get_block(block_offset, plan_scratch(block_offset), true);
 
   // Calculate maximum entry speed for last block in buffer, where the exit speed is always zero.
   current->entry_speed_sqr = min( current->max_entry_speed_sqr, 2*current->acceleration*current->millimeters);
+  plan_put_block_profile(block_offset, current);
   
-  block_index = plan_prev_block_index(block_index);
-  if (block_index == block_buffer_planned) { // Only two plannable blocks in buffer. Reverse pass complete.
+  block_offset--;
+  if (block_offset == block_buffer_planned) { // Only two plannable blocks in buffer. Reverse pass complete.
     // Check if the first block is the tail. If so, notify stepper to update its current parameters.
-    if (block_index == block_buffer_tail) { st_update_plan_block_parameters(); }
+    if (block_offset == 0) { st_update_plan_block_parameters(); }
   } else { // Three or more plan-able blocks
-    while (block_index != block_buffer_planned) { 
+    while (block_offset != block_buffer_planned) { 
       next = current;
-      current = &block_buffer[block_index];
-      block_index = plan_prev_block_index(block_index);
+      current = plan_get_block(block_offset, plan_scratch(block_offset), true);
+      block_offset--;
 
       // Check if next block is the tail block(=planned block). If so, update current stepper parameters.
-      if (block_index == block_buffer_tail) { st_update_plan_block_parameters(); } 
+      if (block_offset == 0) { st_update_plan_block_parameters(); } 
 
       // Compute maximum entry speed decelerating over the current block from its exit speed.
       if (current->entry_speed_sqr != current->max_entry_speed_sqr) {
@@ -176,17 +312,18 @@ static void planner_recalculate()
         } else {
           current->entry_speed_sqr = current->max_entry_speed_sqr;
         }
+        plan_put_block_profile(block_offset+1, current);
       }
     }
   }    
 
   // Forward Pass: Forward plan the acceleration curve from the planned pointer onward.
   // Also scans for optimal plan breakpoints and appropriately updates the planned pointer.
-  next = &block_buffer[block_buffer_planned]; // Begin at buffer planned pointer
-  block_index = plan_next_block_index(block_buffer_planned); 
-  while (block_index != block_buffer_head) {
+  next = plan_get_block(block_buffer_planned, plan_scratch(block_buffer_planned), true); // Begin at buffer planned pointer
+  block_offset = block_buffer_planned+1; 
+  while (block_offset != block_count) {
     current = next;
-    next = &block_buffer[block_index];
+    next = plan_get_block(block_offset, plan_scratch(block_offset), true);
     
     // Any acceleration detected in the forward pass automatically moves the optimal planned
     // pointer forward, since everything before this is all optimal. In other words, nothing
@@ -196,7 +333,8 @@ static void planner_recalculate()
       // If true, current block is full-acceleration and we can move the planned pointer forward.
       if (entry_speed_sqr < next->entry_speed_sqr) {
         next->entry_speed_sqr = entry_speed_sqr; // Always <= max_entry_speed_sqr. Backward pass sets this.
-        block_buffer_planned = block_index; // Set optimal plan pointer.
+        plan_put_block_profile(block_offset, next);
+        block_buffer_planned = block_offset; // Set optimal plan pointer.
       }
     }
     
@@ -204,30 +342,108 @@ static void planner_recalculate()
     // point in the buffer. When the plan is bracketed by either the beginning of the
     // buffer and a maximum entry speed or two maximum entry speeds, every block in between
     // cannot logically be further improved. Hence, we don't have to recompute them anymore.
-    if (next->entry_speed_sqr == next->max_entry_speed_sqr) { block_buffer_planned = block_index; }
-    block_index = plan_next_block_index( block_index );
+    if (next->entry_speed_sqr == next->max_entry_speed_sqr) { block_buffer_planned = block_offset; }
+    block_offset++;
   } 
 }
 
 
+// Computes the nominal speed of a block from its programmed rate and the current feed or rapid
+// override, never exceeding the axis maximum rates.
+static float plan_compute_nominal_speed(plan_block_t *block)
+{
+  float nominal_speed = block->programmed_rate;
+  if (block->flags & PL_FLAG_RAPID) { nominal_speed *= (0.01*sys.r_override); }
+  else if (!(block->flags & PL_FLAG_NO_OVERRIDE)) {
+    nominal_speed *= (0.01*sys.f_override);
+    if (nominal_speed > block->rapid_rate) { nominal_speed = block->rapid_rate; }
+  }
+  return(nominal_speed);
+}
+
+
+// Computes the nominal speed and the maximum entry speed of a block. The junction speed is
+// limited by the nominal speeds of both neighboring blocks.
+static void plan_compute_profile_parameters(plan_block_t *block, float prev_nominal_speed_sqr)
+{
+  float nominal_speed = plan_compute_nominal_speed(block);
+  block->nominal_speed_sqr = nominal_speed*nominal_speed; // (mm/min). Always > 0
+  block->max_entry_speed_sqr = min(block->max_junction_speed_sqr,
+                                   min(block->nominal_speed_sqr,prev_nominal_speed_sqr));
+}
+
+
+void plan_update_velocity_profile_parameters()
+{
+  uint16_t block_count = plan_block_count();
+  if (block_count == 0) { return; } // Nothing buffered
+  float prev_nominal_speed_sqr = SOME_LARGE_VALUE; // First block is limited by its junction speed only.
+  uint16_t block_offset;
+  for (block_offset=0; block_offset<block_count; block_offset++) {
+    #ifdef PLANNER_MERGE_MARKS
+      pl.merge_nominal_speed_sqr = prev_nominal_speed_sqr; // Ends up before the last block
+    #endif
+    plan_block_t *block = plan_get_block(block_offset, plan_scratch(0), false);
+    plan_compute_profile_parameters(block, prev_nominal_speed_sqr);
+    plan_put_block_profile(block_offset, block);
+    prev_nominal_speed_sqr = block->nominal_speed_sqr;
+  }
+  pl.previous_nominal_speed_sqr = prev_nominal_speed_sqr; // For the junction of the next new block.
+}
+
+
 void plan_reset() 
 {
+  ST_PREP_LOCK();
   memset(&pl, 0, sizeof(pl)); // Clear planner struct
   block_buffer_tail = 0;
   block_buffer_head = 0; // Empty = tail
   next_buffer_head = 1; // plan_next_block_index(block_buffer_head)
   block_buffer_planned = 0; // = block_buffer_tail;
+  #ifdef PLANNER_SPILL_SIZE
+    spill_tail = 0;
+    spill_count = 0;
+    spill_enabled = settings.use_spi; // The SRAM is only initialized with the SPI bus.
+  #endif
+  #ifdef PLANNER_MERGE_MARKS
+    merge_mark_tail = 0;
+    merge_mark_count = 0;
+  #endif
+  ST_PREP_UNLOCK();
 }
 
 
 void plan_discard_current_block() 
 {
   if (block_buffer_head != block_buffer_tail) { // Discard non-empty buffer.
-    uint8_t block_index = plan_next_block_index( block_buffer_tail );
-    // Push block_buffer_planned pointer, if encountered.
-    if (block_buffer_tail == block_buffer_planned) { block_buffer_planned = block_index; }
-    block_buffer_tail = block_index;
+    // Push block_buffer_planned pointer, if encountered. Otherwise it moves with the tail.
+    if (block_buffer_planned) { block_buffer_planned--; }
+    block_buffer_tail = plan_next_block_index( block_buffer_tail );
+
+    #ifdef PLANNER_SPILL_SIZE
+      // Prefetch the oldest spilled block into the freed slot of the hot window. The spilled
+      // blocks directly follow the hot ones, so the planned offset is unchanged.
+      if (spill_count) {
+        sram_read(PLAN_SPILL_ADDRESS + spill_tail*sizeof(plan_block_t), &block_buffer[block_buffer_head],
+                  sizeof(plan_block_t));
+        if (++spill_tail == PLANNER_SPILL_SIZE) { spill_tail = 0; }
+        spill_count--;
+        block_buffer_head = next_buffer_head;
+        next_buffer_head = plan_next_block_index(block_buffer_head);
+      }
+    #endif
+  }
+}
+
+
+// Discards all jog blocks at the tail of the buffer. Called after a jog cancel has brought the
+// steppers to a stop. Non-jog blocks are never queued behind jogs, so this normally empties it.
+void plan_flush_jog_blocks()
+{
+  while ((block_buffer_tail != block_buffer_head) && (block_buffer[block_buffer_tail].flags & PL_FLAG_JOG)) {
+    plan_discard_current_block(); // Also prefetches any spilled jogs into the hot window.
   }
+  block_buffer_planned = 0; // = block_buffer_tail
 }
 
 
@@ -238,6 +454,8 @@ plan_block_t *plan_get_current_block()
 }
 
 
+// NOTE: The block after the tail is always in the hot window, since blocks are only spilled
+// while the hot window is full.
 float plan_get_exec_block_exit_speed()
 {
   uint8_t block_index = plan_next_block_index(block_buffer_tail);
@@ -249,11 +467,171 @@ float plan_get_exec_block_exit_speed()
 // Returns the availability status of the block ring buffer. True, if full.
 uint8_t plan_check_full_buffer()
 {
-  if (block_buffer_tail == next_buffer_head) { return(true); }
+  if (block_buffer_tail == next_buffer_head) {
+    #ifdef PLANNER_SPILL_SIZE
+      if (spill_enabled && (spill_count < PLANNER_SPILL_SIZE)) { return(false); }
+    #endif
+    return(true);
+  }
   return(false);
 }
 
 
+#ifdef PLANNER_MERGE_MARKS
+float plan_get_merge_mark()
+{
+  return(merge_marks[merge_mark_tail]);
+}
+
+
+void plan_discard_merge_mark()
+{
+  if (merge_mark_count) {
+    if (++merge_mark_tail == PLANNER_MERGE_MARKS) { merge_mark_tail = 0; }
+    merge_mark_count--;
+  }
+}
+
+
+// Returns true if a line may be merged with its neighbors. Only plain g-code lines qualify.
+static uint8_t plan_line_mergeable(uint8_t invert_feed_rate, linenumber_t line_number, plan_arc_t *arc)
+{
+  if (settings.merge_tolerance <= 0.0 || invert_feed_rate || arc) { return(false); }
+  if (line_number > LINENUMBER_MAX) { return(false); } // Homing, servo, jog and empty blocks
+  if (sys.state & (STATE_HOMING | STATE_FORCESERVO | STATE_PROBING | STATE_JOG)) { return(false); }
+  return(true);
+}
+
+
+/* Folds the line ending at target_steps into the last block, when it continues the last block in
+   nearly the same direction and the merged line stays within the merge tolerance of every line end
+   it replaces. Let S-E be the last block and E-T the new line. The path error of merging is the
+   distance of E from S-T, added to the error of any lines already merged into S-E, which bounds
+   the distance of their ends from S-T. The block being executed is never merged into.
+   When merged, the last block is popped and the planner is rewound to its start, so that the
+   caller plans S-T in its place. The end of the last line is marked by its path length from S.
+   Returns true, if merged. */
+static uint8_t plan_merge_last_block(int32_t *target_steps)
+{
+  if (plan_block_count() < 2) { return(false); }
+  if (merge_mark_count == PLANNER_MERGE_MARKS || pl.merge_count == 255) { return(false); }
+
+  float a[N_AXIS], b[N_AXIS]; // S-E and E-T in (mm)
+  float aa = 0.0, bb = 0.0, ab = 0.0;
+  uint8_t idx;
+  for (idx=0; idx<N_AXIS; idx++) {
+    a[idx] = (pl.position[idx]-pl.merge_start[idx])/settings.steps_per_mm[idx];
+    b[idx] = (target_steps[idx]-pl.position[idx])/settings.steps_per_mm[idx];
+    aa += a[idx]*a[idx];
+    bb += b[idx]*b[idx];
+    ab += a[idx]*b[idx];
+  }
+  if (bb == 0.0) { return(false); } // Zero-length line. Handled by the caller.
+
+  // Direction change, by cos(theta) = ab/sqrt(aa*bb), without the sqrt.
+  if ((ab <= 0.0) || (ab*ab < (PLANNER_MERGE_MIN_COS*PLANNER_MERGE_MIN_COS)*aa*bb)) { return(false); }
+
+  // Distance of E from S-T, where S-T = a+b. E projects inside S-T, since ab > 0.
+  float ac = aa+ab;
+  float cc = aa+2*ab+bb;
+  float error = aa-ac*ac/cc;
+  error = pl.merge_error + ((error > 0.0) ? sqrt(error) : 0.0);
+  if (error > settings.merge_tolerance) { return(false); }
+
+  // Pop the last block. The junction before it changes a little with the merged line, so the
+  // block before it is re-planned as well.
+  #ifdef PLANNER_SPILL_SIZE
+    if (spill_count) { spill_count--; } else
+  #endif
+  {
+    next_buffer_head = block_buffer_head;
+    block_buffer_head = plan_prev_block_index(block_buffer_head);
+  }
+  uint16_t block_count = plan_block_count();
+  if (block_buffer_planned+1 >= block_count) {
+    block_buffer_planned = (block_count > 1) ? block_count-2 : 0;
+  }
+
+  // Mark the end of the last line and rewind the planner to the start of its block.
+  uint8_t mark_index = merge_mark_tail + merge_mark_count;
+  if (mark_index >= PLANNER_MERGE_MARKS) { mark_index -= PLANNER_MERGE_MARKS; }
+  merge_marks[mark_index] = pl.merge_length;
+  merge_mark_count++;
+  pl.merge_count++;
+  pl.merge_length += sqrt(bb);
+  pl.merge_error = error;
+  memcpy(pl.position, pl.merge_start, sizeof(pl.position));
+  memcpy(pl.previous_unit_vec, pl.merge_unit_vec, sizeof(pl.previous_unit_vec));
+  pl.previous_nominal_speed_sqr = pl.merge_nominal_speed_sqr;
+  return(true);
+}
+#endif
+
+
+#ifdef NATIVE_ARCS
+/* Sets up an arc block. Expects the net travel of each axis in unit_vec[] and replaces it with
+   the largest share of the path each axis may take along the arc, which the axis limits are
+   applied to. Any direction in the plane may come up, so both plane axes take the full share of
+   the plane. The tangent unit vectors at the start and the end of the arc, which the junctions
+   are computed from, go to tangent[0] and tangent[1]. The block step_event_count is set to the
+   path length in steps of the finest axis, as the distance resolution of the segment generator.
+   NOTE: The arc speed is also limited by the centripetal acceleration v^2/r of the slower plane
+   axis. The tangential acceleration is not reduced for it. */
+static void plan_arc_setup(plan_block_t *block, plan_arc_t *arc, float *unit_vec, float tangent[2][N_AXIS])
+{
+  uint8_t axis_0 = arc->axis_0;
+  uint8_t axis_1 = arc->axis_1;
+  float r_axis0 = -arc->offset[axis_0];  // Radius vector from center to the start
+  float r_axis1 = -arc->offset[axis_1];
+  float rt_axis0 = r_axis0 + unit_vec[axis_0];  // Radius vector from center to the end
+  float rt_axis1 = r_axis1 + unit_vec[axis_1];
+  float radius = sqrt(r_axis0*r_axis0 + r_axis1*r_axis1);
+  float plane_mm = radius*fabs(arc->angular_travel);
+
+  // Path length. The other axes travel linearly along the arc, like the helical axis.
+  float mm_sqr = plane_mm*plane_mm;
+  uint8_t idx;
+  for (idx=0; idx<N_AXIS; idx++) {
+    if ((idx != axis_0) && (idx != axis_1)) { mm_sqr += unit_vec[idx]*unit_vec[idx]; }
+  }
+  block->millimeters = sqrt(mm_sqr);
+  block->step_event_count = 0;
+  if (block->millimeters == 0.0) { return; } // Zero-length. Bailed by the caller.
+  float inverse_millimeters = 1.0/block->millimeters;
+
+  // Tangents are the radius vectors turned a quarter in the direction of travel.
+  float tangent_scalar = 0.0;
+  if (radius > 0.0) {
+    tangent_scalar = plane_mm*inverse_millimeters/radius;
+    if (arc->angular_travel < 0.0) { tangent_scalar = -tangent_scalar; }
+    block->rapid_rate = sqrt(min(settings.acceleration[axis_0],settings.acceleration[axis_1])*radius);
+  }
+  tangent[0][axis_0] = -r_axis1*tangent_scalar;
+  tangent[0][axis_1] = r_axis0*tangent_scalar;
+  tangent[1][axis_0] = -rt_axis1*tangent_scalar;
+  tangent[1][axis_1] = rt_axis0*tangent_scalar;
+  unit_vec[axis_0] = plane_mm;
+  unit_vec[axis_1] = plane_mm;
+
+  float max_steps_per_mm = 0.0;
+  for (idx=0; idx<N_AXIS; idx++) {
+    if ((idx != axis_0) && (idx != axis_1)) {
+      tangent[0][idx] = unit_vec[idx]*inverse_millimeters;
+      tangent[1][idx] = tangent[0][idx];
+    }
+    if (unit_vec[idx] != 0.0) { max_steps_per_mm = max(max_steps_per_mm,settings.steps_per_mm[idx]); }
+  }
+  block->step_event_count = ceil(block->millimeters*max_steps_per_mm);
+
+  block->flags |= PL_FLAG_ARC;
+  block->arc_vec[0] = r_axis0;
+  block->arc_vec[1] = r_axis1;
+  block->arc_angle = arc->angular_travel;
+  block->arc_axes = axis_0 | (axis_1 << 4);
+}
+#endif
+
+
 /* Add a new linear movement to the buffer. target[N_AXIS] is the signed, absolute target position
    in millimeters. Feed rate specifies the speed of the motion. If feed rate is inverted, the feed
    rate is taken to mean "frequency" and would complete the operation in 1/feed_rate minutes.
@@ -263,25 +641,47 @@ uint8_t plan_check_full_buffer()
    In other words, the buffer head is never equal to the buffer tail.  Also the feed rate input value
    is used in three ways: as a normal feed rate if invert_feed_rate is false, as inverse time if
    invert_feed_rate is true, or as seek/rapids rate if the feed_rate value is negative (and
-   invert_feed_rate always false). */
-void plan_buffer_line(float *target, float feed_rate, uint8_t invert_feed_rate, linenumber_t line_number) 
+   invert_feed_rate always false). An arc block is planned, if arc is given. */
+static void plan_buffer_block(float *target, float feed_rate, uint8_t invert_feed_rate, linenumber_t line_number,
+                              plan_arc_t *arc)
 {
-  // Prepare and initialize new block
+  // Calculate target position in absolute steps. This conversion should be consistent throughout.
+  int32_t target_steps[N_AXIS];
+  uint8_t idx;
+  for (idx=0; idx<N_AXIS; idx++) {
+    target_steps[idx] = lround(target[idx]*settings.steps_per_mm[idx]);
+  }
+
+  // Fold the line into the last block, if it is nearly collinear with it. The block is then
+  // planned again below, from the start of the last block to the new target.
+  #ifdef PLANNER_MERGE_MARKS
+    uint8_t mergeable = plan_line_mergeable(invert_feed_rate, line_number, arc);
+    uint8_t merged = false;
+    if (mergeable && pl.merge_ok && (feed_rate == pl.merge_feed_rate)) {
+      merged = plan_merge_last_block(target_steps);
+    }
+    float programmed_feed_rate = feed_rate;
+  #endif
+
+  // Prepare and initialize new block. Once the hot window is full, the block is built in a
+  // scratch block and appended to the spill ring in the SPI SRAM.
   plan_block_t *block = &block_buffer[block_buffer_head];
+  #ifdef PLANNER_SPILL_SIZE
+    uint8_t spill = (block_buffer_tail == next_buffer_head);
+    if (spill) { block = plan_scratch(0); }
+  #endif
   block->step_event_count = 0;
   block->millimeters = 0;
   block->direction_bits = 0;
   block->acceleration = SOME_LARGE_VALUE; // Scaled down to maximum acceleration later
+  block->jerk = SOME_LARGE_VALUE; // Scaled down to maximum jerk later, if any moving axis is jerk limited
+  block->rapid_rate = SOME_LARGE_VALUE; // Scaled down to maximum rate later
+  block->flags = 0;
   block->line_number = line_number;
 
   // to try to keep these types of things completely separate from the planner for portability.
-  int32_t target_steps[N_AXIS];
   float unit_vec[N_AXIS], delta_mm;
-  uint8_t idx;
   for (idx=0; idx<N_AXIS; idx++) {
-    // Calculate target position in absolute steps. This conversion should be consistent throughout.
-    target_steps[idx] = lround(target[idx]*settings.steps_per_mm[idx]);
-  
     // Number of steps for each axis and determine max step events
     block->steps[idx] = labs(target_steps[idx]-pl.position[idx]);
     block->step_event_count = max(block->step_event_count, block->steps[idx]);
@@ -298,6 +698,10 @@ void plan_buffer_line(float *target, float feed_rate, uint8_t invert_feed_rate,
     block->millimeters += delta_mm*delta_mm;
   }
   block->millimeters = sqrt(block->millimeters); // Complete millimeters calculation with sqrt()
+  #ifdef NATIVE_ARCS
+    float arc_tangent[2][N_AXIS]; // Arc unit vectors at the start and the end of the block
+    if (arc) { plan_arc_setup(block, arc, unit_vec, arc_tangent); }
+  #endif
   
   // Bail if this is a zero-length block. Highly unlikely to occur.
   if (block->step_event_count == 0) { 
@@ -312,8 +716,14 @@ void plan_buffer_line(float *target, float feed_rate, uint8_t invert_feed_rate,
   }
   
   // Adjust feed_rate value to mm/min depending on type of rate input (normal, inverse time, or rapids)
-  // TODO: Need to distinguish a rapids vs feed move for overrides. Some flag of some sort.
-  if (feed_rate < 0) { feed_rate = SOME_LARGE_VALUE; } // Scaled down to absolute max/rapids rate later
+  // NOTE: Homing and force servo motions are planned directly, in their own states, and keep
+  // their rates regardless of overrides.
+  if (sys.state & (STATE_HOMING | STATE_FORCESERVO)) { block->flags |= PL_FLAG_NO_OVERRIDE; }
+  if (sys.state == STATE_JOG) { block->flags |= (PL_FLAG_JOG | PL_FLAG_NO_OVERRIDE); }
+  if (feed_rate < 0) { // Scaled down to absolute max/rapids rate later
+    feed_rate = SOME_LARGE_VALUE;
+    block->flags |= PL_FLAG_RAPID;
+  }
   else if (invert_feed_rate) { feed_rate = block->millimeters/feed_rate; }
 
   // Calculate the unit vector of the line move and the block maximum feed rate and acceleration scaled 
@@ -330,8 +740,9 @@ void plan_buffer_line(float *target, float feed_rate, uint8_t invert_feed_rate,
       inverse_unit_vec_value = fabs(1.0/unit_vec[idx]); // Inverse to remove multiple float divides.
 
       // Check and limit feed rate against max individual axis velocities and accelerations
-      feed_rate = min(feed_rate,settings.max_rate[idx]*inverse_unit_vec_value);
+      block->rapid_rate = min(block->rapid_rate,settings.max_rate[idx]*inverse_unit_vec_value);
       block->acceleration = min(block->acceleration,settings.acceleration[idx]*inverse_unit_vec_value);
+      if (settings.jerk[idx] > 0.0) { block->jerk = min(block->jerk,settings.jerk[idx]*inverse_unit_vec_value); }
 
       // Incrementally compute cosine of angle between previous and current path. Cos(theta) of the junction
       // between the current move and the previous move is simply the dot product of the two unit vectors, 
@@ -340,6 +751,17 @@ void plan_buffer_line(float *target, float feed_rate, uint8_t invert_feed_rate,
     }
   }
   
+  block->programmed_rate = min(feed_rate,block->rapid_rate);
+
+  // The junction into an arc is at its start tangent, the next junction at its end tangent.
+  #ifdef NATIVE_ARCS
+    if (arc) {
+      junction_cos_theta = 0;
+      for (idx=0; idx<N_AXIS; idx++) { junction_cos_theta -= pl.previous_unit_vec[idx]*arc_tangent[0][idx]; }
+      memcpy(unit_vec, arc_tangent[1], sizeof(unit_vec));
+    }
+  #endif
+
   // TODO: Need to check this method handling zero junction speeds when starting from rest.
   if (block_buffer_head == block_buffer_tail) {
   
@@ -380,13 +802,45 @@ void plan_buffer_line(float *target, float feed_rate, uint8_t invert_feed_rate,
                                  (block->acceleration * settings.junction_deviation * sin_theta_d2)/(1.0-sin_theta_d2) );
   }
 
-  // Store block nominal speed
-  block->nominal_speed_sqr = feed_rate*feed_rate; // (mm/min). Always > 0
-  
-  // Compute the junction maximum entry based on the minimum of the junction speed and neighboring nominal speeds.
-  block->max_entry_speed_sqr = min(max_junction_speed_sqr, 
-                                   min(block->nominal_speed_sqr,pl.previous_nominal_speed_sqr));
+  // Store block nominal speed and the maximum entry speed, based on the minimum of the junction
+  // speed and neighboring nominal speeds. Both are recomputed when the overrides change.
+  block->max_junction_speed_sqr = max_junction_speed_sqr;
+  plan_compute_profile_parameters(block, pl.previous_nominal_speed_sqr);
+
+  // Jerk limited blocks are executed with S-curve ramps by the segment generator. Each ramp keeps
+  // the time and distance of the planned trapezoid ramp, but its acceleration rises and falls
+  // smoothly, peaking at 1.5x the planned acceleration a with a peak jerk of 6*a^2/dv, where dv is
+  // the speed change of the ramp. Plan with a lower acceleration, such that the peak stays within
+  // the axis limits and the ramp from rest to the nominal speed stays within the jerk limit.
+  // Shorter ramps between junction speeds are not jerk limited as tightly, but never exceed the
+  // acceleration limit. The junction speed above is still computed from the full acceleration,
+  // since no tangential acceleration acts there.
+  // NOTE: The acceleration is planned for the programmed rate and is not changed by overrides.
+  // NOTE: Compared as a float, since SOME_LARGE_VALUE is a double constant on hosts such as the sim.
+  if (block->jerk == (float)SOME_LARGE_VALUE) { block->jerk = 0.0; } // Trapezoid profile
+  else {
+    block->acceleration = min(block->acceleration*(1.0/1.5),
+                              sqrt(block->jerk*block->programmed_rate*(1.0/6.0)));
+  }
   
+  // Keep the start and the lines of this block, to merge the next line into it.
+  #ifdef PLANNER_MERGE_MARKS
+    if (!merged) {
+      memcpy(pl.merge_start, pl.position, sizeof(pl.position));
+      memcpy(pl.merge_unit_vec, pl.previous_unit_vec, sizeof(pl.previous_unit_vec));
+      pl.merge_nominal_speed_sqr = pl.previous_nominal_speed_sqr;
+      pl.merge_count = 0;
+      pl.merge_length = block->millimeters;
+      pl.merge_error = 0.0;
+    }
+    pl.merge_ok = mergeable;
+    pl.merge_feed_rate = programmed_feed_rate;
+    block->merge_count = pl.merge_count;
+    block->merge_length = pl.merge_length;
+  #else
+    block->merge_count = 0;
+  #endif
+
   // Update previous path unit_vector and nominal speed (squared)
   memcpy(pl.previous_unit_vec, unit_vec, sizeof(unit_vec)); // pl.previous_unit_vec[] = unit_vec[]
   pl.previous_nominal_speed_sqr = block->nominal_speed_sqr;
@@ -395,14 +849,44 @@ void plan_buffer_line(float *target, float feed_rate, uint8_t invert_feed_rate,
   memcpy(pl.position, target_steps, sizeof(target_steps)); // pl.position[] = target_steps[]
 
   // New block is all set. Update buffer head and next buffer head indices.
-  block_buffer_head = next_buffer_head;  
-  next_buffer_head = plan_next_block_index(block_buffer_head);
+  #ifdef PLANNER_SPILL_SIZE
+    if (spill) {
+      uint16_t spill_index = spill_tail + spill_count;
+      if (spill_index >= PLANNER_SPILL_SIZE) { spill_index -= PLANNER_SPILL_SIZE; }
+      sram_write(PLAN_SPILL_ADDRESS + spill_index*sizeof(plan_block_t), block, sizeof(plan_block_t));
+      spill_count++;
+    } else
+  #endif
+  {
+    block_buffer_head = next_buffer_head;  
+    next_buffer_head = plan_next_block_index(block_buffer_head);
+  }
   
   // Finish up by recalculating the plan with the new block.
   planner_recalculate();
 }
 
 
+void plan_buffer_line(float *target, float feed_rate, uint8_t invert_feed_rate, linenumber_t line_number)
+{
+  ST_PREP_LOCK();
+  plan_buffer_block(target, feed_rate, invert_feed_rate, line_number, NULL);
+  ST_PREP_UNLOCK();
+}
+
+
+#ifdef NATIVE_ARCS
+void plan_buffer_arc(float *target, float feed_rate, uint8_t invert_feed_rate, linenumber_t line_number,
+                     float *offset, float angular_travel, uint8_t axis_0, uint8_t axis_1)
+{
+  plan_arc_t arc = { offset, angular_travel, axis_0, axis_1 };
+  ST_PREP_LOCK();
+  plan_buffer_block(target, feed_rate, invert_feed_rate, line_number, &arc);
+  ST_PREP_UNLOCK();
+}
+#endif
+
+
 // Reset the planner position vectors. Called by the system abort/initialization routine.
 void plan_sync_position()
 {
@@ -410,6 +894,9 @@ void plan_sync_position()
   for (idx=0; idx<N_AXIS; idx++) {
     pl.position[idx] = sys.position[idx];
   }
+  #ifdef PLANNER_MERGE_MARKS
+    pl.merge_ok = false; // The last block no longer ends at the planner position.
+  #endif
 }
 
 float plan_get_position(uint8_t axis){ //in mm
@@ -421,7 +908,9 @@ float plan_get_position(uint8_t axis){ //in mm
 void plan_cycle_reinitialize()
 {
   // Re-plan from a complete stop. Reset planner entry speeds and buffer planned pointer.
+  ST_PREP_LOCK();
   st_update_plan_block_parameters();
-  block_buffer_planned = block_buffer_tail;
+  block_buffer_planned = 0; // = block_buffer_tail
   planner_recalculate();  
+  ST_PREP_UNLOCK();
 }
@@ -46,11 +46,37 @@ typedef struct {
                                  //   neighboring nominal speeds with overrides in (mm/min)^2
   float nominal_speed_sqr;       // Axis-limit adjusted nominal speed for this block in (mm/min)^2
   float acceleration;            // Axis-limit adjusted line acceleration in (mm/min^2)
+  float jerk;                    // Axis-limit adjusted line jerk in (mm/min^3). Zero for trapezoid profiles.
   float millimeters;             // The remaining distance for this block to be executed in (mm)
 
+  // Fields used to recompute the nominal speeds when feed or rapid overrides change
+  uint8_t flags;                 // See PL_FLAG_xxx below
+  float programmed_rate;         // Axis-limit adjusted programmed rate before overrides in (mm/min)
+  float rapid_rate;              // Axis-limit adjusted maximum rate for this block direction in (mm/min)
+  float max_junction_speed_sqr;  // Junction entry speed limit based on direction vectors in (mm/min)^2
+
+  // Fields used to report the line numbers of moves merged into this block
+  uint8_t merge_count;           // Line ends merged into this block. See plan_get_merge_mark().
+  float merge_length;            // Path length of all lines in this block in (mm)
+
+  #ifdef NATIVE_ARCS
+    // Arc geometry of PL_FLAG_ARC blocks. The arc turns in the plane of its two axes, all other
+    // moving axes travel linearly. The step fields hold the net travel, except step_event_count,
+    // which sets the distance resolution of the arc for the segment generator.
+    float arc_vec[2];            // Radius vector from the arc center to the block start in (mm)
+    float arc_angle;             // Angular travel in (rad). Positive is counter-clockwise.
+    uint8_t arc_axes;            // Plane axes, axis_0 | (axis_1 << 4)
+  #endif
+
   linenumber_t line_number;
 } plan_block_t;
 
+// Define planner block flags
+#define PL_FLAG_RAPID        bit(0) // Rapid motion. Scaled by the rapid override.
+#define PL_FLAG_NO_OVERRIDE  bit(1) // System motion, such as homing. Never overridden.
+#define PL_FLAG_JOG          bit(2) // Jog motion. Flushed by a jog cancel.
+#define PL_FLAG_ARC          bit(3) // Arc motion. See NATIVE_ARCS.
+
       
 // Initialize and reset the motion plan subsystem
 void plan_reset();
@@ -60,10 +86,21 @@ void plan_reset();
 // rate is taken to mean "frequency" and would complete the operation in 1/feed_rate minutes.
 void plan_buffer_line(float *target, float feed_rate, uint8_t invert_feed_rate, linenumber_t line_number);
 
+#ifdef NATIVE_ARCS
+// Add a new arc movement to the buffer, turning by angular_travel about the center at offset[N_AXIS]
+// from the planner position, in the plane of axis_0 and axis_1. Positive angles are counter-clockwise.
+// Otherwise the same as plan_buffer_line().
+void plan_buffer_arc(float *target, float feed_rate, uint8_t invert_feed_rate, linenumber_t line_number,
+                     float *offset, float angular_travel, uint8_t axis_0, uint8_t axis_1);
+#endif
+
 // Called when the current block is no longer needed. Discards the block and makes the memory
 // availible for new blocks.
 void plan_discard_current_block();
 
+// Discards the jog blocks at the tail of the buffer after a jog cancel.
+void plan_flush_jog_blocks();
+
 // Gets the current block. Returns NULL if buffer empty
 plan_block_t *plan_get_current_block();
 
@@ -83,9 +120,26 @@ void plan_sync_position();
 // Reinitialize plan with a partially completed block
 void plan_cycle_reinitialize();
 
+// Recomputes the nominal and maximum entry speeds of all buffered blocks after an override change.
+// Must be followed by plan_cycle_reinitialize() to re-plan the buffer.
+void plan_update_velocity_profile_parameters();
+
+// Returns the path length from the start of its block to the next merged line end, in (mm). One
+// mark is kept for each of the merge_count line ends of each block, in order.
+float plan_get_merge_mark();
+
+// Called by the stepper once the next merged line end has been passed.
+void plan_discard_merge_mark();
+
 // Returns the status of the block ring buffer. True, if buffer is full.
 uint8_t plan_check_full_buffer();
 
+// Returns the number of blocks in the planner, executing or not.
+uint16_t plan_block_count();
+
+// Returns the number of blocks that can still be planned before plan_check_full_buffer().
+uint16_t plan_get_block_buffer_available();
+
 //returns last planned pos for `axis` in mm
 float plan_get_position(uint8_t axis);
 
@@ -28,6 +28,8 @@
 #include "gcode.h"
 #include "report.h"
 #include "motion_control.h"
+#include "magazine.h"
+#include "sram.h"
 
 #define PROBE_LINE_NUMBER (LINENUMBER_SPECIAL)
 struct probe_state probe;
@@ -65,6 +67,34 @@ static struct {
   }
 };
 
+#ifdef PROBE_SCAN_RING
+  struct scan_edge {
+    int32_t position[N_AXIS];
+    uint8_t state;
+  };
+
+  // Edges are latched into the ring by the sensor interrupts and drained into the SPI SRAM by
+  // the main program, which owns the SPI bus. The scan store sits between the planner spill ring
+  // and the serial write spill.
+  #ifdef PLANNER_SPILL_SIZE
+    #define PROBE_SCAN_ADDRESS ((uint16_t)PLANNER_SPILL_SIZE*sizeof(plan_block_t))
+  #else
+    #define PROBE_SCAN_ADDRESS 0
+  #endif
+  #define PROBE_SCAN_SRAM_EDGES ((TX_SPILL_ADDRESS-PROBE_SCAN_ADDRESS)/sizeof(struct scan_edge))
+  _Static_assert(PROBE_SCAN_SRAM_EDGES > 0, "No SPI SRAM left for the scan store");
+
+  static struct {
+    struct scan_edge ring[PROBE_SCAN_RING];
+    volatile uint8_t head;   // Written by the sensor interrupts
+    uint8_t tail;
+    uint8_t state;           // Sensor state after the last recorded edge
+    uint8_t use_sram;
+    uint16_t count;          // Edges stored in the SPI SRAM
+    volatile uint16_t dropped;
+  } scan;
+#endif
+
 void set_active_probe(enum e_sensor sensor)
 {
   probe.active_sensor = sensor;
@@ -84,24 +114,34 @@ void probe_init()
   probe.active_sensor = E_SENSOR_TYPES;
   probe.probe_reached = 0;
   probe.isprobing = 0;
+  probe.isscanning = 0;
 
 }
 
 void probe_check()
 {
+  #ifdef PROBE_SCAN_RING
+    if (probe.isscanning) {
+      // Other pins of the sensor port share the interrupt. Only record real edges.
+      uint8_t state = probe_get_active_sensor_state();
+      if (state == scan.state) { return; }
+      scan.state = state;
+      uint8_t next = (scan.head+1) & (PROBE_SCAN_RING-1);
+      if (next == scan.tail) {
+        scan.dropped++;
+        return;
+      }
+      st_get_position(scan.ring[scan.head].position);
+      scan.ring[scan.head].state = state;
+      scan.head = next;
+      return;
+    }
+  #endif
+
   if (probe_get_active_sensor_state()) {
-    // Stop looking for probe
+    // Stop looking for probe, and keep the exact position where it was found
     probe.isprobing = 0;
-
-    // TODO: Report the position where the probe was found
-    // using report_probe_parameters(). This should possibly be
-    // reported in in probe_loop or probe_move_to_sensor instead of here.
-  }
-
-  // Check for ESTOP
-  if (ESTOP_PIN & ESTOP_MASK) {
-    sys.alarm |= ALARM_ESTOP;
-    SYS_EXEC |= (EXEC_FEED_HOLD | EXEC_ALARM | EXEC_CRIT_EVENT);
+    st_get_position(sys.probe_position);
   }
 }
 
@@ -111,12 +151,19 @@ bool probe_loop()
   st_prep_buffer();
   st_wake_up();
 
+  // Sensors are only checked on edges. Check once in case the probe is already tripped.
+  uint8_t sreg = SREG;
+  cli();
+  probe_check();
+  probe_carousel_monitor();
+  SREG = sreg;
+
   SYS_EXEC |= EXEC_CYCLE_START;
 
   // Stay in this loop until alarm or until
   // the probe is found. probe_check() is called
-  // from the stepper ISR to check if the active
-  // probe is found.
+  // from the sensor edge interrupts to check if the
+  // active probe is found.
   while (probe.isprobing) {
     // Check for user reset and allow
     // protocol_execute_runtime to run in this loop 
@@ -167,14 +214,26 @@ void probe_move_to_sensor(float * target, float feed_rate, uint8_t invert_feed_r
   if (sys.abort)
     return;
 
+#ifdef MAGAZINE_MAP_SIZE
+  // Rapid up to the learned magazine edge. The probe watches both moves, and decelerates either
+  // to a stop, so a magazine found early doesn't stop the carousel dead at rapid speed. With no
+  // magazine there, the moves run out to the target.
+  float approach[N_AXIS];
+  if (sensor == MAG_SENSOR && magazine_map_approach(target, approach)) {
+    mc_line(approach, -1.0, false, LINENUMBER_EMPTY_BLOCK);
+  }
+#endif
+
   // Move in a line to the target
   mc_line(target, feed_rate, invert_feed_rate, line_number);
 
   // TODO: If the probe is already activated, we should look in
   // the oppostie direction that is specified.
 
-  if (sensor == MAG_SENSOR)
+  if (sensor == MAG_SENSOR) {
+    sysflags.carousel_stop = false;
     probe.carousel_probe_state = PROBE_ACTIVE;
+  }
 
   // Tell the system we are probing
   probe.isprobing = 1;
@@ -183,20 +242,27 @@ void probe_move_to_sensor(float * target, float feed_rate, uint8_t invert_feed_r
  
   uint8_t probe_fail;
   probe_fail = !probe_loop();
- 
-  if (!probe_fail)
-    memcpy(sys.probe_position, sys.position, sizeof(float) * N_AXIS);
 
   if (sensor == MAG_SENSOR) {
     probe_fail = (probe.carousel_probe_state == PROBE_ACTIVE);
     if (probe_fail)
-      memcpy(sys.probe_position, sys.position, sizeof(float) * N_AXIS);
+      st_get_position(sys.probe_position);
   }
 
   protocol_execute_runtime();
 
   if (sys.abort)
     return;
+
+  // The carousel probe trips into a hold, which may catch the approach at rapid speed.
+  // Let it bring the carousel to rest before the rest of the motion is dropped.
+  if (sensor == MAG_SENSOR) {
+    while ((sys.state == STATE_HOLD) || st_is_running()) {
+      protocol_execute_runtime();
+      if (sys.abort)
+        return;
+    }
+  }
   
   // Prep the new target based on the positon that the probe triggered
   uint8_t idx;
@@ -232,6 +298,97 @@ void probe_move_to_sensor(float * target, float feed_rate, uint8_t invert_feed_r
   
 }
 
+#ifdef PROBE_SCAN_RING
+// Moves the edges latched by the sensor interrupts into the SPI SRAM. Without SPI, the edges stay
+// in the ring, which then holds the whole scan. Once the SRAM is full, the ring fills up and the
+// sensor interrupts count the edges that no longer fit.
+static void probe_scan_drain()
+{
+  if (!scan.use_sram) { return; }
+  while ((scan.tail != scan.head) && (scan.count < PROBE_SCAN_SRAM_EDGES)) {
+    sram_write(PROBE_SCAN_ADDRESS + scan.count*sizeof(struct scan_edge), &scan.ring[scan.tail],
+               sizeof(struct scan_edge));
+    scan.count++;
+    scan.tail = (scan.tail+1) & (PROBE_SCAN_RING-1);
+  }
+}
+
+void probe_scan_sensor(float * target, float feed_rate, uint8_t invert_feed_rate,
+  linenumber_t line_number, enum e_sensor sensor)
+{
+  probe.active_sensor = sensor;
+
+  if (sys.state != STATE_CYCLE)
+    protocol_auto_cycle_start();
+
+  // Finish all queued commands
+  protocol_buffer_synchronize();
+
+  if (sys.abort)
+    return;
+
+  mc_line(target, feed_rate, invert_feed_rate, line_number);
+
+  // Start recording from the current sensor state, so only changes are edges
+  scan.head = 0;
+  scan.tail = 0;
+  scan.count = 0;
+  scan.dropped = 0;
+  scan.use_sram = settings.use_spi;
+  uint8_t sreg = SREG;
+  cli();
+  scan.state = probe_get_active_sensor_state();
+  probe.isscanning = 1;
+  probe.isprobing = 1;
+  SREG = sreg;
+
+  sys.state = STATE_PROBING;
+  st_prep_buffer();
+  st_wake_up();
+
+  // Run through to the target. Like the other probes, a scan doesn't take feed holds.
+  while (plan_get_current_block() || (sys.state & (STATE_CYCLE | STATE_PROBING))) {
+    probe_scan_drain();
+    protocol_execute_runtime();
+    if (sys.abort) {
+      probe.isscanning = 0;
+      probe.isprobing = 0;
+      return;
+    }
+  }
+
+  sreg = SREG;
+  cli();
+  probe.isscanning = 0;
+  probe.isprobing = 0;
+  SREG = sreg;
+  probe_scan_drain();
+
+  gc_sync_position();
+  sys.state = STATE_IDLE;
+  st_go_idle();
+
+  // Stream the scan back in one batch. The probe position is the first edge.
+  request_eol_report();
+  protocol_execute_runtime();
+  struct scan_edge edge;
+  uint16_t idx;
+  uint16_t count = scan.use_sram ? scan.count : scan.head;
+  for (idx = 0; idx < count; idx++) {
+    if (scan.use_sram) {
+      sram_read(PROBE_SCAN_ADDRESS + idx*sizeof(struct scan_edge), &edge, sizeof(struct scan_edge));
+    } else {
+      edge = scan.ring[idx];
+    }
+    if (idx == 0) { memcpy(sys.probe_position, edge.position, sizeof(edge.position)); }
+    report_scan_edge(edge.state, edge.position);
+  }
+
+  // A scan that missed edges is incomplete
+  report_probe_parameters(!count || scan.dropped || (scan.use_sram && (scan.tail != scan.head)));
+}
+#endif
+
 // This function monitors the carousel magazine alignment probe
 // which is used to move to a specified magazine.
 void probe_carousel_monitor()
@@ -239,14 +396,8 @@ void probe_carousel_monitor()
   uint8_t probe_on = probe_get_carousel_state();
   if (probe.carousel_probe_state == PROBE_ACTIVE && probe_on) {
     probe.carousel_probe_state = PROBE_OFF;
-    memcpy(sys.probe_position, sys.position, sizeof(float) * N_AXIS);
-    SYS_EXEC |= EXEC_FEED_HOLD;
+    st_get_position(sys.probe_position);
+    sysflags.carousel_stop = true;
   }
-
-  if (ESTOP_PIN & ESTOP_MASK) {
-    sys.alarm |= ALARM_ESTOP;
-    SYS_EXEC |= (EXEC_FEED_HOLD | EXEC_ALARM | EXEC_CRIT_EVENT);
-  }
-
 }
 
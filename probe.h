@@ -39,6 +39,7 @@ struct probe_state {
   enum e_sensor active_sensor;  // The currently active probe seonsor
   volatile uint8_t probe_reached;  // Flag to indicate if active probe is reached
   uint8_t isprobing;
+  uint8_t isscanning;  // Edges are recorded instead of ending the probe
   volatile uint8_t carousel_probe_state;
 };
 
@@ -51,10 +52,18 @@ void probe_init();
 void probe_move_to_sensor(float * target, float feed_rate, uint8_t invert_feed_rate,
   linenumber_t line_number, enum e_sensor sensor);
 
+#ifdef PROBE_SCAN_RING
+// Moves through to the target and records every edge of the sensor along the way. The edges are
+// reported when the move completes, followed by the probe report of the first one.
+void probe_scan_sensor(float * target, float feed_rate, uint8_t invert_feed_rate,
+  linenumber_t line_number, enum e_sensor sensor);
+#endif
+
 // Used to set active probe to look for
 void set_active_probe(enum e_sensor sensor);
 
-// Called from stepper ISR - needs to be very efficient
+// Called from the sensor edge interrupts - needs to be very efficient. Latches the position if
+// the active probe is reached. Must be called with interrupts disabled.
 void probe_check();
 
 // Returns active probe state
@@ -69,6 +78,6 @@ void probe_check();
 // when detected. Called by the stepper ISR each ISR tick.
 void probe_state_monitor();
 
-// Monitors CAROUSEL probe pin state
+// Monitors CAROUSEL probe pin state. Called on alignment sensor edges.
 void probe_carousel_monitor();
 #endif
@@ -30,7 +30,7 @@
 #include "motor_driver.h"
 #include "report.h"
 #include "systick.h"
-#include "magazine.h"
+#include "frame.h"
 
 #define STATUS_REPORT_RATE_MS 333  //3 Hz
 
@@ -39,7 +39,7 @@ static char line[LINE_BUFFER_SIZE]; // Line to be executed. Zero-terminated.
 // Directs and executes one line of formatted input from protocol_process. While mostly
 // incoming streaming g-code blocks, this also directs and executes Grbl internal commands,
 // such as settings, initiating the homing cycle, and toggling switch states.
-static uint8_t protocol_execute_line(char *line)
+uint8_t protocol_dispatch_line(char *line)
 {
   protocol_execute_runtime(); // Runtime command check point.
 
@@ -66,6 +66,12 @@ static uint8_t protocol_execute_line(char *line)
   } else {
     status = gc_execute_line(line);
   }
+  return status;
+}
+
+static uint8_t protocol_execute_line(char *line)
+{
+  uint8_t status = protocol_dispatch_line(line);
 
   /* If there was an error, report it */
   if (status != STATUS_IDLE_WAIT) {
@@ -88,8 +94,7 @@ void protocol_main_loop()
   report_init_message();
 
   /* Request Grbl status upon startup */
-  SYS_EXEC |= EXEC_RUNTIME_REPORT;
-  sysflags.report_rqsts |= REQUEST_STATUS_REPORT;
+  request_report(REQUEST_STATUS_REPORT,0);
 
 
   // Check for and report alarm state after a reset, error, or an initial power up.
@@ -112,6 +117,13 @@ void protocol_main_loop()
     // initial filtering by removing spaces and comments and capitalizing all letters.
 
     while((c = serial_read()) != SERIAL_NO_DATA) {
+      #ifdef BINARY_FRAMING
+        if (frame_mode) {
+          frame_receive(c);
+          if (sys.abort) { return; }
+          continue;
+        }
+      #endif
       if ((c == '\n') || (c == '\r')) { // End of line reached
         line[char_counter] = 0; // Set string termination character.
 
@@ -155,6 +167,9 @@ void protocol_main_loop()
     // If there are no more characters in the serial read buffer to be processed and executed,
     // this indicates that g-code streaming has either filled the planner buffer or has
     // completed. In either case, auto-cycle start, if enabled, any queued moves.
+    #ifdef BINARY_FRAMING
+      frame_flush_ack(); // Acknowledge the frames executed so far in one go.
+    #endif
     protocol_auto_cycle_start();
 
     protocol_execute_runtime();  // Runtime command check point.
@@ -169,8 +184,7 @@ static void protocol_check_required_reports()
   /* Report state changes */
   if (sys.state != sys.old_state) {
     sys.old_state = sys.state;
-    SYS_EXEC |= EXEC_RUNTIME_REPORT;
-    sysflags.report_rqsts |= REQUEST_STATUS_REPORT;
+    request_report(REQUEST_STATUS_REPORT,0);
   }
 
   /* Update limit state and report if changed */
@@ -178,15 +192,13 @@ static void protocol_check_required_reports()
                                                 pin, but  short for PORT IN */
   if (sys.limit_state != sys.old_limit_state) {
     sys.old_limit_state = sys.limit_state;
-    SYS_EXEC |= EXEC_RUNTIME_REPORT;
-    sysflags.report_rqsts |= REQUEST_LIMIT_REPORT;
+    request_report(REQUEST_LIMIT_REPORT,0);
   }
 
   /* Check if the ESTOP status changed */
   if ((ESTOP_PIN & ESTOP_MASK) != sys.last_estop_state) {
     sys.last_estop_state = (ESTOP_PIN & ESTOP_MASK);
-    SYS_EXEC |= EXEC_RUNTIME_REPORT;
-    sysflags.report_rqsts |= REQUEST_LIMIT_REPORT;
+    request_report(REQUEST_LIMIT_REPORT,0);
   }
 }
 
@@ -198,6 +210,17 @@ static void maybe_reinit_motors(void)
   }
 }
 
+// Decelerates the executing motion to a hold. The planned motion stays, to resume or discard.
+static void protocol_feed_hold()
+{
+  if (sys.state != STATE_JOG) { sys.flags &=~ SYSFLAG_AUTOSTART; } // Disable planner auto start upon feed hold.
+  ST_PREP_LOCK();
+  sys.state = STATE_HOLD;
+  st_update_plan_block_parameters();
+  ST_PREP_UNLOCK();
+  st_prep_buffer();
+}
+
 // Executes run-time commands, when required. This is called from various check points in the main
 // program, primarily where there may be a while loop waiting for a buffer to clear space or any
 // point where the execution time from the last check point may be more than a fraction of a second.
@@ -211,8 +234,24 @@ static void maybe_reinit_motors(void)
 // limit switches, or the main program.
 void protocol_execute_runtime()
 {
+  // A jog cancel is a feed hold that also discards the remaining jog blocks once stopped. It is
+  // ignored unless jogging, so a late cancel never holds a regular cycle.
+  if (sysflags.jog_cancel) {
+    sysflags.jog_cancel = false;
+    if (sys.state == STATE_JOG) { SYS_EXEC |= EXEC_FEED_HOLD; }
+  }
+
+  // The carousel probe decelerates to a stop when it trips. It has its own request, so a feed
+  // hold from the host leaves other probes running, and an ordinary probe never ends in a hold.
+  if (sysflags.carousel_stop) {
+    sysflags.carousel_stop = false;
+    if (sys.state == STATE_PROBING) { protocol_feed_hold(); }
+  }
+
   uint8_t rt_exec = SYS_EXEC; // Copy to avoid calling volatile multiple times
 
+  serial_tx_refill(); // Feed spilled report output to the serial write buffer
+
   // Service SysTick Callbacks
   systick_service_callbacks();
 
@@ -269,54 +308,37 @@ void protocol_execute_runtime()
       return; // Nothing else to do but exit.
     }
 
-    // Execute and serial print status
-    if (rt_exec & EXEC_RUNTIME_REPORT) {
-      uint8_t reports=sysflags.report_rqsts;
-      sysflags.report_rqsts=0;   //TODO: potential race here if isr requests another right after we read it.
-
-      if (reports & REQUEST_STATUS_REPORT) {
-        if (!report_realtime_status()){ //ensure no more lines to report
-          reports &= ~REQUEST_STATUS_REPORT;
-        }
-      }
-      //elsif forces 1 report per loop max
-      else if (reports & REQUEST_LIMIT_REPORT) {
-        report_limit_pins();
-        reports &= ~REQUEST_LIMIT_REPORT;
-      }
-      else if (reports & REQUEST_COUNTER_REPORT) {
-        report_counters();
-        reports &= ~REQUEST_COUNTER_REPORT;
-      }
-      else if (reports & REQUEST_VOLTAGE_REPORT) {
-        report_voltage();
-        reports &= ~REQUEST_VOLTAGE_REPORT;
-      }
-      else if (reports & REQUEST_EDGE_REPORT) {
-        magazine_report_edge_events();
-        reports &= ~REQUEST_EDGE_REPORT;
-      }
-      if (0==(sysflags.report_rqsts|=reports)) { //if all reports done and no new requests, clear report flag
-        bit_false(SYS_EXEC,EXEC_RUNTIME_REPORT);
-      }
+    // Execute and serial print status. Reports wait for room in the write buffer, so repeated
+    // requests fold into one report instead of stalling on the serial link.
+    if ((rt_exec & EXEC_RUNTIME_REPORT) && (serial_get_tx_buffer_available() >= REPORT_TX_ROOM)) {
+      // Claim every pending request at once. Requests landing after the claim stay set for the
+      // next pass, and status reports with completed lines left to report request themselves again.
+      uint8_t sreg = SREG;
+      cli();
+      uint8_t reports = sysflags.report_rqsts;
+      sysflags.report_rqsts = 0;
+      bit_false(SYS_EXEC,EXEC_RUNTIME_REPORT);
+      SREG = sreg;
+
+      reports = report_runtime(reports);
+      if (reports) { request_report(reports,0); }
     }
 
-    // Execute a feed hold with deceleration, only during cycle.
+    // Execute a feed hold with deceleration, only during cycle or jog. A held jog is cancelled.
     if (rt_exec & EXEC_FEED_HOLD) {
       // !!! During a cycle, the segment buffer has just been reloaded and full. So the math involved
       // with the feed hold should be fine for most, if not all, operational scenarios.
-      if (sys.state == STATE_CYCLE) {
-        sys.state = STATE_HOLD;
-        st_update_plan_block_parameters();
-        st_prep_buffer();
-        sys.flags &=~ SYSFLAG_AUTOSTART; // Disable planner auto start upon feed hold.
+      if (sys.state & (STATE_CYCLE | STATE_JOG)) {
+        if (sys.state == STATE_JOG) { sys.flags |= SYSFLAG_JOG_CANCEL; }
+        protocol_feed_hold();
       }
       bit_false(SYS_EXEC,EXEC_FEED_HOLD);
     }
 
     // Execute a cycle start by starting the stepper interrupt begin executing the blocks in queue.
-    // block Start while homing/force-servoing.
-    if ((rt_exec & EXEC_CYCLE_START) && !(sys.state & (STATE_HOMING | STATE_FORCESERVO | STATE_PROBING))) {
+    // block Start while homing/force-servoing, or while a cancelled jog comes to a stop.
+    if ((rt_exec & EXEC_CYCLE_START) && !(sys.state & (STATE_HOMING | STATE_FORCESERVO | STATE_PROBING)) &&
+        !(sys.flags & SYSFLAG_JOG_CANCEL)) {
       if (sys.state == STATE_QUEUED) {
         sys.state = STATE_CYCLE;
         st_prep_buffer(); // Initialize step segment buffer before beginning cycle.
@@ -335,18 +357,49 @@ void protocol_execute_runtime()
     // cycle reinitializations. The stepper path should continue exactly as if nothing has happened.
     // NOTE: EXEC_CYCLE_STOP is set by the stepper subsystem when a cycle or feed hold completes.
     if (rt_exec & EXEC_CYCLE_STOP) {
-      if ( plan_get_current_block() ) { sys.state = STATE_QUEUED; }
+      if (sys.flags & SYSFLAG_JOG_CANCEL) {
+        // Jog cancel complete. Drop the rest of the jog and resync to where the machine stopped.
+        sys.flags &= ~SYSFLAG_JOG_CANCEL;
+        ST_PREP_LOCK();
+        plan_flush_jog_blocks();
+        st_reset();
+        ST_PREP_UNLOCK();
+        plan_sync_position();
+        gc_sync_position();
+        sys.state = STATE_IDLE;
+      } else if (sys.state == STATE_JOG) {
+        // The steppers ran dry between streamed jogs. Jogs never wait for a cycle start.
+        if ( plan_get_current_block() ) {
+          st_prep_buffer();
+          st_wake_up();
+        } else { sys.state = STATE_IDLE; }
+      }
+      else if ( plan_get_current_block() ) { sys.state = STATE_QUEUED; }
       else { sys.state = STATE_IDLE; }
       bit_false(SYS_EXEC,EXEC_CYCLE_STOP);
     }
 
   }
 
-  // Overrides flag byte (sys.override) and execution should be installed here, since they
-  // are runtime and require a direct and controlled interface to the main stepper program.
+  // Apply feed and rapid overrides requested over serial. The buffered blocks are re-planned with
+  // their new nominal speeds and the executing block picks up its new profile on the fly, so no
+  // feed hold is needed.
+  if (rt_exec & EXEC_MOTION_OVERRIDE) {
+    bit_false(SYS_EXEC,EXEC_MOTION_OVERRIDE);
+    uint8_t f_override = sysflags.f_override;
+    uint8_t r_override = sysflags.r_override;
+    if ((f_override != sys.f_override) || (r_override != sys.r_override)) {
+      sys.f_override = f_override;
+      sys.r_override = r_override;
+      ST_PREP_LOCK();
+      plan_update_velocity_profile_parameters();
+      plan_cycle_reinitialize();
+      ST_PREP_UNLOCK();
+    }
+  }
 
   // Reload step segment buffer
-  if (sys.state & (STATE_CYCLE | STATE_HOLD | STATE_HOMING | STATE_FORCESERVO | STATE_PROBING)) 
+  if (sys.state & (STATE_CYCLE | STATE_HOLD | STATE_HOMING | STATE_FORCESERVO | STATE_PROBING | STATE_JOG)) 
     st_prep_buffer(); 
   
   // Clear IO Reset bit.
@@ -361,7 +414,7 @@ void protocol_buffer_synchronize()
 {
   // Check and set auto start to resume cycle after synchronize and caller completes.
   if (sys.state == STATE_CYCLE) { sys.flags |= SYSFLAG_AUTOSTART; }
-  while (plan_get_current_block() || (sys.state == STATE_CYCLE)) {
+  while (plan_get_current_block() || (sys.state & (STATE_CYCLE | STATE_JOG))) {
     protocol_execute_runtime();   // Check and execute run-time commands
     if (sys.abort) { return; } // Check for system abort
   }
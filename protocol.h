@@ -35,6 +35,10 @@
 // them as they complete. It is also responsible for finishing the initialization procedures.
 void protocol_main_loop();
 
+// Executes one line, a g-code block or a $ system command, and returns its status without
+// reporting it.
+uint8_t protocol_dispatch_line(char *line);
+
 // Checks and executes a runtime command at various stop points in main program
 void protocol_execute_runtime();
 
@@ -38,6 +38,9 @@
 #include "probe.h"
 #include "magazine.h"
 #include "signals.h"
+#include "isr_timing.h"
+#include "serial.h"
+#include "systick.h"
 
 // Handles the primary confirmation protocol response for streaming interfaces and human-feedback.
 // For every incoming line, this method responds with an 'ok' for a successful command or an
@@ -47,10 +50,25 @@
 // responses.
 // NOTE: In silent mode, all error codes are greater than zero.
 // TODO: Install silent mode to return only numeric values, primarily for GUIs.
+// Prints the free planner blocks and serial read buffer bytes, so a host can keep both full
+// without waiting on each line.
+static void report_buffer_state()
+{
+  printInteger(plan_get_block_buffer_available());
+  printPgmString(PSTR(","));
+  print_uint8_base10(serial_get_rx_buffer_available());
+}
+
 void report_status_message(uint8_t status_code)
 {
   if (status_code == 0) { // STATUS_OK
-    printPgmString(PSTR("ok\r\n"));
+    if (bit_istrue(settings.flags,BITFLAG_REPORT_BUFFERS)) {
+      printPgmString(PSTR("ok:"));
+      report_buffer_state();
+      printPgmString(PSTR("\r\n"));
+    } else {
+      printPgmString(PSTR("ok\r\n"));
+    }
   } else if (status_code & STATUS_QUIET_OK) {
     // protocol can return a 'QUIET_OK' status meaning don't print OK, print something else instead
     if (0!= (status_code&=~STATUS_QUIET_OK)) {
@@ -82,6 +100,10 @@ void report_status_message(uint8_t status_code)
       printPgmString(PSTR("Homing not enabled")); break;
       case STATUS_OVERFLOW:
       printPgmString(PSTR("Line overflow")); break;
+      case STATUS_INVALID_JOG_COMMAND:
+      printPgmString(PSTR("Invalid jog command")); break;
+      case STATUS_TRAVEL_EXCEEDED:
+      printPgmString(PSTR("Travel exceeded")); break;
 
       // Common g-code parser errors.
       case STATUS_GCODE_MODAL_GROUP_VIOLATION:
@@ -173,11 +195,23 @@ void report_grbl_help() {
                       "$X (kill alarm lock)\r\n"
                       "$H<x=single axis> (run homing cycle)\r\n"
                       "$E<x=clear axis> (report encoders)\r\n"
+                      "$T (report and clear ISR timing)\r\n"
+#ifdef BINARY_FRAMING
+                      "$K (binary framed protocol)\r\n"
+#endif
+#ifdef MAGAZINE_MAP_SIZE
+                      "$M (view magazine map)\r\n"
+                      "$MC (learn magazine map)\r\n"
+#endif
+                      "$J=line (jog, G20/G21/G90/G91/G53 and F required)\r\n"
                       "$Hx=axis (run homing cycle)\r\n"
                       "~ (cycle start)\r\n"
                       "! (feed hold)\r\n"
                       "? (current status)\r\n"
                       "^ (limit pins)\r\n"
+                      "0x85 (jog cancel)\r\n"
+                      "0x90-0x94 (feed override reset,+10%,-10%,+1%,-1%)\r\n"
+                      "0x95-0x97 (rapid override 100%,50%,25%)\r\n"
                       "ctrl-x (reset Grbl)\r\n"));
 }
 
@@ -252,10 +286,28 @@ void report_grbl_settings() {
   printPgmString(PSTR(" (z microsteps, bool)"));
   printPgmString(PSTR("\r\n$49=")); print_uint8_base10(settings.c_microsteps);
   printPgmString(PSTR(" (c microsteps, bool)"));
+  printPgmString(PSTR("\r\n$50=")); printFloat_SettingValue(settings.jerk[X_AXIS]/(60*60*60)); // Convert from mm/min^3 for human readability
+  printPgmString(PSTR(" (x jerk, mm/sec^3)\r\n$51=")); printFloat_SettingValue(settings.jerk[Y_AXIS]/(60*60*60));
+  printPgmString(PSTR(" (y jerk, mm/sec^3)\r\n$52=")); printFloat_SettingValue(settings.jerk[Z_AXIS]/(60*60*60));
+  printPgmString(PSTR(" (z jerk, mm/sec^3)\r\n$53=")); printFloat_SettingValue(settings.jerk[C_AXIS]/(60*60*60));
+  printPgmString(PSTR(" (c jerk, mm/sec^3)\r\n$54=")); printFloat_SettingValue(settings.merge_tolerance);
+  printPgmString(PSTR(" (merge tolerance, mm)\r\n$55=")); printFloat_SettingValue(settings.homing_edge_offset[X_AXIS]);
+  printPgmString(PSTR(" (x homing edge offset, mm)\r\n$56=")); printFloat_SettingValue(settings.homing_edge_offset[Y_AXIS]);
+  printPgmString(PSTR(" (y homing edge offset, mm)\r\n$57=")); printFloat_SettingValue(settings.homing_edge_offset[Z_AXIS]);
+  printPgmString(PSTR(" (z homing edge offset, mm)\r\n$58=")); printFloat_SettingValue(settings.homing_edge_offset[C_AXIS]);
+  printPgmString(PSTR(" (c homing edge offset, mm)\r\n$59=")); printFloat_SettingValue(settings.force_servo_kp);
+  printPgmString(PSTR(" (force servo p, mm/min/count)\r\n$60=")); printFloat_SettingValue(settings.force_servo_ki);
+  printPgmString(PSTR(" (force servo i, mm/min/count*sec)\r\n$61=")); printFloat_SettingValue(settings.force_servo_kd);
+  printPgmString(PSTR(" (force servo d, mm/min/count/sec)\r\n$62=")); print_uint8_base10(settings.force_servo_band);
+  printPgmString(PSTR(" (force servo settle band, count)\r\n$63=")); print_uint8_base10(bit_istrue(settings.flags,BITFLAG_REPORT_BUFFERS));
+  printPgmString(PSTR(" (report buffers, bool)\r\n$64=")); printInteger(settings.status_report_interval);
+  printPgmString(PSTR(" (status report interval, msec)\r\n$65=")); print_uint8_base10(settings.status_report_mask);
+  printPgmString(PSTR(" (status report mask:")); print_uint8_base2(settings.status_report_mask);
+  printPgmString(PSTR(")"));
   /* Because of the way Grbl eeprom settings are parsed in Motion, the index
   of (end_of_settings) needs to directly follow the last index of the eeprom
   settings. */
-  printPgmString(PSTR("\r\n$50=1"));
+  printPgmString(PSTR("\r\n$66=1"));
   printPgmString(PSTR(" (end_of_settings)"));
   /* End KEYME Specific */
   printPgmString(PSTR("\r\n"));
@@ -422,6 +474,64 @@ void report_voltage()
   printPgmString(PSTR("\r\n"));
 }
 
+// Prints and clears the ISR timing histograms, one line per interrupt. Times are in usec.
+// [ISR <name> N:<count> MIN:<min> MAX:<max> P99:<p99> H:<bucket counts>]
+// P99 is the upper bound of the bucket holding the 99th percentile, capped at MAX.
+void report_isr_timing()
+{
+  isr_timing_t timing;
+  uint8_t id, idx;
+  for (id = 0; id < N_ISR_TIMING; id++) {
+    isr_timing_read(id, &timing);
+
+    printPgmString(PSTR("[ISR "));
+    switch (id) {
+      case ISR_TIMING_STEP: printPgmString(PSTR("STEP")); break;
+      case ISR_TIMING_SERIAL_RX: printPgmString(PSTR("RX")); break;
+      case ISR_TIMING_SERIAL_UDRE: printPgmString(PSTR("UDRE")); break;
+      case ISR_TIMING_ADC: printPgmString(PSTR("ADC")); break;
+      case ISR_TIMING_FDBK: printPgmString(PSTR("FDBK")); break;
+    }
+    printPgmString(PSTR(" N:"));
+    print_uint32_base10(timing.count);
+    if (timing.count == 0) {
+      printPgmString(PSTR("]\r\n"));
+      continue;
+    }
+
+    // Find the 99th percentile and the last used bucket
+    uint32_t total = 0;
+    uint8_t last = 0;
+    for (idx = 0; idx < ISR_TIMING_BUCKETS; idx++) {
+      total += timing.bucket[idx];
+      if (timing.bucket[idx]) { last = idx; }
+    }
+    uint32_t rank = total - total/100;
+    uint32_t seen = 0;
+    uint16_t p99 = timing.max;
+    for (idx = 0; idx < ISR_TIMING_BUCKETS; idx++) {
+      seen += timing.bucket[idx];
+      if (seen >= rank) {
+        p99 = min(isr_timing_bucket_limit(idx), timing.max);
+        break;
+      }
+    }
+
+    printPgmString(PSTR(" MIN:"));
+    printFloat((float)timing.min/ISR_TIMING_TICKS_PER_USEC, 1);
+    printPgmString(PSTR(" MAX:"));
+    printFloat((float)timing.max/ISR_TIMING_TICKS_PER_USEC, 1);
+    printPgmString(PSTR(" P99:"));
+    printFloat((float)p99/ISR_TIMING_TICKS_PER_USEC, 1);
+    printPgmString(PSTR(" H:"));
+    for (idx = 0; idx <= last; idx++) {
+      if (idx) { printPgmString(PSTR(",")); }
+      print_uint32_base10(timing.bucket[idx]);
+    }
+    printPgmString(PSTR("]\r\n"));
+  }
+}
+
 void report_sensor_edge(uint8_t sensor, bool state, int32_t axis_position)
 {
   printPgmString(PSTR("%"));
@@ -433,21 +543,71 @@ void report_sensor_edge(uint8_t sensor, bool state, int32_t axis_position)
   printPgmString(PSTR("%\r\n"));
 }
 
-// Prints real-time data. This function grabs a real-time snapshot of the stepper subprogram
-// and the actual location of the CNC machine. Users may change the following function to their
-// specific needs, but the desired real-time data report must be as short as possible. This is
-// requires as it minimizes the computational overhead and allows grbl to keep running smoothly,
-// especially during g-code programs with fast, short line segments and high frequency reports (5-20Hz).
-uint8_t report_realtime_status()
+void report_scan_edge(uint8_t state, int32_t *position)
+{
+  uint8_t i;
+  printPgmString(PSTR("[SCN:"));
+  print_uint8_base10(state);
+  for (i=0; i< N_AXIS; i++) {
+    printPgmString(PSTR(","));
+    printFloat_CoordValue(position[i]/settings.steps_per_mm[i]);
+  }
+  printPgmString(PSTR("]\r\n"));
+}
+
+void report_magazine_map_entry(uint8_t magazine, uint16_t on_edge, uint16_t off_edge)
+{
+  printPgmString(PSTR("[MAG:"));
+  print_uint8_base10(magazine);
+  printPgmString(PSTR(","));
+  printInteger(on_edge);
+  printPgmString(PSTR(","));
+  printInteger(off_edge);
+  printPgmString(PSTR("]\r\n"));
+}
+
+static linenumber_t report_ln; // Completed line number carried by the status report
+
+// Moves the reported line number on to the next completed line, if there is one. Lines completed
+// together, by a merged planner block, are counted by the stepper and reported one at a time.
+// Returns true if the line number moved on.
+static uint8_t report_line_number_update()
+{
+  if (!(sys.flags & SYSFLAG_EOL_REPORT) && sysflags.eol_count) {
+    uint8_t sreg = SREG;
+    cli();
+    sysflags.eol_count--;
+    SREG = sreg;
+    sys.flags |= SYSFLAG_EOL_REPORT;
+  }
+  if (sys.flags & SYSFLAG_EOL_REPORT) {
+    report_ln = linenumber_get();
+    if (report_ln & LINENUMBER_SPECIAL_SERVO){
+      // ln & ~LINENUMBER_EMPTY_BLOCK drops high bit of servoing linenumber
+      report_ln &= ~LINENUMBER_EMPTY_BLOCK | LINENUMBER_SPECIAL_SERVO;
+    }
+    else {
+      report_ln &= ~LINENUMBER_EMPTY_BLOCK;
+    }
+    if ((linenumber_peek()&LINENUMBER_EMPTY_BLOCK) == 0) {
+      sys.flags &=  ~SYSFLAG_EOL_REPORT;
+    }
+    return(true);
+  }
+  return(false);
+}
+
+// Prints the status report with the current line number. Returns true while completed lines
+// remain to be reported.
+static uint8_t report_status_fields()
 {
   // **Under construction** Bare-bones status report. Provides real-time machine position relative to
   // the system power on location (0,0,0) and work coordinate position (G54 and G92 applied). Eventually
   // to be added are distance to go on block, processed block id, and feed rate. Also a settings bitmask
   // for a user to select the desired real-time data.
   int32_t current_position[N_AXIS]; // Copy current state of the system position variable
-  static linenumber_t ln=0;
   uint8_t i;
-  memcpy(current_position,sys.position,sizeof(sys.position));
+  st_get_position(current_position);
 
   float print_position[N_AXIS];
   // Report current machine state
@@ -455,6 +615,7 @@ uint8_t report_realtime_status()
     case STATE_IDLE: printPgmString(PSTR("<Idle")); break;
     case STATE_QUEUED: printPgmString(PSTR("<Queue")); break;
     case STATE_CYCLE: printPgmString(PSTR("<Run")); break;
+    case STATE_JOG: printPgmString(PSTR("<Jog")); break;
     case STATE_HOLD: printPgmString(PSTR("<Hold")); break;
     case STATE_HOMING: printPgmString(PSTR("<Home")); break;
     case STATE_ALARM: printPgmString(PSTR("<Alarm")); break;
@@ -465,46 +626,128 @@ uint8_t report_realtime_status()
 
   // Report machine position
   printPgmString(PSTR(":"));
-  for (i=0; i< N_AXIS-1; i++) {
-    //switch to work position
+  if (settings.status_report_mask & STATUS_FIELD_POSITION) {
+    for (i=0; i< N_AXIS-1; i++) {
+      //switch to work position
+      print_position[i] = current_position[i]/settings.steps_per_mm[i];
+      print_position[i] -= gc_state.coord_system[i]+gc_state.coord_offset[i];
+      printFloat_CoordValue(print_position[i]);
+      printPgmString(PSTR(","));
+    }
     print_position[i] = current_position[i]/settings.steps_per_mm[i];
     print_position[i] -= gc_state.coord_system[i]+gc_state.coord_offset[i];
     printFloat_CoordValue(print_position[i]);
-    printPgmString(PSTR(","));
   }
-  print_position[i] = current_position[i]/settings.steps_per_mm[i];
-  print_position[i] -= gc_state.coord_system[i]+gc_state.coord_offset[i];
-  printFloat_CoordValue(print_position[i]);
 
   // Report work position
   printPgmString(PSTR(":"));
-  for (i=0;i< N_AXIS-1; i++) {
+  if (settings.status_report_mask & STATUS_FIELD_STEPS) {
+    for (i=0;i< N_AXIS-1; i++) {
+      printInteger(current_position[i]);
+      printPgmString(PSTR(","));
+    }
     printInteger(current_position[i]);
-    printPgmString(PSTR(","));
   }
-  printInteger(current_position[i]);
 
   // Report current line number
-  if (sys.flags & SYSFLAG_EOL_REPORT) {
-    ln = linenumber_get();
-    if (ln & LINENUMBER_SPECIAL_SERVO){
-      // ln & ~LINENUMBER_EMPTY_BLOCK drops high bit of servoing linenumber
-      ln &= ~LINENUMBER_EMPTY_BLOCK | LINENUMBER_SPECIAL_SERVO;
-    }
-    else {
-      ln &= ~LINENUMBER_EMPTY_BLOCK;
-    }
-    if ((linenumber_peek()&LINENUMBER_EMPTY_BLOCK) == 0) {
-      sys.flags &=  ~SYSFLAG_EOL_REPORT;
-    }
+  printPgmString(PSTR(":"));
+  printInteger(report_ln);
+
+  // Report feed and rapid overrides, only while either is active to keep the report short.
+  if ((settings.status_report_mask & STATUS_FIELD_OVERRIDES) &&
+      ((sys.f_override != DEFAULT_FEED_OVERRIDE) || (sys.r_override != DEFAULT_RAPID_OVERRIDE))) {
+    printPgmString(PSTR(":"));
+    print_uint8_base10(sys.f_override);
+    printPgmString(PSTR(","));
+    print_uint8_base10(sys.r_override);
   }
 
-  printPgmString(PSTR(":"));
-  printInteger(ln);
+  // Report free planner blocks and serial read buffer bytes, tagged as overrides come and go
+  if (bit_istrue(settings.flags,BITFLAG_REPORT_BUFFERS)) {
+    printPgmString(PSTR(":Bf"));
+    report_buffer_state();
+  }
+
+  // Report bytes of status reports dropped for newer ones on a slow serial link, only once any were
+  if (serial_tx_dropped_bytes) {
+    printPgmString(PSTR(":TxB"));
+    printInteger(serial_tx_dropped_bytes);
+  }
+
+  // Report segment buffer underruns, only once there were any
+  uint16_t underruns;
+  uint8_t sreg = SREG;
+  cli();
+  underruns = st_underrun_count;
+  SREG = sreg;
+  if (underruns) {
+    printPgmString(PSTR(":Ur"));
+    printInteger(underruns);
+  }
   printPgmString(PSTR(">\r\n"));
 
-  return (sys.flags & SYSFLAG_EOL_REPORT); //returns True if more work to do
+  return ((sys.flags & SYSFLAG_EOL_REPORT) || sysflags.eol_count); //returns True if more work to do
+
+}
+
+// Prints real-time data. This function grabs a real-time snapshot of the stepper subprogram
+// and the actual location of the CNC machine. Users may change the following function to their
+// specific needs, but the desired real-time data report must be as short as possible. This is
+// requires as it minimizes the computational overhead and allows grbl to keep running smoothly,
+// especially during g-code programs with fast, short line segments and high frequency reports (5-20Hz).
+// NOTE: The report is held back until the serial write buffer has room for it, and replaced by
+// the next one if it is still waiting then. A report with a new line number is never replaced.
+uint8_t report_realtime_status()
+{
+  uint8_t new_line = report_line_number_update();
+  serial_report_begin();
+  uint8_t more = report_status_fields();
+  serial_report_end(!new_line);
+  return(more);
+}
+
+uint8_t report_runtime(uint8_t reports)
+{
+  uint8_t pending = 0;
+
+  // Several reports go out as one composite, led by the time they were taken and the line
+  // number of the status report, so the host reads them as a single snapshot.
+  if (reports & (reports-1)) {
+    uint8_t sreg = SREG;
+    cli();
+    uint32_t now = masterclock;
+    SREG = sreg;
+    if (reports & REQUEST_STATUS_REPORT) { report_line_number_update(); }
+    printPgmString(PSTR("[RPT:"));
+    printInteger(now);
+    printPgmString(PSTR(","));
+    printInteger(report_ln);
+    printPgmString(PSTR("]\r\n"));
+    if ((reports & REQUEST_STATUS_REPORT) && report_status_fields()) { pending |= REQUEST_STATUS_REPORT; }
+  } else if (reports & REQUEST_STATUS_REPORT) {
+    if (report_realtime_status()) { pending |= REQUEST_STATUS_REPORT; }
+  }
+
+  if (reports & REQUEST_LIMIT_REPORT) { report_limit_pins(); }
+  if (reports & REQUEST_COUNTER_REPORT) { report_counters(); }
+  if (reports & REQUEST_VOLTAGE_REPORT) { report_voltage(); }
+  if (reports & REQUEST_EDGE_REPORT) { magazine_report_edge_events(); }
+  if (reports & REQUEST_ISR_TIMING_REPORT) { report_isr_timing(); }
 
+  return(pending);
+}
+
+static void report_status_stream_callback()
+{
+  request_report(REQUEST_STATUS_REPORT,0);
+}
+
+void report_status_stream_start()
+{
+  systick_cancel_callback(report_status_stream_callback);
+  if (!settings.status_report_interval) { return; }
+  systick_register_periodic_callback(settings.status_report_interval, settings.status_report_interval,
+                                     report_status_stream_callback);
 }
 
 void report_limit_pins()
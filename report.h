@@ -35,6 +35,8 @@
 #define STATUS_OVERFLOW 11
 #define STATUS_IDLE_WAIT 12
 #define STATUS_ABORT 13
+#define STATUS_INVALID_JOG_COMMAND 14
+#define STATUS_TRAVEL_EXCEEDED 15
 #define STATUS_QUIET_OK (1<<7)
 #define STATUS_ALT_REPORT(rpt) (STATUS_QUIET_OK|rpt)
 
@@ -87,15 +89,37 @@ void report_grbl_help();
 // Prints Grbl global settings
 void report_grbl_settings();
 
+// Status report fields selected by the status report mask ($65). A field left out stays empty
+// between its separators, so the fields after it keep their place.
+#define STATUS_FIELD_POSITION  bit(0) // Work position (mm)
+#define STATUS_FIELD_STEPS     bit(1) // Machine position (steps)
+#define STATUS_FIELD_OVERRIDES bit(2) // Feed and rapid overrides, while either is active
+
+#define STATUS_REPORT_MIN_INTERVAL 20 // Fastest pushed status reports (ms)
+
+// Free serial write bytes before a runtime report renders. Requests wait and coalesce meanwhile.
+#define REPORT_TX_ROOM 64
+
 // Prints realtime status report
 uint8_t report_realtime_status();
 
+// Prints the claimed runtime reports (REQUEST_ bits) in one pass. Two or more are led by
+// [RPT:<masterclock>,<line number>]. Returns the reports with more left to print.
+uint8_t report_runtime(uint8_t reports);
+
+// Pushes a status report every status report interval ($64), on top of the requested ones.
+// Called when the interval is set and after the systick callbacks are reset.
+void report_status_stream_start();
+
 // Prints state of limit pins and estop
 void report_limit_pins();
 
 // Prints state of counters
 void report_counters();
 
+// Prints and clears the ISR timing histograms
+void report_isr_timing();
+
 // Read voltage of ADCs
 
 void report_voltage();
@@ -106,6 +130,12 @@ void report_revision();
 // Reporting of sensor edges
 void report_sensor_edge(uint8_t sensor, bool state, int32_t axis_position);
 
+// Prints one edge recorded by a scan probe
+void report_scan_edge(uint8_t state, int32_t *position);
+
+// Prints one learned magazine of the carousel map
+void report_magazine_map_entry(uint8_t magazine, uint16_t on_edge, uint16_t off_edge);
+
 // Prints recorded probe position
 void report_probe_parameters(uint8_t error);
 
@@ -127,7 +157,16 @@ void report_build_info(char *line);
 // Prints current limit word
 void report_limit_pins();
 
-#define request_report(report,exec) (sysflags.report_rqsts|=(report))&&(SYS_EXEC|=(EXEC_RUNTIME_REPORT|(exec)))
+// Requests runtime reports, from interrupts or the main program. The request bits are claimed
+// all at once by protocol_execute_runtime(), so setting them has to be atomic as well.
+static inline void request_report(uint8_t report, uint8_t exec)
+{
+  uint8_t sreg = SREG;
+  cli();
+  sysflags.report_rqsts |= report;
+  SYS_EXEC |= (EXEC_RUNTIME_REPORT|exec);
+  SREG = sreg;
+}
 #define request_eol_report()  (sys.flags|=SYSFLAG_EOL_REPORT);request_report(REQUEST_STATUS_REPORT,0)
 
 #endif
@@ -0,0 +1,54 @@
+/*
+  Not part of Grbl. KeyMe specific.
+
+  Typed single-producer/single-consumer ring buffers.
+
+  RING_DECLARE(name, type, size) declares a static ring of size elements and its inline
+  accessors name_put(), name_get(), name_count(), name_is_empty(), name_is_full(), name_init()
+  and name_flush(). The size must be a power of two up to 256, and the ring holds size-1
+  elements, so full and empty never look alike. Indices are single bytes and wrap by masking.
+
+  Only the producer writes head and only the consumer writes tail. One of them may be an
+  interrupt without any locking, since a byte is read and written in one instruction. Put on a
+  full ring or get on an empty one are not checked. Check is_full() or is_empty() first.
+*/
+
+#ifndef ring_h
+#define ring_h
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Keeps the compiler from moving element accesses past the index update that hands them over
+#define RING_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+
+#define RING_DECLARE(name, type, size) \
+  _Static_assert(((size) & ((size)-1)) == 0 && (size) <= 256, #name " size must be a power of two up to 256"); \
+  static struct { \
+    type buffer[size]; \
+    volatile uint8_t head; \
+    volatile uint8_t tail; \
+  } name; \
+  static inline void name##_init() { name.head = 0; name.tail = 0; } \
+  static inline uint8_t name##_count() { return((uint8_t)(name.head-name.tail) & ((size)-1)); } \
+  static inline bool name##_is_empty() { return(name.head == name.tail); } \
+  static inline bool name##_is_full() { return(((name.head+1) & ((size)-1)) == name.tail); } \
+  static inline void name##_put(type item) \
+  { \
+    uint8_t head = name.head; \
+    name.buffer[head] = item; \
+    RING_BARRIER(); \
+    name.head = (head+1) & ((size)-1); \
+  } \
+  static inline type name##_get() \
+  { \
+    uint8_t tail = name.tail; \
+    type item = name.buffer[tail]; \
+    RING_BARRIER(); \
+    name.tail = (tail+1) & ((size)-1); \
+    return(item); \
+  } \
+  /* Drops everything queued. Called by the consumer. */ \
+  static inline void name##_flush() { name.tail = name.head; }
+
+#endif
@@ -28,17 +28,53 @@
 #include "motion_control.h"
 #include "protocol.h"
 #include "report.h"
-#include "gqueue.h"
+#include "ring.h"
+#include "isr_timing.h"
+#include "stepper.h"
+#include "sram.h"
+#include "frame.h"
 
-DECLARE_QUEUE(tx_buf, uint8_t, TX_BUFFER_SIZE);
-DECLARE_QUEUE(rx_buf, uint8_t, RX_BUFFER_SIZE);
+RING_DECLARE(tx_buf, uint8_t, TX_BUFFER_SIZE);
+RING_DECLARE(rx_buf, uint8_t, RX_BUFFER_SIZE);
 
 static uint8_t checksum = 0;  //sum all bytes between newlines.
+static uint8_t tx_line_open;  // Output stopped mid-line. Nothing may go in between.
+
+uint16_t serial_tx_dropped_bytes;
+
+// Status report held back until the write buffer has room for all of it. A newer status report
+// replaces it, unless it carries a line number the host hasn't seen yet.
+static struct {
+  uint8_t data[TX_REPORT_SIZE];
+  uint8_t length;
+  uint8_t capturing;  // Output goes to the report instead of the write buffer
+  uint8_t droppable;
+  uint8_t checksum;   // Of the line the report was made in the middle of
+} tx_report;
+
+#ifdef TX_SPILL_SIZE
+  _Static_assert((TX_SPILL_SIZE & (TX_SPILL_SIZE-1)) == 0, "TX_SPILL_SIZE must be a power of two");
+  #define TX_SPILL_MASK (TX_SPILL_SIZE-1)
+
+  // Bytes that don't fit the write buffer wait here in order, and move to the buffer as it drains.
+  // Only the main program touches the spill, since it owns the SPI bus. The interrupt only ever
+  // sends from the buffer. Holds TX_SPILL_SIZE-1 bytes.
+  static struct {
+    uint16_t head;
+    uint16_t tail;
+    uint8_t enabled;
+  } tx_spill;
+
+  static uint16_t serial_tx_spill_count()
+  {
+    return((tx_spill.head-tx_spill.tail) & TX_SPILL_MASK);
+  }
+#endif
 
 void serial_init()
 {
-  queue_init(&tx_buf, sizeof(uint8_t), TX_BUFFER_SIZE);
-  queue_init(&rx_buf, sizeof(uint8_t), RX_BUFFER_SIZE);
+  tx_buf_init();
+  rx_buf_init();
 
   // Set baud rate
   #if BAUD_RATE < 57600
@@ -61,60 +97,206 @@ void serial_init()
   // defaults to 8-bit, no parity, 1 stop bit
 }
 
-void serial_sendchar(uint8_t data) 
+void serial_enable_tx_spill()
+{
+  #ifdef TX_SPILL_SIZE
+    tx_spill.enabled = true;
+  #endif
+}
+
+static void serial_tx_refill_spill()
+{
+  #ifdef TX_SPILL_SIZE
+    uint8_t chunk[16];
+    while (tx_spill.head != tx_spill.tail) {
+      uint16_t len = (TX_BUFFER_SIZE-1)-tx_buf_count();
+      if (!len) { return; }
+      len = min(len, sizeof(chunk));
+      len = min(len, serial_tx_spill_count());
+      len = min(len, TX_SPILL_SIZE-tx_spill.tail); // Up to the end of the spill, then wrap
+      sram_read(TX_SPILL_ADDRESS+tx_spill.tail, chunk, len);
+      tx_spill.tail = (tx_spill.tail+len) & TX_SPILL_MASK;
+      uint8_t idx;
+      for (idx = 0; idx < len; idx++) { tx_buf_put(chunk[idx]); }
+      UCSR0B |= (1 << UDRIE0);
+    }
+  #endif
+}
+
+void serial_tx_refill()
+{
+  serial_tx_refill_spill();
+
+  // The held status report goes in once all of it fits, in between two lines, and after the
+  // spilled output. Never from within serial_queue(), which may be in the middle of a frame.
+  #ifdef TX_SPILL_SIZE
+    if (tx_spill.head != tx_spill.tail) { return; }
+  #endif
+  if (tx_report.length && !tx_report.capturing && !tx_line_open &&
+      (tx_report.length <= (TX_BUFFER_SIZE-1)-tx_buf_count())) {
+    uint8_t idx;
+    for (idx = 0; idx < tx_report.length; idx++) { tx_buf_put(tx_report.data[idx]); }
+    tx_report.length = 0;
+    UCSR0B |= (1 << UDRIE0);
+  }
+}
+
+uint16_t serial_get_tx_buffer_available()
 {
-  // As this is an interrupt driven UART, we can simply spin forever
-  // and the service routine will drain the queue until there is
-  // enough room
-  while (queue_is_full(&tx_buf));
+  uint16_t available = (TX_BUFFER_SIZE-1)-tx_buf_count();
+  #ifdef TX_SPILL_SIZE
+    if (tx_spill.enabled) { available += TX_SPILL_MASK-serial_tx_spill_count(); }
+  #endif
+  return(available);
+}
+
+// Queues a byte for the interrupt, behind everything queued before. Only waits with the spill
+// unavailable or full. The steps keep being prepared meanwhile, so never write output between
+// ST_PREP_LOCK() and ST_PREP_UNLOCK(): with the segment prep interrupt, st_prep_buffer() skips
+// and the steppers run dry, and without it, the prep would run on a half changed planner.
+static void serial_queue(uint8_t data)
+{
+  #ifdef TX_SPILL_SIZE
+    if (tx_spill.enabled) {
+      // Keep the order. Once bytes spill, the rest follow them until the spill drains.
+      serial_tx_refill_spill();
+      if ((tx_spill.head != tx_spill.tail) || tx_buf_is_full()) {
+        while (serial_tx_spill_count() == TX_SPILL_MASK) {
+          st_prep_buffer();
+          serial_tx_refill_spill();
+        }
+        sram_write_byte(TX_SPILL_ADDRESS+tx_spill.head, data);
+        tx_spill.head = (tx_spill.head+1) & TX_SPILL_MASK;
+        return;
+      }
+    }
+  #endif
+
+  // Out of room. The interrupt drains the buffer, and step segments keep being prepared
+  // meanwhile, so a slow serial link never starves the steppers.
+  while (tx_buf_is_full()) { st_prep_buffer(); }
 
-  queue_enqueue(&tx_buf, &data);
+  tx_buf_put(data);
 
   // Enable Data Register Empty Interrupt to make sure tx-streaming is running
   UCSR0B |= (1 << UDRIE0);
 }
 
+// Queues the held status report, waiting for room if need be.
+static void serial_report_push()
+{
+  uint8_t capturing = tx_report.capturing;
+  uint8_t length = tx_report.length;
+  tx_report.capturing = false;
+  tx_report.length = 0;
+  uint8_t idx;
+  for (idx = 0; idx < length; idx++) { serial_queue(tx_report.data[idx]); }
+  tx_report.capturing = capturing;
+}
+
+void serial_sendchar(uint8_t data)
+{
+  if (tx_report.capturing) {
+    if (tx_report.length < TX_REPORT_SIZE) {
+      tx_report.data[tx_report.length++] = data;
+      return;
+    }
+    // Too long to hold back. The report goes out in one piece, like any other output.
+    serial_report_push();
+    tx_report.capturing = false;
+  }
+  serial_queue(data);
+}
+
+void serial_report_begin()
+{
+  if (tx_report.length) {
+    if (tx_report.droppable) {
+      serial_tx_dropped_bytes += tx_report.length;
+      tx_report.length = 0;
+    } else {
+      serial_report_push();
+    }
+  }
+  tx_report.capturing = true;
+  tx_report.checksum = checksum;
+  checksum = 0;
+}
+
+void serial_report_end(uint8_t droppable)
+{
+  tx_report.capturing = false;
+  tx_report.droppable = droppable;
+  checksum = tx_report.checksum;
+  serial_tx_refill();
+}
+
 void serial_write(uint8_t data)
 {
-  checksum += data;
-  serial_sendchar(data);
-  if (data == '\n') {
-    serial_sendchar(checksum);
-    checksum = 0;
+  uint8_t line = !tx_report.capturing; // Held back reports go in between the lines
+  if (line) { tx_line_open = true; }
+  #ifdef BINARY_FRAMING
+    // A raw checksum byte could be taken for a frame delimiter. Frames carry a CRC instead.
+    if (frame_mode) { frame_write(data); } else
+  #endif
+  {
+    checksum += data;
+    serial_sendchar(data);
+    if (data == '\n') {
+      serial_sendchar(checksum);
+      checksum = 0;
+    }
   }
+  if (line && (data == '\n')) { tx_line_open = false; }
 }
 
 // Data Register Empty Interrupt handler
 ISR(SERIAL_UDRE)
 {
-  uint8_t data = 0;
-
-  queue_dequeue(&tx_buf, &data);
-  
+  ISR_TIMING_START();
   // Send a byte from the buffer
-  UDR0 = data;
+  UDR0 = tx_buf_get();
 
   // Turn off Data Register Empty Interrupt to stop tx-streaming if this concludes the transfer
-  if (queue_is_empty(&tx_buf)) {
+  if (tx_buf_is_empty()) {
     UCSR0B &= ~(1 << UDRIE0);
   }
-  
+  ISR_TIMING_STOP(ISR_TIMING_SERIAL_UDRE);
 }
 
 // Read data from rx_buffer at tail value 
 uint8_t serial_read()
 {
-  if (queue_is_empty(&rx_buf)) {
+  if (rx_buf_is_empty()) {
     return SERIAL_NO_DATA;
   }
-  
-  uint8_t data = 0;
-  queue_dequeue(&rx_buf, &data);
-  return data;
+  return rx_buf_get();
+}
+
+uint8_t serial_get_rx_buffer_available()
+{
+  return((RX_BUFFER_SIZE-1)-rx_buf_count());
+}
+
+// Requests a new feed override value, limited to the configured range. Applied by the main
+// program, which re-plans the buffer with the new nominal speeds.
+static void serial_feed_override(int16_t value)
+{
+  if (value > MAX_FEED_RATE_OVERRIDE) { value = MAX_FEED_RATE_OVERRIDE; }
+  else if (value < MIN_FEED_RATE_OVERRIDE) { value = MIN_FEED_RATE_OVERRIDE; }
+  sysflags.f_override = value;
+  SYS_EXEC |= EXEC_MOTION_OVERRIDE;
+}
+
+static void serial_rapid_override(uint8_t value)
+{
+  sysflags.r_override = value;
+  SYS_EXEC |= EXEC_MOTION_OVERRIDE;
 }
 
 ISR(SERIAL_RX)
 {
+  ISR_TIMING_START();
   uint8_t data = UDR0;
 
   // Pick off runtime command characters directly from the serial stream. These characters are
@@ -127,14 +309,24 @@ ISR(SERIAL_RX)
   case CMD_CYCLE_START: SYS_EXEC |= EXEC_CYCLE_START; break; // Set as true
   case CMD_FEED_HOLD:  SYS_EXEC |= EXEC_FEED_HOLD; break; // Set as true
   case CMD_RESET:     mc_reset(); break; // Call motion control reset routine.
+  case CMD_JOG_CANCEL: sysflags.jog_cancel = true; break; // Serviced only while jogging.
+  case CMD_FEED_OVR_RESET: serial_feed_override(DEFAULT_FEED_OVERRIDE); break;
+  case CMD_FEED_OVR_COARSE_PLUS: serial_feed_override(sysflags.f_override+FEED_OVERRIDE_COARSE_INCREMENT); break;
+  case CMD_FEED_OVR_COARSE_MINUS: serial_feed_override(sysflags.f_override-FEED_OVERRIDE_COARSE_INCREMENT); break;
+  case CMD_FEED_OVR_FINE_PLUS: serial_feed_override(sysflags.f_override+FEED_OVERRIDE_FINE_INCREMENT); break;
+  case CMD_FEED_OVR_FINE_MINUS: serial_feed_override(sysflags.f_override-FEED_OVERRIDE_FINE_INCREMENT); break;
+  case CMD_RAPID_OVR_RESET: serial_rapid_override(DEFAULT_RAPID_OVERRIDE); break;
+  case CMD_RAPID_OVR_MEDIUM: serial_rapid_override(RAPID_OVERRIDE_MEDIUM); break;
+  case CMD_RAPID_OVR_LOW: serial_rapid_override(RAPID_OVERRIDE_LOW); break;
   default: // Write character to buffer
-    if (!queue_is_full(&rx_buf)) {
-      queue_enqueue(&rx_buf, &data);
+    if (!rx_buf_is_full()) {
+      rx_buf_put(data);
     }
   }
+  ISR_TIMING_STOP(ISR_TIMING_SERIAL_RX);
 }
 
 void serial_reset_read_buffer()
 {
-  queue_init(&rx_buf, sizeof(uint8_t), RX_BUFFER_SIZE);
+  rx_buf_flush();
 }
@@ -26,6 +26,7 @@
 #define serial_h
 
 
+// Ring sizes. Powers of two up to 256. One byte less than the size is usable.
 #ifndef RX_BUFFER_SIZE
   #define RX_BUFFER_SIZE 128
 #endif
@@ -33,6 +34,11 @@
   #define TX_BUFFER_SIZE 128
 #endif
 
+// Status report held back while the write buffer is full. At most the usable write buffer.
+#ifndef TX_REPORT_SIZE
+  #define TX_REPORT_SIZE (TX_BUFFER_SIZE-1)
+#endif
+
 #define SERIAL_NO_DATA 0xff
 
 volatile uint8_t force_servo_enable;
@@ -40,10 +46,40 @@ volatile uint8_t collect_servo_info;
 
 void serial_init();
 
+// Queues a byte for the serial link. Without the SPI SRAM spill, a byte that finds the write
+// buffer full waits for room, calling only st_prep_buffer() meanwhile. Only status reports are
+// held back instead. Any other long output, such as report_grbl_settings(), stalls the main
+// program on a slow serial link until it is written.
 void serial_write(uint8_t data);
 
+// Queues a byte without adding it to the line checksum. Used for binary frames.
+void serial_sendchar(uint8_t data);
+
+// Spills write buffer overflow into the SPI SRAM. Called once the SRAM is initialized.
+void serial_enable_tx_spill();
+
+// Moves spilled bytes, then the held status report, into the write buffer as it drains. Called by
+// the main program, in between lines.
+void serial_tx_refill();
+
+// Returns the number of bytes that can be written without waiting, spill included
+uint16_t serial_get_tx_buffer_available();
+
+// Holds back the output up to serial_report_end(), until the write buffer has room for all of
+// it. Used for status reports, so they never wait on the serial link. A report still held back
+// when the next one begins is dropped if it was droppable, or else queued first.
+void serial_report_begin();
+void serial_report_end(uint8_t droppable);
+
+// Bytes of the status reports dropped for a newer one, as the serial link fell behind. Reported
+// with the status.
+extern uint16_t serial_tx_dropped_bytes;
+
 uint8_t serial_read();
 
+// Returns the number of free bytes in the read buffer
+uint8_t serial_get_rx_buffer_available();
+
 // Reset and empty data in read buffer. Used by e-stop and reset.
 void serial_reset_read_buffer();
 
@@ -88,6 +88,7 @@ void settings_reset() {
   if (DEFAULT_SOFT_LIMIT_ENABLE) { settings.flags |= BITFLAG_SOFT_LIMIT_ENABLE; }
   if (DEFAULT_HARD_LIMIT_ENABLE) { settings.flags |= BITFLAG_HARD_LIMIT_ENABLE; }
   if (DEFAULT_HOMING_ENABLE) { settings.flags |= BITFLAG_HOMING_ENABLE; }
+  if (DEFAULT_REPORT_BUFFERS) { settings.flags |= BITFLAG_REPORT_BUFFERS; }
   settings.homing_dir_mask = DEFAULT_HOMING_DIR_MASK;
   settings.homing_feed_rate = DEFAULT_HOMING_FEED_RATE;
   settings.homing_seek_rate[X_AXIS] = DEFAULT_X_HOMING_SEEK_RATE;
@@ -114,6 +115,21 @@ void settings_reset() {
   settings.y_microsteps = DEFAULT_Y_MICROSTEPS;
   settings.z_microsteps = DEFAULT_Z_MICROSTEPS;
   settings.c_microsteps = DEFAULT_C_MICROSTEPS;
+  settings.jerk[X_AXIS] = DEFAULT_X_JERK;
+  settings.jerk[Y_AXIS] = DEFAULT_Y_JERK;
+  settings.jerk[Z_AXIS] = DEFAULT_Z_JERK;
+  settings.jerk[C_AXIS] = DEFAULT_C_JERK;
+  settings.merge_tolerance = DEFAULT_MERGE_TOLERANCE;
+  settings.homing_edge_offset[X_AXIS] = DEFAULT_X_HOMING_EDGE_OFFSET;
+  settings.homing_edge_offset[Y_AXIS] = DEFAULT_Y_HOMING_EDGE_OFFSET;
+  settings.homing_edge_offset[Z_AXIS] = DEFAULT_Z_HOMING_EDGE_OFFSET;
+  settings.homing_edge_offset[C_AXIS] = DEFAULT_C_HOMING_EDGE_OFFSET;
+  settings.force_servo_kp = DEFAULT_FORCE_SERVO_KP;
+  settings.force_servo_ki = DEFAULT_FORCE_SERVO_KI;
+  settings.force_servo_kd = DEFAULT_FORCE_SERVO_KD;
+  settings.force_servo_band = DEFAULT_FORCE_SERVO_BAND;
+  settings.status_report_interval = DEFAULT_STATUS_REPORT_INTERVAL;
+  settings.status_report_mask = DEFAULT_STATUS_REPORT_MASK;
   write_global_settings();
 }
 
@@ -275,6 +291,27 @@ uint8_t settings_store_global_setting(int parameter, float value) {
       }
       motor_drv_init();
       break;
+    case 50: case 51: case 52: case 53:
+      settings.jerk[parameter-50] = value*60*60*60; break; // Convert to mm/min^3 for grbl internal use.
+    case 54: settings.merge_tolerance = value; break;
+    case 55: case 56: case 57: case 58:
+      settings.homing_edge_offset[parameter-55] = value; break;
+    case 59: settings.force_servo_kp = value; break;
+    case 60: settings.force_servo_ki = value; break;
+    case 61: settings.force_servo_kd = value; break;
+    case 62: settings.force_servo_band = value; break;
+    case 63:
+      if (value) { settings.flags |= BITFLAG_REPORT_BUFFERS; }
+      else { settings.flags &= ~BITFLAG_REPORT_BUFFERS; }
+      break;
+    case 64:
+      // Faster reports would keep the main loop busy waiting on the serial port
+      if (value && (value < STATUS_REPORT_MIN_INTERVAL)) { return(STATUS_INVALID_STATEMENT); }
+      if (value > UINT16_MAX) { return(STATUS_INVALID_STATEMENT); } // Stored in a uint16_t
+      settings.status_report_interval = value;
+      report_status_stream_start();
+      break;
+    case 65: settings.status_report_mask = value; break;
     default:
       return(STATUS_INVALID_STATEMENT);
   }
@@ -41,7 +41,7 @@
 
 // Version of the EEPROM data. Will be used to migrate existing data from older versions of Grbl
 // when firmware is upgraded. Always stored in byte 0 of eeprom
-#define SETTINGS_VERSION 73
+#define SETTINGS_VERSION 78
 
 // Define bit flag masks for the boolean settings in settings.flag.
 #define BITFLAG_REPORT_INCHES      bit(0)
@@ -51,6 +51,7 @@
 #define BITFLAG_HOMING_ENABLE      bit(4)
 #define BITFLAG_SOFT_LIMIT_ENABLE  bit(5)
 #define BITFLAG_INVERT_LIMIT_PINS  bit(6)
+#define BITFLAG_REPORT_BUFFERS     bit(7)
 
 // Define EEPROM memory address location values for Grbl settings and parameters
 // NOTE: The Atmega328p has 1KB EEPROM. The upper half is reserved for parameters and
@@ -60,6 +61,7 @@
 #define EEPROM_ADDR_PARAMETERS 512
 #define EEPROM_ADDR_STARTUP_BLOCK 768
 #define EEPROM_ADDR_BUILD_INFO 992
+#define EEPROM_ADDR_MAGAZINE_MAP 1024 // Mega 2560 only. Above the 1KB of the 328p.
 
 // Define EEPROM address indexing for coordinate parameters
 //@TODO: can reduce this for EEPROM space.
@@ -103,6 +105,15 @@ typedef struct {
   uint8_t y_microsteps;
   uint8_t z_microsteps;
   uint8_t c_microsteps;
+  float jerk[N_AXIS];  // Jerk limit (mm/min^3). Zero disables S-curve profiles for the axis.
+  float merge_tolerance;  // Path error allowed when merging collinear moves (mm). Zero disables.
+  float homing_edge_offset[N_AXIS];  // Late trip of the switch edges at seek speed (mm). See HOMING_EDGE_LATCH.
+  float force_servo_kp;  // Gripper rate per force error ((mm/min)/count). Zero keeps the bang-bang servo.
+  float force_servo_ki;  // Gripper rate per integrated force error ((mm/min)/(count*sec))
+  float force_servo_kd;  // Gripper rate per force rate of change ((mm/min)/(count/sec))
+  uint8_t force_servo_band;  // Force error the servo settles within (counts)
+  uint16_t status_report_interval;  // Period of the pushed status reports (ms). Zero disables.
+  uint8_t status_report_mask;  // STATUS_FIELD bits of the status report fields to print
 } settings_t;
 extern settings_t settings;
 
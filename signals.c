@@ -40,6 +40,10 @@ void signals_update_motors()
 // Filter and update force ADC reading
 void signals_update_force()
 {
+#ifdef FORCE_OVERSAMPLING
+  // The ADC ISR oversamples and filters the force itself. Just pick up the latest value.
+  signals.adc_samples[FORCE_VALUE_INDEX] = adc_get_force(&signals.force_time);
+#else
   // Since the raw adc value changes based on an interrupt,
   // copy the raw value at the beginning of this function to
   // ensure that the value being used doesn't change during 
@@ -61,6 +65,7 @@ void signals_update_force()
 
   // Advance all values in the unfiltered array
   memmove(&X_BUF(0), &X_BUF(1) ,sizeof(uint16_t) * N_FILTER - 1);
+#endif
 
 }
 
@@ -73,14 +78,10 @@ void signals_callback()
     // signals.pause needs to be set before the force servoing cycle
     // is started to prevent the signals_callback from asynchronously
     // updating the force value while force servoing.
-    systick_register_callback(signals.callback_period, signals_callback);
     return;
   }  
 
   signals_update_force();
- 
-  // Register callback to this function in SIGNALS_CALLBACK_INTERVAL milliseconds
-  systick_register_callback(signals.callback_period, signals_callback);
 }
 
 // Read value from revision voltage divider
@@ -22,6 +22,9 @@ typedef struct {
   uint8_t pause;  // Pause the reading of ADC values periodically with a callback
   uint16_t adc_samples[VOLTAGE_SENSOR_COUNT];  // Filtered ADC readings
   uint16_t callback_period;  // Period between ADC readings TODO: Add command to change this over serial  
+  #ifdef FORCE_OVERSAMPLING
+    uint32_t force_time;  // masterclock time of the last sample in the force reading
+  #endif
 } signals_t;
 signals_t signals;
 
@@ -59,7 +59,7 @@ enum sim_wgm_mode sim_wgm_4[16] = {wgm_NORMAL,wgm_PHASE_PWM,wgm_PHASE_PWM,wgm_PH
 
 static const uint16_t timer_bitdepth[SIM_N_TIMERS] = {
   0xFF,0xFFFF,0xFF,
-  //0xFFFF,0xFFFF,0xFFFF   3 more for mega
+  0xFFFF,0xFFFF,0xFFFF // 3 more for mega
 };
 
 void timer_interrupts() {
@@ -40,7 +40,7 @@ enum {
   SIM_PORT_COUNT
 };
 
-#define SIM_N_TIMERS 3 //328p has 3, Mega has 6
+#define SIM_N_TIMERS 6 //328p has 3, Mega has 6
 
 
 // dummy register variables
@@ -55,12 +55,18 @@ typedef struct io_sim {
   uint16_t tcnt[SIM_N_TIMERS]; //tcint0 is really only 8bit
   uint8_t tccra[SIM_N_TIMERS];
   uint8_t tccrb[SIM_N_TIMERS];
+  uint8_t tccrc[SIM_N_TIMERS];
   uint8_t tifr[SIM_N_TIMERS];
   uint8_t  pcicr;
   uint8_t pcmsk[3];
   uint8_t ucsr0[3];
   uint8_t udr[3];
   uint8_t gpior[3];
+  uint8_t spcr, spsr, spdr;
+  uint8_t admux, adcsra, adcsrb;
+  uint16_t adc;
+  uint8_t eicra, eicrb, eimsk;
+  uint8_t acsr;
   uint8_t mcusr;
   uint8_t wdtcsr;
   union hilo16 ubrr0;
@@ -164,17 +170,49 @@ typedef struct io_sim_monitor {
 #define OCIE2A  SIM_OCA
 #define TOIE2   SIM_TOV
 
+#define OCIE3C  SIM_OCC
+#define OCIE3B  SIM_OCB
+#define OCIE3A  SIM_OCA
+#define TOIE3   SIM_TOV
+#define OCIE4C  SIM_OCC
+#define OCIE4B  SIM_OCB
+#define OCIE4A  SIM_OCA
+#define TOIE4   SIM_TOV
+#define OCIE5C  SIM_OCC
+#define OCIE5B  SIM_OCB
+#define OCIE5A  SIM_OCA
+#define TOIE5   SIM_TOV
+
 #define OCR0A io.ocra[0]
 #define OCR1A io.ocra[1]
 #define OCR2A io.ocra[2]
 
+#define OCR3A io.ocra[3]
+#define OCR4A io.ocra[4]
+#define OCR5A io.ocra[5]
+
 #define OCR0B io.ocrb[0]
 #define OCR1B io.ocrb[1]
 #define OCR2B io.ocrb[2]
+#define OCR3B io.ocrb[3]
+#define OCR4B io.ocrb[4]
+#define OCR5B io.ocrb[5]
+
+#define OCR3C io.ocrc[3]
+#define OCR4C io.ocrc[4]
+#define OCR5C io.ocrc[5]
+
+// Low bytes of the 16-bit compare registers. Little endian, like the AVR.
+#define OCR3AL (*(volatile uint8_t*)&io.ocra[3])
+#define OCR3BL (*(volatile uint8_t*)&io.ocrb[3])
+#define OCR3CL (*(volatile uint8_t*)&io.ocrc[3])
 
 #define TCNT0  io.tcnt[0]
 #define TCNT1  io.tcnt[1]
 #define TCNT2  io.tcnt[2]
+#define TCNT3  io.tcnt[3]
+#define TCNT4  io.tcnt[4]
+#define TCNT5  io.tcnt[5]
 
 #define TCCR0A io.tccra[0]
 #define TCCR0B io.tccrb[0]
@@ -182,10 +220,22 @@ typedef struct io_sim_monitor {
 #define TCCR1B io.tccrb[1]
 #define TCCR2A io.tccra[2]
 #define TCCR2B io.tccrb[2]
+#define TCCR3A io.tccra[3]
+#define TCCR3B io.tccrb[3]
+#define TCCR3C io.tccrc[3]
+#define TCCR4A io.tccra[4]
+#define TCCR4B io.tccrb[4]
+#define TCCR4C io.tccrc[4]
+#define TCCR5A io.tccra[5]
+#define TCCR5B io.tccrb[5]
+#define TCCR5C io.tccrc[5]
 
 #define TIFR0  io.tifr[0]
 #define TIFR1  io.tifr[1]
 #define TIFR2  io.tifr[2]
+#define TIFR3  io.tifr[3]
+#define TIFR4  io.tifr[4]
+#define TIFR5  io.tifr[5]
 
 #define CS00 0
 #define CS01 1
@@ -193,6 +243,15 @@ typedef struct io_sim_monitor {
 #define CS11 1
 #define CS10 0
 #define CS21 1
+#define CS32 2
+#define CS31 1
+#define CS30 0
+#define CS42 2
+#define CS41 1
+#define CS40 0
+#define CS52 2
+#define CS51 1
+#define CS50 0
 
 #define WGM13 4
 #define WGM12 3
@@ -203,6 +262,19 @@ typedef struct io_sim_monitor {
 #define WGM21 1
 #define WGM20 0
 
+#define WGM33 4
+#define WGM32 3
+#define WGM31 1
+#define WGM30 0
+#define WGM43 4
+#define WGM42 3
+#define WGM41 1
+#define WGM40 0
+#define WGM53 4
+#define WGM52 3
+#define WGM51 1
+#define WGM50 0
+
 #define TOV0 SIM_TOV
 #define TOV1 SIM_TOV
 #define TOV2 SIM_TOV
@@ -213,6 +285,18 @@ typedef struct io_sim_monitor {
 #define COM1B0 4
 #define COM1C1 3
 #define COM1C0 2
+#define COM3A1 7
+#define COM3A0 6
+#define COM3B1 5
+#define COM3B0 4
+#define COM3C1 3
+#define COM3C0 2
+#define COM4A1 7
+#define COM4A0 6
+#define COM4B1 5
+#define COM4B0 4
+#define COM4C1 3
+#define COM4C0 2
 
 
 #define PCICR io.pcicr
@@ -236,6 +320,226 @@ typedef struct io_sim_monitor {
 #define PCMSK1 io.pcmsk[1]
 #define PCMSK2 io.pcmsk[2]
 
+// Port pin bit numbers
+#define PA0 0
+#define PA1 1
+#define PA2 2
+#define PA3 3
+#define PA4 4
+#define PA5 5
+#define PA6 6
+#define PA7 7
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PC6 6
+#define PC7 7
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+#define PE0 0
+#define PE1 1
+#define PE2 2
+#define PE3 3
+#define PE4 4
+#define PE5 5
+#define PE6 6
+#define PE7 7
+#define PF0 0
+#define PF1 1
+#define PF2 2
+#define PF3 3
+#define PF4 4
+#define PF5 5
+#define PF6 6
+#define PF7 7
+#define PG0 0
+#define PG1 1
+#define PG2 2
+#define PG3 3
+#define PG4 4
+#define PG5 5
+#define PG6 6
+#define PG7 7
+#define PH0 0
+#define PH1 1
+#define PH2 2
+#define PH3 3
+#define PH4 4
+#define PH5 5
+#define PH6 6
+#define PH7 7
+#define PJ0 0
+#define PJ1 1
+#define PJ2 2
+#define PJ3 3
+#define PJ4 4
+#define PJ5 5
+#define PJ6 6
+#define PJ7 7
+#define PK0 0
+#define PK1 1
+#define PK2 2
+#define PK3 3
+#define PK4 4
+#define PK5 5
+#define PK6 6
+#define PK7 7
+#define PL0 0
+#define PL1 1
+#define PL2 2
+#define PL3 3
+#define PL4 4
+#define PL5 5
+#define PL6 6
+#define PL7 7
+
+// Data direction bit numbers
+#define DDA0 0
+#define DDA1 1
+#define DDA2 2
+#define DDA3 3
+#define DDA4 4
+#define DDA5 5
+#define DDA6 6
+#define DDA7 7
+#define DDB0 0
+#define DDB1 1
+#define DDB2 2
+#define DDB3 3
+#define DDB4 4
+#define DDB5 5
+#define DDB6 6
+#define DDB7 7
+#define DDC0 0
+#define DDC1 1
+#define DDC2 2
+#define DDC3 3
+#define DDC4 4
+#define DDC5 5
+#define DDC6 6
+#define DDC7 7
+#define DDD0 0
+#define DDD1 1
+#define DDD2 2
+#define DDD3 3
+#define DDD4 4
+#define DDD5 5
+#define DDD6 6
+#define DDD7 7
+#define DDE0 0
+#define DDE1 1
+#define DDE2 2
+#define DDE3 3
+#define DDE4 4
+#define DDE5 5
+#define DDE6 6
+#define DDE7 7
+#define DDF0 0
+#define DDF1 1
+#define DDF2 2
+#define DDF3 3
+#define DDF4 4
+#define DDF5 5
+#define DDF6 6
+#define DDF7 7
+#define DDG0 0
+#define DDG1 1
+#define DDG2 2
+#define DDG3 3
+#define DDG4 4
+#define DDG5 5
+#define DDG6 6
+#define DDG7 7
+#define DDH0 0
+#define DDH1 1
+#define DDH2 2
+#define DDH3 3
+#define DDH4 4
+#define DDH5 5
+#define DDH6 6
+#define DDH7 7
+#define DDJ0 0
+#define DDJ1 1
+#define DDJ2 2
+#define DDJ3 3
+#define DDJ4 4
+#define DDJ5 5
+#define DDJ6 6
+#define DDJ7 7
+#define DDK0 0
+#define DDK1 1
+#define DDK2 2
+#define DDK3 3
+#define DDK4 4
+#define DDK5 5
+#define DDK6 6
+#define DDK7 7
+#define DDL0 0
+#define DDL1 1
+#define DDL2 2
+#define DDL3 3
+#define DDL4 4
+#define DDL5 5
+#define DDL6 6
+#define DDL7 7
+
+// SPI
+#define SPCR io.spcr
+#define SPSR io.spsr
+#define SPDR io.spdr
+#define SPR0 0
+#define SPR1 1
+#define CPHA 2
+#define CPOL 3
+#define MSTR 4
+#define DORD 5
+#define SPE  6
+#define SPIE 7
+#define SPI2X 0
+#define SPIF 7
+
+// ADC
+#define ADMUX  io.admux
+#define ADCSRA io.adcsra
+#define ADCSRB io.adcsrb
+#define ADC    io.adc
+#define REFS0 6
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE 3
+#define ADSC 6
+#define ADEN 7
+
+// Analog comparator
+#define ACSR io.acsr
+#define ACIE 3
+
+// External interrupts
+#define EICRA io.eicra
+#define EICRB io.eicrb
+#define EIMSK io.eimsk
+
+// Status register. Only the interrupt enable bit is used. See sei() and cli().
+#define SREG io.sreg
+
 //GPIO
 #define GPIOR0 io.gpior[0]
 #define GPIOR1 io.gpior[1]
@@ -0,0 +1,22 @@
+# Compares the path results of the float and fixed point segment generators, as printed by
+# segment_prep.c. The end positions must match exactly, and the path times within 0.1%.
+
+FNR == NR && NF == 6 { steps[$1] = $2 " " $3 " " $4 " " $5; cycles[$1] = $6; next }
+
+NF == 6 {
+  if (!($1 in steps)) { print $1 ": no float result"; failed = 1; next }
+  if (steps[$1] != $2 " " $3 " " $4 " " $5) {
+    print $1 ": fixed point ends at " $2 " " $3 " " $4 " " $5 ", float at " steps[$1]; failed = 1
+  }
+  diff = ($6 - cycles[$1]) / cycles[$1]
+  if (diff > 0.001 || diff < -0.001) {
+    printf "%s: fixed point takes %d cycles, float %d (%+.3f%%)\n", $1, $6, cycles[$1], 100*diff; failed = 1
+  }
+  compared++
+}
+
+END {
+  if (!compared) { print "compare_segment_prep: no results"; failed = 1 }
+  print "compare_segment_prep: " (failed ? "FAILED" : "ok")
+  exit failed
+}
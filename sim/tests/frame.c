@@ -0,0 +1,274 @@
+/*
+  frame.c - SLIP escaping and CRC of the binary framed host protocol
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The frame module is included whole, to share its reserved byte set.
+#include "../../frame.c"
+#include "tests.h"
+
+parser_state_t gc_state;
+
+// Bytes sent by the device
+static uint8_t tx[512];
+static uint16_t tx_len;
+void serial_sendchar(uint8_t data) { if (tx_len < sizeof(tx)) { tx[tx_len++] = data; } }
+
+static uint16_t blocks_available;
+static uint8_t rx_available;
+uint16_t plan_get_block_buffer_available() { return blocks_available; }
+uint8_t serial_get_rx_buffer_available() { return rx_available; }
+
+// Last move and line handed on by the frames
+static float move_target[N_AXIS];
+static float move_feed_rate;
+static linenumber_t move_line_number;
+static uint8_t n_moves;
+static uint8_t n_lines;
+
+void mc_line(float *target, float feed_rate, uint8_t invert_feed_rate, linenumber_t line_number)
+{
+  memcpy(move_target, target, sizeof(move_target));
+  move_feed_rate = feed_rate;
+  move_line_number = line_number;
+  n_moves++;
+}
+
+uint8_t protocol_dispatch_line(char *line) { n_lines++; return STATUS_OK; }
+
+// Device frames decoded from tx. Opcode, payload and CRC, as sent.
+#define MAX_FRAMES 8
+static uint8_t rx_frames[MAX_FRAMES][64];
+static uint8_t rx_frame_len[MAX_FRAMES];
+static uint8_t n_rx_frames;
+
+static void reset()
+{
+  frame_start();
+  memset(&gc_state, 0, sizeof(gc_state));
+  tx_len = 0;
+  n_moves = 0;
+  n_lines = 0;
+  blocks_available = 10;
+  rx_available = 100;
+}
+
+// Encodes a host frame the way the host does, and feeds it to the device byte by byte.
+// The CRC can be spoiled, to test the rejection.
+static void send_frame(uint8_t seq, uint8_t opcode, const uint8_t *payload, uint8_t length, uint16_t crc_error)
+{
+  uint8_t raw[FRAME_BUFFER_SIZE];
+  uint8_t idx, n = 0;
+  uint16_t crc = 0;
+  raw[n++] = seq;
+  raw[n++] = opcode;
+  memcpy(&raw[n], payload, length);
+  n += length;
+  for (idx = 0; idx < n; idx++) { crc = _crc_xmodem_update(crc, raw[idx]); }
+  crc ^= crc_error;
+  raw[n++] = crc >> 8;
+  raw[n++] = crc & 0xff;
+
+  frame_receive(FRAME_END);
+  for (idx = 0; idx < n; idx++) {
+    if (frame_is_reserved(raw[idx])) {
+      frame_receive(FRAME_ESC);
+      frame_receive(raw[idx] ^ FRAME_ESC_XOR);
+    } else {
+      frame_receive(raw[idx]);
+    }
+  }
+  frame_receive(FRAME_END);
+}
+
+// Splits the device output into frames, undoing the escapes. Every byte between the delimiters
+// must be safe to send raw, and every frame must carry a good CRC.
+static void decode_tx()
+{
+  uint16_t idx;
+  uint8_t len = 0, escaped = false, in_frame = false;
+  n_rx_frames = 0;
+  for (idx = 0; idx < tx_len; idx++) {
+    uint8_t data = tx[idx];
+    if (data == FRAME_END) {
+      if (in_frame && len) {
+        uint16_t crc = 0;
+        uint8_t i;
+        for (i = 0; i < len-2; i++) { crc = _crc_xmodem_update(crc, rx_frames[n_rx_frames][i]); }
+        CHECK(crc == (((uint16_t)rx_frames[n_rx_frames][len-2] << 8) | rx_frames[n_rx_frames][len-1]));
+        rx_frame_len[n_rx_frames++] = len;
+        in_frame = false;
+      } else {
+        in_frame = true;
+      }
+      len = 0;
+      continue;
+    }
+    CHECK(in_frame);
+    if (data == FRAME_ESC) { escaped = true; continue; }
+    CHECK(!frame_is_reserved(data));
+    if (escaped) { data ^= FRAME_ESC_XOR; escaped = false; }
+    if (n_rx_frames < MAX_FRAMES && len < sizeof(rx_frames[0])) { rx_frames[n_rx_frames][len++] = data; }
+  }
+  CHECK(!escaped);
+}
+
+// The avr-libc CRC and the one of the host tests agree on the standard check value.
+static void test_crc_check_value()
+{
+  const char *check = "123456789";
+  uint16_t crc = 0;
+  while (*check) { crc = _crc_xmodem_update(crc, *check++); }
+  CHECK(crc == 0x31C3);
+}
+
+// A move whose payload is full of delimiters and runtime commands arrives intact.
+static void test_move_with_reserved_bytes()
+{
+  uint8_t payload[] = {
+    0x03,                     // X and Y
+    0xC0, 0x0A,               // Line 0x0AC0
+    CMD_STATUS_REPORT, 0x0D,  // Feed 0x0D3F
+    CMD_FEED_HOLD, CMD_CYCLE_START, CMD_RESET, 0x00,    // X 0x00187E21 um
+    FRAME_ESC, CMD_JOG_CANCEL, '\n', CMD_RAPID_OVR_LOW, // Y, negative
+  };
+  int32_t y_microns;
+  memcpy(&y_microns, &payload[9], sizeof(y_microns));
+
+  reset();
+  gc_state.position[Z_AXIS] = 4.5;
+  send_frame(0, FRAME_OP_MOVE, payload, sizeof(payload), 0);
+  CHECK(n_moves == 1);
+  CHECK(move_line_number == 0x0AC0);
+  CHECK(move_feed_rate == 0x0D3F);
+  CHECK(move_target[X_AXIS] == (float)(0.001*0x00187E21));
+  CHECK(move_target[Y_AXIS] == (float)(0.001*y_microns));
+  CHECK(move_target[Z_AXIS] == 4.5f);
+  CHECK(tx_len == 0); // Acknowledged later
+
+  // The acknowledgement has reserved bytes of its own to escape.
+  blocks_available = (FRAME_END << 8) | FRAME_ESC;
+  rx_available = CMD_STATUS_REPORT;
+  frame_flush_ack();
+  decode_tx();
+  CHECK(n_rx_frames == 1);
+  CHECK(rx_frame_len[0] == 7);
+  CHECK(rx_frames[0][0] == FRAME_OP_ACK);
+  CHECK(rx_frames[0][1] == 0);
+  CHECK(rx_frames[0][2] == FRAME_ESC && rx_frames[0][3] == FRAME_END);
+  CHECK(rx_frames[0][4] == CMD_STATUS_REPORT);
+}
+
+// A frame with a bad CRC is answered with a single NAK until the expected frame arrives.
+static void test_bad_crc_nak()
+{
+  uint8_t line[] = "G0X1";
+  reset();
+  send_frame(0, FRAME_OP_LINE, line, 4, 0);
+  send_frame(1, FRAME_OP_LINE, line, 4, 0x0100);
+  send_frame(2, FRAME_OP_LINE, line, 4, 0);
+  CHECK(n_lines == 1);
+  decode_tx();
+  CHECK(n_rx_frames == 1);
+  CHECK(rx_frames[0][0] == FRAME_OP_NAK && rx_frames[0][1] == 1);
+
+  // The host resends from the expected frame.
+  tx_len = 0;
+  send_frame(1, FRAME_OP_LINE, line, 4, 0);
+  send_frame(2, FRAME_OP_LINE, line, 4, 0);
+  CHECK(n_lines == 3);
+  frame_flush_ack();
+  decode_tx();
+  CHECK(n_rx_frames == 1);
+  CHECK(rx_frames[0][0] == FRAME_OP_ACK && rx_frames[0][1] == 2);
+}
+
+// A dropped escape byte breaks the CRC, rather than executing a changed frame.
+static void test_lost_escape()
+{
+  uint8_t payload[] = { 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+  uint8_t idx;
+  reset();
+  payload[5] = CMD_FEED_HOLD;
+  // As send_frame(), but the FRAME_ESC before the feed hold byte is lost on the line.
+  uint16_t crc = _crc_xmodem_update(_crc_xmodem_update(0, 0), FRAME_OP_MOVE);
+  for (idx = 0; idx < sizeof(payload); idx++) { crc = _crc_xmodem_update(crc, payload[idx]); }
+  frame_receive(FRAME_END);
+  frame_receive(0);
+  frame_receive(FRAME_OP_MOVE);
+  for (idx = 0; idx < sizeof(payload); idx++) {
+    frame_receive(frame_is_reserved(payload[idx]) ? payload[idx] ^ FRAME_ESC_XOR : payload[idx]);
+  }
+  frame_receive(crc >> 8);
+  frame_receive(crc & 0xff);
+  frame_receive(FRAME_END);
+  CHECK(n_moves == 0);
+  decode_tx();
+  CHECK(n_rx_frames == 1);
+  CHECK(rx_frames[0][0] == FRAME_OP_NAK && rx_frames[0][1] == 0);
+}
+
+static void write_text(const char *s)
+{
+  while (*s) { frame_write(*s++); }
+}
+
+// Report lines go out in text frames between the others, even when one is cut short by a frame
+// or a reset. A line whose ASCII checksum byte would be FRAME_END leaves no raw byte behind.
+static void test_report_between_frames()
+{
+  const char ok[] = { 'o', 'k', ':', 0x95, '\r', '\n', 0 }; // Bytes sum to FRAME_END
+  uint8_t line[] = "G0X1";
+  uint8_t idx, sum = 0;
+  for (idx = 0; ok[idx]; idx++) { sum += ok[idx]; }
+  CHECK(sum == FRAME_END);
+
+  reset();
+  send_frame(0, FRAME_OP_LINE, line, 4, 0);
+  write_text(ok);
+  write_text("<Idle");
+  frame_flush_ack();
+  write_text(">\r\n");
+  write_text("<Al");
+  frame_init();
+  decode_tx();
+  CHECK(n_rx_frames == 5);
+  CHECK(rx_frames[0][0] == FRAME_OP_TEXT && rx_frame_len[0] == 9);
+  CHECK(memcmp(&rx_frames[0][1], ok, 6) == 0);
+  CHECK(rx_frames[1][0] == FRAME_OP_TEXT && rx_frame_len[1] == 8);
+  CHECK(memcmp(&rx_frames[1][1], "<Idle", 5) == 0);
+  CHECK(rx_frames[2][0] == FRAME_OP_ACK && rx_frames[2][1] == 0);
+  CHECK(rx_frames[3][0] == FRAME_OP_TEXT && rx_frame_len[3] == 6);
+  CHECK(memcmp(&rx_frames[3][1], ">\r\n", 3) == 0);
+  CHECK(rx_frames[4][0] == FRAME_OP_TEXT && rx_frame_len[4] == 6);
+  CHECK(!frame_mode);
+
+  // Back in ASCII, nothing more is framed.
+  tx_len = 0;
+  frame_init();
+  CHECK(tx_len == 0);
+}
+
+int main()
+{
+  test_crc_check_value();
+  test_move_with_reserved_bytes();
+  test_bad_crc_nak();
+  test_lost_escape();
+  test_report_between_frames();
+  return test_result("frame");
+}
@@ -1,3 +1,5 @@
+// The generic queue the firmware used before ring.h. See gqueue.h.
+
 #include <gqueue.h>
 
 void queue_enqueue(volatile void *q, const void *elt)
@@ -1,3 +1,6 @@
+// The generic queue the firmware used before ring.h, unchanged but for this note. Kept only as
+// the baseline of ring_bench.
+
 #ifndef _QUEUE_H_
 #define _QUEUE_H_
 
@@ -0,0 +1,146 @@
+/*
+  plan_arc.c - arc block setup of the planner
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The planner module is included whole, to reach plan_arc_setup().
+#include "../../planner.c"
+#include "tests.h"
+
+#ifndef NATIVE_ARCS
+  #error "Build with NATIVE_ARCS"
+#endif
+
+#define NEAR(a,b) (fabs((a)-(b)) < 1e-4*(1.0+fabs(b)))
+
+typedef struct {
+  plan_block_t block;
+  float unit_vec[N_AXIS];
+  float tangent[2][N_AXIS];
+} arc_setup_t;
+
+// Sets up an arc block from start to target about the center, as plan_buffer_block() does.
+static void setup_arc(arc_setup_t *s, const float *start, const float *target, const float *center,
+                      float angular_travel, uint8_t axis_0, uint8_t axis_1)
+{
+  float offset[N_AXIS];
+  plan_arc_t arc = { offset, angular_travel, axis_0, axis_1 };
+  uint8_t idx;
+  memset(s, 0, sizeof(arc_setup_t));
+  for (idx=0; idx<N_AXIS; idx++) {
+    offset[idx] = center[idx]-start[idx];
+    s->unit_vec[idx] = target[idx]-start[idx];
+  }
+  s->block.rapid_rate = SOME_LARGE_VALUE;
+  plan_arc_setup(&s->block, &arc, s->unit_vec, s->tangent);
+}
+
+static float norm(const float *vec)
+{
+  float sum = 0.0;
+  uint8_t idx;
+  for (idx=0; idx<N_AXIS; idx++) { sum += vec[idx]*vec[idx]; }
+  return sqrt(sum);
+}
+
+// Quarter turn counter-clockwise in XY, from (10,0) to (0,10) about the origin.
+static void test_quarter_ccw()
+{
+  const float start[N_AXIS] = { 10.0, 0.0, 0.0, 0.0 };
+  const float target[N_AXIS] = { 0.0, 10.0, 0.0, 0.0 };
+  const float center[N_AXIS] = { 0.0, 0.0, 0.0, 0.0 };
+  arc_setup_t s;
+  test_init_machine();
+  setup_arc(&s, start, target, center, M_PI/2, X_AXIS, Y_AXIS);
+
+  float mm = 10.0*M_PI/2;
+  CHECK(NEAR(s.block.millimeters, mm));
+  CHECK(s.block.step_event_count == (uint32_t)ceil(mm*TEST_STEPS_PER_MM));
+  CHECK(s.block.flags & PL_FLAG_ARC);
+  CHECK(s.block.arc_vec[0] == 10.0 && s.block.arc_vec[1] == 0.0);
+  CHECK(s.block.arc_angle == (float)(M_PI/2));
+  CHECK(s.block.arc_axes == (X_AXIS | (Y_AXIS << 4)));
+  // Leaves heading +Y, arrives heading -X.
+  CHECK(NEAR(s.tangent[0][X_AXIS], 0.0) && NEAR(s.tangent[0][Y_AXIS], 1.0));
+  CHECK(NEAR(s.tangent[1][X_AXIS], -1.0) && NEAR(s.tangent[1][Y_AXIS], 0.0));
+  // Both plane axes take the full plane path for the axis limits.
+  CHECK(NEAR(s.unit_vec[X_AXIS], mm) && NEAR(s.unit_vec[Y_AXIS], mm));
+  CHECK(s.unit_vec[Z_AXIS] == 0.0 && s.unit_vec[C_AXIS] == 0.0);
+  // Centripetal limit v^2/r within the axis acceleration.
+  CHECK(NEAR(s.block.rapid_rate, sqrt(TEST_ACCELERATION*10.0)));
+}
+
+// Clockwise half turn in YZ with X travelling along, like a helix.
+static void test_helix_cw()
+{
+  const float start[N_AXIS] = { 1.0, 5.0, 0.0, 0.0 };
+  const float target[N_AXIS] = { 4.0, -5.0, 0.0, 0.0 };
+  const float center[N_AXIS] = { 0.0, 0.0, 0.0, 0.0 };
+  arc_setup_t s;
+  test_init_machine();
+  settings.steps_per_mm[Z_AXIS] = 2*TEST_STEPS_PER_MM; // Only counts when Z moves.
+  settings.steps_per_mm[X_AXIS] = 4*TEST_STEPS_PER_MM;
+  setup_arc(&s, start, target, center, -M_PI, Y_AXIS, Z_AXIS);
+
+  float plane_mm = 5.0*M_PI;
+  float mm = sqrt(plane_mm*plane_mm + 3.0*3.0);
+  CHECK(NEAR(s.block.millimeters, mm));
+  CHECK(s.block.step_event_count == (uint32_t)ceil(mm*4*TEST_STEPS_PER_MM));
+  CHECK(s.block.arc_axes == (Y_AXIS | (Z_AXIS << 4)));
+  CHECK(s.block.arc_angle == (float)-M_PI);
+  // From the top of the circle, clockwise in YZ heads -Z. X climbs evenly along the path.
+  CHECK(NEAR(s.tangent[0][Y_AXIS], 0.0) && NEAR(s.tangent[0][Z_AXIS], -plane_mm/mm));
+  CHECK(NEAR(s.tangent[1][Y_AXIS], 0.0) && NEAR(s.tangent[1][Z_AXIS], plane_mm/mm));
+  CHECK(NEAR(s.tangent[0][X_AXIS], 3.0/mm) && NEAR(s.tangent[1][X_AXIS], 3.0/mm));
+  CHECK(NEAR(norm(s.tangent[0]), 1.0) && NEAR(norm(s.tangent[1]), 1.0));
+  CHECK(NEAR(s.unit_vec[X_AXIS], 3.0));
+}
+
+// A full circle ends where it starts, but still has a path.
+static void test_full_circle()
+{
+  const float start[N_AXIS] = { 2.0, 0.0, 0.0, 0.0 };
+  const float center[N_AXIS] = { 0.0, 0.0, 0.0, 0.0 };
+  arc_setup_t s;
+  test_init_machine();
+  setup_arc(&s, start, start, center, 2*M_PI, X_AXIS, Y_AXIS);
+  CHECK(NEAR(s.block.millimeters, 4.0*M_PI));
+  CHECK(s.block.step_event_count > 0);
+  CHECK(NEAR(s.tangent[0][Y_AXIS], 1.0) && NEAR(s.tangent[1][Y_AXIS], 1.0));
+}
+
+// No turn and no other travel is a zero-length block, which the caller drops.
+static void test_zero_length()
+{
+  const float start[N_AXIS] = { 2.0, 0.0, 0.0, 0.0 };
+  const float center[N_AXIS] = { 0.0, 0.0, 0.0, 0.0 };
+  arc_setup_t s;
+  test_init_machine();
+  setup_arc(&s, start, start, center, 0.0, X_AXIS, Y_AXIS);
+  CHECK(s.block.millimeters == 0.0);
+  CHECK(s.block.step_event_count == 0);
+  CHECK(!(s.block.flags & PL_FLAG_ARC));
+}
+
+int main()
+{
+  test_quarter_ccw();
+  test_helix_cw();
+  test_full_circle();
+  test_zero_length();
+  return test_result("plan_arc");
+}
@@ -0,0 +1,172 @@
+/*
+  plan_spill.c - planner look-ahead past the block buffer, in the SPI SRAM spill ring
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The planner module is included whole, to reach the spill ring state.
+#include "../../planner.c"
+#include "tests.h"
+
+#ifndef PLANNER_SPILL_SIZE
+  #error "Build with PLANNER_SPILL_SIZE"
+#endif
+
+#define NEAR(a,b) (fabs((a)-(b)) < 1e-4*(1.0+fabs(b)))
+#define PLAN_CAPACITY (BLOCK_BUFFER_SIZE-1+PLANNER_SPILL_SIZE)
+
+// A zigzag of short lines of varying length and feed rate, so the junctions and the nominal
+// speeds both limit the plan. Line n ends at path_point(n).
+static void path_point(uint16_t n, float *point)
+{
+  memset(point, 0, N_AXIS*sizeof(float));
+  point[X_AXIS] = 0.5*n + 0.1*(n % 7);
+  point[Y_AXIS] = (n & 1) ? 0.3 : 0.0;
+}
+
+static float path_feed_rate(uint16_t n)
+{
+  return 1000.0 + 500.0*(n % 5);
+}
+
+static void plan_path_line(uint16_t n)
+{
+  float target[N_AXIS];
+  path_point(n, target);
+  plan_buffer_line(target, path_feed_rate(n), false, n);
+}
+
+static void init_spill()
+{
+  test_init_machine();
+  settings.use_spi = true;
+  plan_reset();
+  plan_sync_position();
+}
+
+// Blocks as they come back through the hot window
+static plan_block_t popped[PLAN_CAPACITY];
+
+// Pops the current block, which prefetches the oldest spilled block into the hot window.
+static void pop_block(plan_block_t *block)
+{
+  plan_block_t *current = plan_get_current_block();
+  CHECK(current != NULL);
+  if (!current) { return; }
+  memcpy(block, current, sizeof(plan_block_t));
+  plan_discard_current_block();
+}
+
+// Line n came back whole, with the steps from the end of line n-1.
+static void check_line(const plan_block_t *block, uint16_t n)
+{
+  float start[N_AXIS], end[N_AXIS];
+  path_point(n-1, start);
+  path_point(n, end);
+  CHECK(block->line_number == n);
+  uint8_t idx;
+  for (idx=0; idx<N_AXIS; idx++) {
+    CHECK(block->steps[idx] == labs(lround(end[idx]*TEST_STEPS_PER_MM)-lround(start[idx]*TEST_STEPS_PER_MM)));
+  }
+}
+
+// Plans well past the block buffer. The spilled blocks come back in order and whole, and the
+// plan over all of them is the optimal one, as if the block buffer held them all.
+static void test_plan_past_block_buffer()
+{
+  const uint16_t n_lines = 3*BLOCK_BUFFER_SIZE;
+  uint16_t n;
+  init_spill();
+  for (n=1; n<=n_lines; n++) { plan_path_line(n); }
+  CHECK(plan_block_count() == n_lines);
+  CHECK(spill_count == n_lines-(BLOCK_BUFFER_SIZE-1));
+  CHECK(plan_get_block_buffer_available() == PLAN_CAPACITY-n_lines);
+  CHECK(!plan_check_full_buffer());
+
+  for (n=0; n<n_lines; n++) { pop_block(&popped[n]); }
+  CHECK(plan_get_current_block() == NULL);
+  CHECK(spill_count == 0);
+
+  // Optimal plan: the most any block can enter with and still decelerate to a stop at the end,
+  // limited by the most it can reach accelerating from rest at the start.
+  float entry[PLAN_CAPACITY];
+  float exit_sqr = 0.0;
+  for (n=n_lines; n-- > 0;) {
+    entry[n] = min(popped[n].max_entry_speed_sqr, exit_sqr + 2*popped[n].acceleration*popped[n].millimeters);
+    exit_sqr = entry[n];
+  }
+  entry[0] = 0.0;
+  for (n=1; n<n_lines; n++) {
+    entry[n] = min(entry[n], entry[n-1] + 2*popped[n-1].acceleration*popped[n-1].millimeters);
+  }
+
+  uint16_t cruising = 0;
+  for (n=0; n<n_lines; n++) {
+    check_line(&popped[n], n+1);
+    CHECK(NEAR(popped[n].entry_speed_sqr, entry[n]));
+    if (entry[n] == popped[n].max_entry_speed_sqr) { cruising++; }
+  }
+  CHECK(cruising > 0); // The look-ahead is long enough to reach the junction limits.
+}
+
+// Keeps the planner full while the stepper retires blocks, until the spill ring wrapped around
+// more than once. Every line still comes back once, in order.
+static void test_spill_ring_wrap()
+{
+  uint16_t planned = 0, done = 0;
+  plan_block_t block;
+  init_spill();
+  while (!plan_check_full_buffer()) { plan_path_line(++planned); }
+  CHECK(planned == PLAN_CAPACITY);
+  CHECK(spill_count == PLANNER_SPILL_SIZE);
+  CHECK(plan_get_block_buffer_available() == 0);
+
+  while (planned < 3*PLANNER_SPILL_SIZE) {
+    pop_block(&block);
+    check_line(&block, ++done);
+    CHECK(!plan_check_full_buffer());
+    plan_path_line(++planned);
+    CHECK(plan_check_full_buffer());
+  }
+  while (plan_get_current_block()) {
+    pop_block(&block);
+    check_line(&block, ++done);
+  }
+  CHECK(done == planned);
+  // The last block stops at the end of the path.
+  CHECK(block.entry_speed_sqr <= 2*block.acceleration*block.millimeters*(1.0+1e-4));
+}
+
+// Without SPI, the planner is limited to the block buffer and never touches the SRAM.
+static void test_spill_disabled()
+{
+  uint16_t planned = 0;
+  init_spill();
+  settings.use_spi = false;
+  plan_reset();
+  while (!plan_check_full_buffer()) { plan_path_line(++planned); }
+  CHECK(planned == BLOCK_BUFFER_SIZE-1);
+  CHECK(spill_count == 0);
+  CHECK(plan_get_block_buffer_available() == 0);
+}
+
+int main()
+{
+  test_plan_past_block_buffer();
+  test_spill_ring_wrap();
+  test_spill_disabled();
+  return test_result("plan_spill");
+}
@@ -0,0 +1,124 @@
+/*
+  prep_isr.c - segment prep run from the Timer1 compare B interrupt
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The stepper module is included whole, to see its segment buffer.
+#include "../../stepper.c"
+#include "tests.h"
+
+#ifndef SEGMENT_PREP_ISR
+  #error "Build with SEGMENT_PREP_ISR"
+#endif
+
+#define CYCLES_PER_MS (F_CPU/1000)
+
+static uint8_t segment_count()
+{
+  return (segment_buffer_head+SEGMENT_BUFFER_SIZE-segment_buffer_tail) % SEGMENT_BUFFER_SIZE;
+}
+
+static void start_move(float x, float y)
+{
+  float target[N_AXIS] = {x, y, 0.0, 0.0};
+  test_init_machine();
+  plan_reset();
+  st_reset();
+  sys.state = STATE_CYCLE;
+  SYS_EXEC = 0;
+  plan_buffer_line(target, 3000.0, false, 1);
+}
+
+// A prep interrupt with the buffer free fills it, and leaves the lock as it found it.
+static void test_fills_buffer()
+{
+  start_move(20.0, 10.0);
+  interrupt_TIMER1_COMPB_vect();
+  CHECK(segment_count() == SEGMENT_BUFFER_SIZE-1);
+  CHECK(st_prep_locked == 0);
+}
+
+// The main program holds the prep off while it changes the planner.
+static void test_skips_when_locked()
+{
+  start_move(20.0, 10.0);
+  ST_PREP_LOCK();
+  interrupt_TIMER1_COMPB_vect();
+  CHECK(segment_count() == 0);
+  CHECK(st_prep_locked == 1);
+  ST_PREP_UNLOCK();
+}
+
+// A prep compare arriving during a step tick must not nest in it.
+static void test_skips_inside_step_tick()
+{
+  start_move(20.0, 10.0);
+  busy = true;
+  interrupt_TIMER1_COMPB_vect();
+  CHECK(segment_count() == 0);
+  CHECK(st_prep_locked == 0);
+  busy = false;
+}
+
+// Runs a move with the segment buffer topped up by the prep interrupt alone, once per
+// millisecond of step timer cycles, as on the machine. The real-time position must track the
+// steps, though completed segments reach sys.position only when the prep folds them.
+static void test_runs_move_from_timer()
+{
+  uint32_t cycles = 0;
+  uint32_t next_prep = 0;
+  uint32_t ticks = 0;
+  int32_t position[N_AXIS];
+  int32_t last_x = 0;
+  uint8_t monotonic = true;
+
+  start_move(40.0, -15.0);
+  interrupt_TIMER1_COMPB_vect();
+  st_wake_up();
+
+  while (!(SYS_EXEC & EXEC_CYCLE_STOP) && ticks < 10000000) {
+    if (cycles >= next_prep) {
+      interrupt_TIMER1_COMPB_vect();
+      next_prep += CYCLES_PER_MS;
+    }
+    interrupt_TIMER4_COMPA_vect();
+    cycles += OCR4A;
+    ticks++;
+    st_get_position(position);
+    if (position[X_AXIS] < last_x || position[X_AXIS] > (int32_t)(40.0*TEST_STEPS_PER_MM)) {
+      monotonic = false;
+    }
+    last_x = position[X_AXIS];
+  }
+
+  CHECK(SYS_EXEC & EXEC_CYCLE_STOP);
+  CHECK(monotonic);
+  CHECK(last_x == (int32_t)(40.0*TEST_STEPS_PER_MM));
+  CHECK(sys.position[X_AXIS] == (int32_t)(40.0*TEST_STEPS_PER_MM));
+  CHECK(sys.position[Y_AXIS] == (int32_t)(-15.0*TEST_STEPS_PER_MM));
+  CHECK(st_underrun_count == 0);
+  CHECK(plan_get_current_block() == NULL);
+}
+
+int main()
+{
+  test_fills_buffer();
+  test_skips_when_locked();
+  test_skips_inside_step_tick();
+  test_runs_move_from_timer();
+  return test_result("prep_isr");
+}
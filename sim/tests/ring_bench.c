@@ -0,0 +1,134 @@
+/*
+  ring_bench.c - time of the typed rings of ring.h against the generic queue they replaced
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Fills and drains each queue the way the firmware uses it, a serial buffer of bytes and the
+// magazine edge events, checking is_full() and is_empty() around every put and get. Prints the
+// best time of one put plus one get over BENCH_RUNS, in nsec.
+// NOTE: Host times. The AVR has no divider, so queue_get_len() costs far more there.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "../../ring.h"
+#include "gqueue.h"
+
+#define BENCH_RUNS 2000
+#define BENCH_ITEMS 200 // Per fill and drain. Fits both queues.
+
+struct edge_event {
+  bool state;
+  int32_t position;
+  uint32_t time;
+};
+
+RING_DECLARE(byte_ring, uint8_t, 256);
+RING_DECLARE(edge_ring, struct edge_event, 256);
+DECLARE_QUEUE(byte_queue, uint8_t, 255);
+DECLARE_QUEUE(edge_queue, struct edge_event, 255);
+
+static volatile uint32_t sink; // Keeps the drained items live
+
+static double now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return(ts.tv_sec*1e9 + ts.tv_nsec);
+}
+
+static void byte_ring_run()
+{
+  uint32_t sum = 0;
+  uint16_t i;
+  for (i = 0; i < BENCH_ITEMS; i++) {
+    if (!byte_ring_is_full()) { byte_ring_put((uint8_t)i); }
+  }
+  while (!byte_ring_is_empty()) { sum += byte_ring_get(); }
+  sink = sum;
+}
+
+static void byte_queue_run()
+{
+  uint32_t sum = 0;
+  uint16_t i;
+  for (i = 0; i < BENCH_ITEMS; i++) {
+    uint8_t data = i;
+    if (!queue_is_full(&byte_queue)) { queue_enqueue(&byte_queue, &data); }
+  }
+  while (!queue_is_empty(&byte_queue)) {
+    uint8_t data;
+    queue_dequeue(&byte_queue, &data);
+    sum += data;
+  }
+  sink = sum;
+}
+
+static void edge_ring_run()
+{
+  uint32_t sum = 0;
+  uint16_t i;
+  for (i = 0; i < BENCH_ITEMS; i++) {
+    struct edge_event event = { i & 1, i, i };
+    if (!edge_ring_is_full()) { edge_ring_put(event); }
+  }
+  while (!edge_ring_is_empty()) { sum += edge_ring_get().position; }
+  sink = sum;
+}
+
+static void edge_queue_run()
+{
+  uint32_t sum = 0;
+  uint16_t i;
+  for (i = 0; i < BENCH_ITEMS; i++) {
+    struct edge_event event = { i & 1, i, i };
+    if (!queue_is_full(&edge_queue)) { queue_enqueue(&edge_queue, &event); }
+  }
+  while (!queue_is_empty(&edge_queue)) {
+    struct edge_event event;
+    queue_dequeue(&edge_queue, &event);
+    sum += event.position;
+  }
+  sink = sum;
+}
+
+static void bench(const char *name, void (*run)())
+{
+  double best = 1e30;
+  uint16_t n;
+  for (n = 0; n < BENCH_RUNS; n++) {
+    double start = now_ns();
+    run();
+    double time = now_ns() - start;
+    if (time < best) { best = time; }
+  }
+  printf("%-10s %6.2f nsec per put and get\n", name, best/BENCH_ITEMS);
+}
+
+int main()
+{
+  byte_ring_init();
+  edge_ring_init();
+  queue_init(&byte_queue, sizeof(uint8_t), 255);
+  queue_init(&edge_queue, sizeof(struct edge_event), 255);
+
+  bench("byte ring", byte_ring_run);
+  bench("byte queue", byte_queue_run);
+  bench("edge ring", edge_ring_run);
+  bench("edge queue", edge_queue_run);
+  return(0);
+}
@@ -0,0 +1,157 @@
+/*
+  segment_prep.c - runs paths through the planner, segment generator and step ISR
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Built once with the float segment generator and once with FIXED_POINT_SEGMENT_PREP. Each
+// build prints the end position and the step timer cycles of every path, which
+// compare_segment_prep.awk checks against each other.
+
+#include "../../stepper.c"
+#include "tests.h"
+
+#define MAX_TICKS 50000000UL
+
+typedef struct {
+  float target[N_AXIS];
+  float feed_rate; // mm/min, negative for a rapid
+} test_move_t;
+
+// Queues the moves as the main program does, and steps until the cycle stops. Returns the
+// step timer cycles the path took.
+static uint64_t run_path(const char *name, const test_move_t *moves, uint16_t n_moves, float jerk)
+{
+  uint64_t cycles = 0;
+  uint32_t ticks = 0;
+  uint16_t next = 0;
+  uint8_t idx;
+
+  test_init_machine();
+  for (idx=0; idx<N_AXIS; idx++) { settings.jerk[idx] = jerk; }
+  plan_reset();
+  st_reset();
+  sys.state = STATE_CYCLE;
+  SYS_EXEC = 0;
+
+  while (next < n_moves && !plan_check_full_buffer()) {
+    plan_buffer_line((float*)moves[next].target, moves[next].feed_rate, false, next+1);
+    next++;
+  }
+  st_prep_buffer();
+  st_wake_up();
+
+  while (!(SYS_EXEC & EXEC_CYCLE_STOP) && ticks < MAX_TICKS) {
+    interrupt_TIMER4_COMPA_vect();
+    cycles += OCR4A;
+    ticks++;
+    while (next < n_moves && !plan_check_full_buffer()) {
+      plan_buffer_line((float*)moves[next].target, moves[next].feed_rate, false, next+1);
+      next++;
+    }
+    st_prep_buffer();
+  }
+
+  CHECK(SYS_EXEC & EXEC_CYCLE_STOP);
+  CHECK(next == n_moves);
+  CHECK(st_underrun_count == 0);
+  for (idx=0; idx<N_AXIS; idx++) {
+    int32_t expected = lround(moves[n_moves-1].target[idx]*TEST_STEPS_PER_MM);
+    CHECK(sys.position[idx] == expected);
+  }
+  printf("%s %ld %ld %ld %ld %llu\n", name, (long)sys.position[X_AXIS], (long)sys.position[Y_AXIS],
+         (long)sys.position[Z_AXIS], (long)sys.position[C_AXIS], (unsigned long long)cycles);
+  return cycles;
+}
+
+static const test_move_t long_line[] = {
+  {{ 120.0, 45.5, 0.0, 0.0 }, 3000.0 },
+};
+
+static const test_move_t rapids[] = {
+  {{ 50.0, 0.0, 0.0, 0.0 }, -1.0 },
+  {{ 50.0, 30.0, -10.0, 0.0 }, -1.0 },
+  {{ 0.0, 0.0, 0.0, 25.0 }, -1.0 },
+};
+
+static const test_move_t slow_line[] = {
+  {{ 2.0, -0.7, 0.3, 0.0 }, 10.0 },
+};
+
+// The limit stop mask holds its axes in every step ISR variant, also when a check is armed with
+// the steppers already running.
+static void test_stop_mask()
+{
+  float target[N_AXIS] = { 2.0, 1.0, 0.0, 0.0 };
+  uint8_t outbits = 0;
+  uint32_t ticks = 0;
+
+  test_init_machine();
+  plan_reset();
+  st_reset();
+  sys.state = STATE_CYCLE;
+  SYS_EXEC = 0;
+  plan_buffer_line(target, 1000.0, false, 1);
+  st_prep_buffer();
+  limits.stop_mask = bit(X_AXIS);
+  st_wake_up();
+  CHECK(st.isr_variant == ST_ISR_CYCLE);
+
+  while (!(SYS_EXEC & EXEC_CYCLE_STOP) && ticks < MAX_TICKS) {
+    if (ticks == 100) {
+      limits.mag_gap_check = true;
+      st_select_isr_variant();
+      CHECK(st.isr_variant == ST_ISR_MAG_GAP);
+    }
+    interrupt_TIMER4_COMPA_vect();
+    outbits |= st.step_outbits ^ settings.step_invert_mask;
+    ticks++;
+    st_prep_buffer();
+  }
+  CHECK(!(outbits & bit(X_STEP_BIT)));
+  CHECK(outbits & bit(Y_STEP_BIT));
+  limits.stop_mask = 0;
+  limits.mag_gap_check = false;
+}
+
+// A dense profile of short moves, like a key cut.
+#define ZIGZAG_MOVES 200
+static test_move_t zigzag[ZIGZAG_MOVES];
+
+int main()
+{
+  uint16_t idx;
+  for (idx=0; idx<ZIGZAG_MOVES; idx++) {
+    zigzag[idx].target[X_AXIS] = 0.25*(idx+1);
+    zigzag[idx].target[Y_AXIS] = (idx & 1) ? 0.05 : 0.0;
+    zigzag[idx].target[Z_AXIS] = -0.01*(idx/10);
+    zigzag[idx].target[C_AXIS] = 0.0;
+    zigzag[idx].feed_rate = 1500.0;
+  }
+
+  run_path("long_line", long_line, 1, 0.0);
+  run_path("long_line_jerk", long_line, 1, 50000.0*60*60*60);
+  run_path("rapids", rapids, 3, 0.0);
+  run_path("slow_line", slow_line, 1, 0.0);
+  run_path("zigzag", zigzag, ZIGZAG_MOVES, 0.0);
+  run_path("zigzag_jerk", zigzag, ZIGZAG_MOVES, 50000.0*60*60*60);
+  test_stop_mask();
+  #ifdef FIXED_POINT_SEGMENT_PREP
+    return test_result("segment_prep_fixed");
+  #else
+    return test_result("segment_prep_float");
+  #endif
+}
@@ -0,0 +1,179 @@
+/*
+  serial_tx.c - held back status reports of the serial write path
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The serial module is included whole, to reach its write buffer.
+#include "../../serial.c"
+#include "tests.h"
+
+uint8_t frame_mode;
+void frame_write(uint8_t data) {}
+void mc_reset() {}
+void sram_write_byte(uint16_t addr, uint8_t val) { sram_write(addr, &val, 1); }
+
+// Bytes sent on the serial link
+static uint8_t out[1024];
+static uint16_t out_len;
+
+static void link_send_byte()
+{
+  if (tx_buf_is_empty()) { return; }
+  uint8_t data = tx_buf_get();
+  if (out_len < sizeof(out)) { out[out_len++] = data; }
+}
+
+// Output waits on the link here. One byte goes out per call.
+void st_prep_buffer() { link_send_byte(); }
+
+static void link_drain()
+{
+  while (!tx_buf_is_empty()) { link_send_byte(); }
+}
+
+static void reset()
+{
+  tx_buf_init();
+  memset(&tx_report, 0, sizeof(tx_report));
+  tx_line_open = false;
+  checksum = 0;
+  serial_tx_dropped_bytes = 0;
+  out_len = 0;
+}
+
+static void write_line(const char *s)
+{
+  while (*s) { serial_write(*s++); }
+}
+
+static void write_report(const char *s, uint8_t droppable)
+{
+  serial_report_begin();
+  write_line(s);
+  serial_report_end(droppable);
+}
+
+// Expects the line and its checksum at *pos in the output, and moves past them.
+static void check_line(uint16_t *pos, const char *s)
+{
+  uint8_t sum = 0;
+  uint16_t len = strlen(s);
+  CHECK(*pos+len+1 <= out_len);
+  if (*pos+len+1 > out_len) { return; }
+  CHECK(memcmp(&out[*pos], s, len) == 0);
+  while (*s) { sum += *s++; }
+  CHECK(out[*pos+len] == sum);
+  *pos += len+1;
+}
+
+// A long response without room to spare. The first status report waits for room, and the next
+// one replaces it. Neither waits on the link.
+static void test_status_replaced()
+{
+  char response[TX_BUFFER_SIZE-20];
+  uint16_t pos = 0;
+  reset();
+  memset(response, '$', sizeof(response));
+  response[sizeof(response)-3] = '\r';
+  response[sizeof(response)-2] = '\n';
+  response[sizeof(response)-1] = 0;
+  write_line(response);
+  CHECK(out_len == 0);
+
+  write_report("<Run:1.000:200:7>\r\n", true);
+  write_report("<Run:2.000:400:7>\r\n", true);
+  CHECK(out_len == 0);
+  CHECK(serial_tx_dropped_bytes == strlen("<Run:1.000:200:7>\r\n")+1); // Checksum included
+
+  link_drain();
+  serial_tx_refill();
+  link_drain();
+  check_line(&pos, response);
+  check_line(&pos, "<Run:2.000:400:7>\r\n");
+  CHECK(pos == out_len);
+}
+
+// A status report with a new line number is never dropped. It goes out before the next one.
+static void test_line_report_kept()
+{
+  char response[TX_BUFFER_SIZE-20];
+  uint16_t pos = 0;
+  reset();
+  memset(response, '$', sizeof(response));
+  response[sizeof(response)-3] = '\r';
+  response[sizeof(response)-2] = '\n';
+  response[sizeof(response)-1] = 0;
+  write_line(response);
+
+  write_report("<Run:1.000:200:7>\r\n", false);
+  write_report("<Run:2.000:400:7>\r\n", true);
+  CHECK(serial_tx_dropped_bytes == 0);
+
+  link_drain();
+  serial_tx_refill();
+  link_drain();
+  check_line(&pos, response);
+  check_line(&pos, "<Run:1.000:200:7>\r\n");
+  check_line(&pos, "<Run:2.000:400:7>\r\n");
+  CHECK(pos == out_len);
+}
+
+// A report made while a line is unfinished waits for the end of that line.
+static void test_report_between_lines()
+{
+  uint16_t pos = 0;
+  reset();
+  write_line("ok:");
+  write_report("<Idle:0.000:0:3>\r\n", true);
+  serial_tx_refill();
+  write_line("10,100\r\n");
+  serial_tx_refill();
+  link_drain();
+  check_line(&pos, "ok:10,100\r\n");
+  check_line(&pos, "<Idle:0.000:0:3>\r\n");
+  CHECK(pos == out_len);
+}
+
+// A report too long to hold back goes out whole, like any other output.
+static void test_long_report()
+{
+  char report[TX_REPORT_SIZE+20];
+  uint16_t pos = 0;
+  reset();
+  memset(report, '0', sizeof(report));
+  report[0] = '<';
+  report[sizeof(report)-4] = '>';
+  report[sizeof(report)-3] = '\r';
+  report[sizeof(report)-2] = '\n';
+  report[sizeof(report)-1] = 0;
+  write_report(report, true);
+  write_line("ok\r\n");
+  link_drain();
+  check_line(&pos, report);
+  check_line(&pos, "ok\r\n");
+  CHECK(pos == out_len);
+  CHECK(serial_tx_dropped_bytes == 0);
+}
+
+int main()
+{
+  test_status_replaced();
+  test_line_report_kept();
+  test_report_between_lines();
+  test_long_report();
+  return test_result("serial_tx");
+}
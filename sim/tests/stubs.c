@@ -0,0 +1,79 @@
+/*
+  stubs.c - firmware state and the modules the host tests leave out
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "system.h"
+#include "settings.h"
+#include "limits.h"
+#include "magazine.h"
+#include "signals.h"
+#include "sram.h"
+#include "isr_timing.h"
+#include "tests.h"
+
+int test_failures;
+
+system_t sys;
+volatile sys_flags_t sysflags;
+settings_t settings;
+limit_t limits;
+uint32_t masterclock;
+
+// The SPI SRAM, so that the planner spill runs as on the machine.
+static uint8_t sram[SRAM_SIZE];
+
+void sram_read(uint16_t addr, void * data, uint8_t len) { memcpy(data, &sram[addr], len); }
+void sram_write(uint16_t addr, const void * data, uint8_t len) { memcpy(&sram[addr], data, len); }
+
+void limits_pin_change() {}
+void magazine_pin_change() {}
+void magazine_gap_check() {}
+void signals_update_force() {}
+void isr_timing_record(uint8_t id, uint16_t start) {}
+uint16_t linenumber_insert(linenumber_t line_number) { return 0; }
+void _delay_ms(int i) {}
+void _delay_us(int i) {}
+
+int test_result(const char *name)
+{
+  if (test_failures) { printf("%s: FAILED (%d)\n", name, test_failures); }
+  else { printf("%s: ok\n", name); }
+  return test_failures ? 1 : 0;
+}
+
+void test_init_machine()
+{
+  uint8_t idx;
+  memset(&sys, 0, sizeof(sys));
+  memset((void*)&sysflags, 0, sizeof(sysflags));
+  memset(&settings, 0, sizeof(settings));
+  memset(&limits, 0, sizeof(limits));
+  for (idx=0; idx<N_AXIS; idx++) {
+    settings.steps_per_mm[idx] = TEST_STEPS_PER_MM;
+    settings.max_rate[idx] = TEST_MAX_RATE;
+    settings.acceleration[idx] = TEST_ACCELERATION;
+    settings.max_travel[idx] = -1000.0;
+  }
+  settings.pulse_microseconds = 10;
+  settings.junction_deviation = 0.01;
+  settings.arc_tolerance = 0.002;
+  settings.stepper_idle_lock_time = 255;
+  sys.f_override = 100;
+  sys.r_override = 100;
+}
@@ -0,0 +1,143 @@
+/*
+  systick.c - callback schedule of the system tick
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "systick.h"
+#include "tests.h"
+
+#define MAX_CALLS 64
+
+// Log of the callbacks in the order called, with the tick of each call.
+static char calls[MAX_CALLS];
+static uint64_t call_ticks[MAX_CALLS];
+static uint8_t n_calls;
+
+static void log_call(char name)
+{
+  if (n_calls < MAX_CALLS) {
+    calls[n_calls] = name;
+    call_ticks[n_calls] = sys_tick;
+    n_calls++;
+  }
+}
+
+static void cb_a() { log_call('a'); }
+static void cb_b() { log_call('b'); }
+static void cb_c() { log_call('c'); }
+static void cb_d() { log_call('d'); }
+static void cb_e() { log_call('e'); }
+
+static void reset()
+{
+  systick_init();
+  n_calls = 0;
+}
+
+// Advances the clock a millisecond at a time, servicing the callbacks after each.
+static void run_until(uint64_t tick)
+{
+  while (sys_tick < tick) {
+    sys_tick++;
+    systick_service_callbacks();
+  }
+}
+
+// Callbacks are called in due order, whatever the order they were registered in.
+static void test_heap_order()
+{
+  reset();
+  CHECK(systick_register_callback(50, cb_c));
+  CHECK(systick_register_callback(10, cb_a));
+  CHECK(systick_register_callback(70, cb_e));
+  CHECK(systick_register_callback(30, cb_b));
+  CHECK(systick_register_callback(60, cb_d));
+  run_until(100);
+  CHECK(n_calls == 5);
+  CHECK(memcmp(calls, "abcde", 5) == 0);
+  CHECK(call_ticks[0] == 10 && call_ticks[1] == 30 && call_ticks[2] == 50);
+  CHECK(call_ticks[3] == 60 && call_ticks[4] == 70);
+}
+
+// A full schedule refuses more callbacks, and takes them again once one is called.
+static void test_full_schedule()
+{
+  uint8_t idx;
+  reset();
+  for (idx=0; idx<32; idx++) { CHECK(systick_register_callback(100+idx, cb_a)); }
+  CHECK(!systick_register_callback(5, cb_b));
+  run_until(100);
+  CHECK(systick_register_callback(0, cb_b));
+  run_until(200);
+  CHECK(n_calls == 33);
+  CHECK(calls[0] == 'a' && calls[1] == 'b');
+}
+
+// Periodic calls keep to their period, and skip the calls missed in a stall.
+static void test_periodic_skip_after_stall()
+{
+  uint8_t idx;
+  reset();
+  CHECK(systick_register_periodic_callback(10, 10, cb_a));
+  run_until(30);
+  CHECK(n_calls == 3);
+
+  // The main program stalls for 55ms. Only one call is made for the missed ones.
+  sys_tick = 85;
+  systick_service_callbacks();
+  CHECK(n_calls == 4);
+  CHECK(call_ticks[3] == 85);
+
+  // Back on period, from the end of the stall.
+  run_until(115);
+  CHECK(n_calls == 7);
+  for (idx=4; idx<7; idx++) { CHECK(call_ticks[idx] == 85+10*(idx-3)); }
+}
+
+static void cancel_self() { log_call('s'); systick_cancel_callback(cancel_self); }
+static void cancel_other() { log_call('o'); systick_cancel_callback(cb_b); }
+
+// A periodic callback may cancel itself, or others due in the same pass, while it runs.
+static void test_cancel_while_running()
+{
+  reset();
+  CHECK(systick_register_periodic_callback(10, 5, cancel_self));
+  run_until(30);
+  CHECK(n_calls == 1);
+  CHECK(calls[0] == 's' && call_ticks[0] == 10);
+
+  // After a stall, all three are due in the same pass. cancel_other comes first.
+  CHECK(systick_register_periodic_callback(15, 10, cancel_other));
+  CHECK(systick_register_callback(18, cb_b));
+  CHECK(systick_register_periodic_callback(19, 5, cb_b));
+  sys_tick = 55;
+  systick_service_callbacks();
+  run_until(80);
+  CHECK(n_calls == 4);
+  CHECK(memcmp(calls, "sooo", 4) == 0);
+  CHECK(call_ticks[1] == 55 && call_ticks[2] == 65 && call_ticks[3] == 75);
+}
+
+int main()
+{
+  test_heap_order();
+  test_full_schedule();
+  test_periodic_skip_after_stall();
+  test_cancel_while_running();
+  return test_result("systick");
+}
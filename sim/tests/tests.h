@@ -0,0 +1,46 @@
+/*
+  tests.h - shared checks and firmware state for the host tests
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef tests_h
+#define tests_h
+
+#include <stdio.h>
+
+extern int test_failures;
+
+// Counts and prints a failed check, but carries on with the test.
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      test_failures++; \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    } \
+  } while (0)
+
+// Prints the result line and gives the exit status of the test program.
+int test_result(const char *name);
+
+// Default machine settings for the motion tests. Same for all axes.
+#define TEST_STEPS_PER_MM 200.0
+#define TEST_MAX_RATE 6000.0 // mm/min
+#define TEST_ACCELERATION (500.0*60*60) // mm/min^2
+
+// Loads the test settings and clears the system state.
+void test_init_machine();
+
+#endif
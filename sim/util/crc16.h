@@ -0,0 +1,38 @@
+/*
+  crc16.h - replacement for the avr include of the same name to provide
+  the CRC routines on the host
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef crc16_h
+#define crc16_h
+
+#include <stdint.h>
+
+// Same polynomial (0x1021) and bit order as the avr-libc version.
+static inline uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data)
+{
+  uint8_t i;
+  crc ^= (uint16_t)data << 8;
+  for (i = 0; i < 8; i++) {
+    if (crc & 0x8000) { crc = (crc << 1) ^ 0x1021; }
+    else { crc <<= 1; }
+  }
+  return crc;
+}
+
+#endif
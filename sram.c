@@ -1,6 +1,7 @@
 #include "sram.h"
 #include "spi.h"
 #include "nuts_bolts.h"
+#include "stepper.h"
 
 /* Least and most significant bytes of x, of type uint16_t */
 #define LSB(x) (x & 0x00FF)
@@ -26,25 +27,45 @@ void sram_init()
   SCS_SRAM_DDR |= (1 << SCS_SRAM_DDR_PIN);
 
   /* Set SCS pin to high. The CS for this chip is active low */
-  SCS_SRAM_PORT &= ~(1 << SCS_SRAM_PIN);
+  SCS_SRAM_PORT |= (1 << SCS_SRAM_PIN);
 
   /* SCK resting state is 0. Clock data on rising edge */
   spi_set_mode(0, 0);
 
-  sram_set_mode(BYTE_MODE);
+  /* Sequential mode lets block reads and writes run across pages.
+     Single byte accesses work the same in this mode. */
+  sram_set_mode(SEQ_MODE);
+}
+
+static void _sram_select()
+{
+  /* SCK resting state is 0. Clock data on rising edge. The SRAM
+     runs up to 20MHz, so use the fastest SPI clock, fosc/2. The
+     other SPI devices set their own, slower clock in spi_set_mode. */
+  ST_PREP_LOCK(); // Until deselected. The segment prep interrupt may prefetch from the SRAM.
+  spi_set_mode(0, 0);
+  SPCR &= ~((1 << SPR1) | (1 << SPR0));
+  SPSR |= (1 << SPI2X);
+
+  bit_false(SCS_SRAM_PORT, 1 << SCS_SRAM_PIN);
+}
+
+static void _sram_deselect()
+{
+  bit_true(SCS_SRAM_PORT, 1 << SCS_SRAM_PIN);
+  SPSR &= ~(1 << SPI2X);
+  ST_PREP_UNLOCK();
 }
 
 uint8_t _sram_transact_helper(uint8_t * data_out, uint8_t len)
 {
   /* Transacts the array data_out over SPI to the SRAM IC
      and returns the last byte received. */
-  spi_set_mode(0, 0);
-
   uint8_t data_in[len];
 
-  bit_false(SCS_SRAM_PORT, 1 << SCS_SRAM_PIN);
+  _sram_select();
   spi_transact_array(data_out, data_in, len);
-  bit_true(SCS_SRAM_PORT, 1 << SCS_SRAM_PIN);
+  _sram_deselect();
 
   return data_in[len - 1];
 
@@ -76,3 +97,23 @@ void sram_write_byte(uint16_t addr, uint8_t val)
 
   _sram_transact_helper(data_out, 4);
 }
+
+void sram_read(uint16_t addr, void * data, uint8_t len)
+{
+  uint8_t data_out[3] = {READ, MSB(addr), LSB(addr)};
+
+  _sram_select();
+  spi_write(data_out, 3);
+  spi_read((uint8_t *)data, len);
+  _sram_deselect();
+}
+
+void sram_write(uint16_t addr, const void * data, uint8_t len)
+{
+  uint8_t data_out[3] = {WRITE, MSB(addr), LSB(addr)};
+
+  _sram_select();
+  spi_write(data_out, 3);
+  spi_write((uint8_t *)data, len);
+  _sram_deselect();
+}
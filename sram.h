@@ -3,6 +3,15 @@
 
 #include "system.h"
 
+#define SRAM_SIZE 32768 // 23K256
+
+// The serial write spill takes the top of the SRAM. See serial.c.
+#ifdef TX_SPILL_SIZE
+  #define TX_SPILL_ADDRESS ((uint16_t)(SRAM_SIZE-TX_SPILL_SIZE))
+#else
+  #define TX_SPILL_ADDRESS SRAM_SIZE
+#endif
+
 enum sram_mode_e {
   BYTE_MODE = 0,
   SEQ_MODE = 1U,
@@ -16,6 +25,12 @@ uint8_t sram_read_byte(uint16_t addr);
 
 void sram_write_byte(uint16_t addr, uint8_t val);
 
+/* Block transfers of len bytes starting at addr. Requires
+   sequential mode, which sram_init() selects. */
+void sram_read(uint16_t addr, void * data, uint8_t len);
+
+void sram_write(uint16_t addr, const void * data, uint8_t len);
+
 uint8_t sram_read_mode();
 
 void sram_set_mode(enum sram_mode_e mode);
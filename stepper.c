@@ -32,6 +32,7 @@
 #include "signals.h"
 #include "nuts_bolts.h"
 #include "motor_driver.h"
+#include "isr_timing.h"
 
 // Some useful constants.
 #define DT_SEGMENT (1.0/(ACCELERATION_TICKS_PER_SECOND*60.0)) // min/segment
@@ -39,6 +40,61 @@
 #define RAMP_ACCEL 0
 #define RAMP_CRUISE 1
 #define RAMP_DECEL 2
+#define RAMP_DECEL_OVERRIDE 3
+
+#ifdef FIXED_POINT_SEGMENT_PREP
+  // Fixed-point segment generator units. Distances are tracked in 1/256 steps (Q8). Speeds are in
+  // steps per segment, accelerations in steps per segment^2 and time in segments, all scaled by
+  // 2^16 (Q16), where one segment is DT_SEGMENT long. Segment execution time and the carried
+  // partial step time are kept in CPU cycles, which is what the stepper timer needs anyway.
+  #define FXP_DIST_SHIFT 8
+  #define FXP_SHIFT 16
+  #define FXP_DIST_ONE (1UL<<FXP_DIST_SHIFT) // One step
+  #define FXP_ONE (1UL<<FXP_SHIFT) // One segment of DT_SEGMENT
+  #define REQ_STEP_INCREMENT ((uint32_t)(REQ_MM_INCREMENT_SCALAR*FXP_DIST_ONE))
+  #define CYCLES_PER_SEGMENT ((uint32_t)(F_CPU/ACCELERATION_TICKS_PER_SECOND))
+  // Product of two scaled values with the result rescaled by the given number of fraction bits.
+  #define FXP_MUL(a,b,shift) ((uint32_t)((((uint64_t)(a)*(b)) + (1UL << ((shift)-1))) >> (shift)))
+  // Time (Q16) to travel a Q8 distance at a Q16 speed.
+  #define FXP_TIME(dist,speed) ((uint32_t)(((uint64_t)(dist) << (2*FXP_SHIFT-FXP_DIST_SHIFT))/(speed)))
+
+  typedef uint32_t prep_dist_t;  // Distance from the end of the block (Q8 steps)
+  typedef uint32_t prep_steps_t; // Steps (Q8)
+  typedef uint32_t prep_speed_t; // Speed (Q16 step/segment) or acceleration (Q16 step/segment^2)
+  typedef int32_t prep_delta_t;  // Speed change (Q16 step/segment)
+  typedef uint32_t prep_time_t;  // Time (Q16 segments)
+
+  // Segment generator arithmetic. See the floating point versions.
+  #define PREP_ONE FXP_ONE
+  #define PREP_DT_SEGMENT FXP_ONE
+  #define PREP_TRAVEL(time,speed) FXP_MUL(time,speed,2*FXP_SHIFT-FXP_DIST_SHIFT)
+  #define PREP_SPEED_CHANGE(accel,time) FXP_MUL(accel,time,FXP_SHIFT)
+  #define PREP_TIME(dist,speed) FXP_TIME(dist,speed)
+  #define PREP_RATIO(a,b) ((uint32_t)(((uint64_t)(a) << FXP_SHIFT)/(b)))
+  #define PREP_SHAPE(a,b) FXP_MUL(a,b,FXP_SHIFT)
+  #define PREP_DELTA(delta,shape) ((int32_t)(((int64_t)(delta)*(shape)) >> FXP_SHIFT))
+  #define PREP_WHOLE_STEPS(n) ((uint32_t)(n) << FXP_DIST_SHIFT)
+  #define PREP_CEIL_STEPS(steps) (((steps) + (FXP_DIST_ONE-1)) >> FXP_DIST_SHIFT)
+#else
+  // Floating point segment generator units: mm, mm/min and min.
+  typedef float prep_dist_t;  // Distance from the end of the block (mm)
+  typedef float prep_steps_t; // Steps
+  typedef float prep_speed_t; // Speed (mm/min) or acceleration (mm/min^2)
+  typedef float prep_delta_t; // Speed change (mm/min)
+  typedef float prep_time_t;  // Time (min)
+
+  // Segment generator arithmetic
+  #define PREP_ONE 1.0
+  #define PREP_DT_SEGMENT DT_SEGMENT
+  #define PREP_TRAVEL(time,speed) ((time)*(speed)) // Distance traveled in a time at a speed
+  #define PREP_SPEED_CHANGE(accel,time) ((accel)*(time)) // Speed change over a time
+  #define PREP_TIME(dist,speed) ((dist)/(speed)) // Time to travel a distance at a speed
+  #define PREP_RATIO(a,b) ((a)/(b)) // Ratio of two times, below one
+  #define PREP_SHAPE(a,b) ((a)*(b)) // Product of two ratios
+  #define PREP_DELTA(delta,shape) ((delta)*(shape)) // Share of a speed change
+  #define PREP_WHOLE_STEPS(n) ((float)(n))
+  #define PREP_CEIL_STEPS(steps) ((uint32_t)ceil(steps)) // Whole steps, rounded up
+#endif
 
 static int32_t max_servo_steps;
 
@@ -85,7 +141,9 @@ typedef struct {
   #else
     uint8_t prescaler;      // Without AMASS, a prescaler is required to adjust for slow timing.
   #endif
-  uint8_t do_status;         //true for last segment of a block - used to force reporting
+  uint8_t do_status;         // Number of lines completed by this segment - used to force reporting
+  uint16_t steps[N_AXIS];    // Steps executed per axis. Tallied by the stepper ISR and added to
+                             // sys.position by st_fold_position() once the segment completes.
 } segment_t;
 static segment_t segment_buffer[SEGMENT_BUFFER_SIZE];
 
@@ -108,6 +166,8 @@ typedef struct {
   #endif
 
   uint16_t step_count;       // Steps remaining in line segment motion
+  volatile uint8_t edge_pending;  // Sensor edges deferred until the end of the current ISR tick.
+  uint8_t isr_variant;      // Step ISR body to run. See st_select_isr_variant().
   uint8_t exec_block_index; // Tracks the current st_block index. Change indicates new block.
 
   #ifdef STEP_PULSE_DELAY
@@ -122,10 +182,26 @@ static stepper_t st;
 static volatile uint8_t segment_buffer_tail;
 static uint8_t segment_buffer_head;
 static uint8_t segment_next_head;
+static uint8_t segment_fold_index; // Oldest segment completed, but not yet added to sys.position
 
 // Used to avoid ISR nesting of the "Stepper Driver Interrupt". Should never occur though.
 static volatile uint8_t busy;
 
+volatile uint16_t st_underrun_count;
+#ifdef SEGMENT_PREP_ISR
+  volatile uint8_t st_prep_locked; // Segment prep running, or held off by the main program
+#endif
+
+// Optional checks compiled into a step ISR variant. The limit stop mask is applied by all of them.
+#define ST_CHECK_FORCE   bit(0) // Force servo load cell check
+#define ST_CHECK_MAG_GAP bit(1) // Magazine gap check at the end of each segment
+
+// Step ISR variants. Each carries only the checks of the sensors armed in limits. A check still
+// tests its flag, so a variant running with a flag since cleared is slower, but never wrong.
+#define ST_ISR_CYCLE       0 // Must be zero. Limit stop mask only.
+#define ST_ISR_MAG_GAP     1 // Magazine gap checking
+#define ST_ISR_FORCE_SERVO 2 // Force servo load cell and magazine gap checking
+
 // Pointers for the step segment being prepped from the planner buffer. Accessed only by the
 // main program. Pointers may be planning segments or planner blocks ahead of what being executed.
 static plan_block_t *pl_block;     // Pointer to the planner block being prepped
@@ -136,23 +212,60 @@ static st_block_t *st_prep_block;  // Pointer to the stepper block data being pr
 typedef struct {
   uint8_t st_block_index;  // Index of stepper common data block being prepped
   uint8_t flag_partial_block;  // Flag indicating the last block completed. Time to load a new one.
+  uint8_t flag_decel_override; // Flag to enter the next block at the exit speed of the last one.
+
+  prep_steps_t steps_remaining; // Steps remaining in the current planner block
+  float step_per_mm;            // Current planner block step/millimeter conversion scalar
+  prep_dist_t req_mm_increment; // Distance of the shortest segment, a little over one step
+  prep_speed_t acceleration;    // Current planner block acceleration
+  prep_time_t dt_remainder;     // Partial step execution time carried to the next segment. In
+                                // CPU cycles with FIXED_POINT_SEGMENT_PREP.
+  #ifdef FIXED_POINT_SEGMENT_PREP
+    float mm_per_dist;          // Current planner block Q8 step/millimeter conversion scalar
+    float speed_scalar;         // Current planner block mm/min to Q16 step/segment conversion scalar
+    uint32_t cruise_carry;      // Cruise distance below Q8 carried to the next segment (Q24 steps)
+  #endif
 
-  float steps_remaining;
-  float step_per_mm;           // Current planner block step/millimeter conversion scalar
-  float req_mm_increment;
-  float dt_remainder;
-
-  uint8_t ramp_type;      // Current segment ramp state
-  float mm_complete;      // End of velocity profile from end of current planner block in (mm).
-                          // NOTE: This value must coincide with a step(no mantissa) when converted.
-  float current_speed;    // Current speed at the end of the segment buffer (mm/min)
-  float maximum_speed;    // Maximum speed of executing block. Not always nominal speed. (mm/min)
-  float exit_speed;       // Exit speed of executing block (mm/min)
-  float accelerate_until; // Acceleration ramp end measured from end of block (mm)
-  float decelerate_after; // Deceleration ramp start measured from end of block (mm)
+  uint8_t ramp_type;             // Current segment ramp state
+  prep_dist_t mm_complete;       // End of velocity profile from end of current planner block.
+                                 // NOTE: This value must coincide with a whole step.
+  prep_speed_t current_speed;    // Current speed at the end of the segment buffer
+  prep_speed_t maximum_speed;    // Maximum speed of executing block. Not always nominal speed.
+  prep_speed_t exit_speed;       // Exit speed of executing block
+  prep_dist_t accelerate_until;  // Acceleration ramp end measured from end of block
+  prep_dist_t decelerate_after;  // Deceleration ramp start measured from end of block
+
+  // S-curve ramp of a jerk limited block. Speed follows v0 + dv*(3*tau^2 - 2*tau^3) over the ramp
+  // time, with tau the fraction of ramp time elapsed.
+  uint8_t s_curve;               // Set when the current planner block is jerk limited
+  prep_dist_t ramp_start;        // Ramp start measured from end of block
+  prep_speed_t ramp_entry_speed; // Speed at ramp start, v0
+  prep_delta_t ramp_delta_speed; // Speed change over the ramp, dv. Negative when decelerating.
+  prep_time_t ramp_duration;     // Ramp time
+  prep_time_t ramp_time;         // Ramp time elapsed
+
+  #ifdef PLANNER_MERGE_MARKS
+    uint8_t merge_count;    // Merged line ends left in the current planner block
+    uint32_t merge_steps;   // Steps remaining in the block at the next merged line end
+  #endif
+  #ifdef NATIVE_ARCS
+    prep_dist_t arc_chord;  // Longest chord of the current arc block
+  #endif
 } st_prep_t;
 static st_prep_t prep;
 
+#ifdef NATIVE_ARCS
+// Arc tracing data of the prepped arc block. See st_arc_chord().
+typedef struct {
+  float vec[2];            // Radius vector at the last chord end (mm)
+  float theta;             // Angle turned to the last chord end (rad)
+  uint8_t count;           // Chords since the last exact radius vector correction
+  int32_t steps[N_AXIS];   // Steps from the block start to the last chord end
+  int32_t end[N_AXIS];     // Steps from the block start to the block end
+} st_arc_t;
+static st_arc_t st_arc;
+#endif
+
 static uint64_t st_shutdown_start;
 static uint16_t st_shutdown_delay;  //ms (max = 32767)
 
@@ -207,6 +320,16 @@ void st_disable(uint8_t disable, uint8_t mask) {
   #endif
 }
 
+// Selects the step ISR variant from the sensor checks armed in limits, not from sys.state, so it
+// holds whatever the state. Called whenever a check is armed, including while the steppers run.
+// Clearing a check needs no new variant.
+void st_select_isr_variant()
+{
+  if (limits.isservoing) { st.isr_variant = ST_ISR_FORCE_SERVO; }
+  else if (limits.mag_gap_check) { st.isr_variant = ST_ISR_MAG_GAP; }
+  else { st.isr_variant = ST_ISR_CYCLE; }
+}
+
 // Stepper state initialization. Cycle should only start if the st.cycle_start flag is
 // enabled. Startup init and limits call this function but shouldn't start the cycle.
 void st_wake_up()
@@ -220,7 +343,7 @@ void st_wake_up()
   st_stop_shutdown_timer();
 
 
-  if (sys.state & (STATE_CYCLE | STATE_HOMING | STATE_FORCESERVO | STATE_PROBING)) {
+  if (sys.state & (STATE_CYCLE | STATE_HOMING | STATE_FORCESERVO | STATE_PROBING | STATE_JOG)) {
     // Initialize stepper output bits
     st.dir_outbits = settings.dir_invert_mask;
     st.step_outbits = settings.step_invert_mask;
@@ -236,8 +359,15 @@ void st_wake_up()
       st.step_pulse_time = -(((settings.pulse_microseconds-2)*TICKS_PER_MICROSECOND) >> 3);
     #endif
 
-    // Enable Stepper Driver Interrupt
+    st_select_isr_variant();
+
+    // Enable Stepper Driver Interrupt. Limit pins are only serviced on edges, so evaluate them
+    // once as motion starts, before the first tick, to stop an axis already on its switch.
+    uint8_t sreg = SREG;
+    cli();
     TIMSK4 |= (1<<OCIE4A);
+    limits_pin_change();
+    SREG = sreg;
   }
 }
 
@@ -252,6 +382,46 @@ void st_start_shutdown_timer(void)
   st_shutdown_start = masterclock | 1; //use nearest odd number to handle rare case of mc==0
 }
 
+// Steps of a segment along an axis, signed by the direction of its stepper block.
+// NOTE: The stepper block of a segment outlives its fold. See st_fold_position().
+static int32_t st_segment_axis_steps(segment_t *segment, uint8_t idx)
+{
+  if (st_block_buffer[segment->st_block_index].direction_bits & get_direction_mask(idx)) {
+    return(-(int32_t)segment->steps[idx]);
+  }
+  return(segment->steps[idx]);
+}
+
+// Adds the steps of a segment to sys.position. Only with interrupts disabled.
+static void st_fold_segment(segment_t *segment)
+{
+  uint8_t idx;
+  for (idx=0; idx<N_AXIS; idx++) { sys.position[idx] += st_segment_axis_steps(segment, idx); }
+}
+
+/* Adds the steps of the segments completed by the stepper ISR to sys.position. The fold is left
+   to the segment prep, ahead of reusing a segment, and to st_go_idle() once motion stops, so the
+   tick ending a segment only advances the segment buffer tail. Meanwhile the position lags by the
+   completed segments, and st_get_position() adds them in.
+   The prep folds before it prepares each segment. The completed segments and the segments in the
+   buffer then never span more than the SEGMENT_BUFFER_SIZE-1 stepper blocks, so the blocks of the
+   segments not yet folded are never overwritten.
+   NOTE: Atomic per segment, so sensor edge interrupts never see a half-folded position. */
+static void st_fold_position()
+{
+  for (;;) {
+    uint8_t sreg = SREG;
+    cli();
+    if (segment_fold_index == segment_buffer_tail) {
+      SREG = sreg;
+      return;
+    }
+    st_fold_segment(&segment_buffer[segment_fold_index]);
+    if ( ++segment_fold_index == SEGMENT_BUFFER_SIZE ) { segment_fold_index = 0; }
+    SREG = sreg;
+  }
+}
+
 // Stepper shutdown
 void st_go_idle()
 {
@@ -259,6 +429,7 @@ void st_go_idle()
   TIMSK4 &= ~(1<<OCIE4A); // Disable Timer4 interrupt
   TCCR4B = (TCCR4B & ~((1<<CS42) | (1<<CS41))) | (1<<CS40); // Reset clock to no prescaling.
   busy = false;
+  st_fold_position();
 
   // Set stepper driver idle state, disabled or enabled, depending on settings and circumstances.
     // Force stepper dwell to lock axes for a defined amount of time to ensure the axes come to a complete
@@ -291,49 +462,58 @@ void st_check_disable() {
   }
 }
 
-//Called from ISR(TIMER4_COMPA_vect) - needs to be very efficient 
-void st_limit_check()
+// Returns the real-time position of an axis in steps, including the steps of the completed
+// segments not yet folded and of the executing segment. Only safe to call from the stepper ISR,
+// or with the stepper ISR otherwise blocked.
+int32_t st_get_axis_position(uint8_t idx)
 {
-  // While homing or if hard limits enabled
-
-  // Limit checking performed here
-
-  // LIMIT_PIN - Input buffer of port to which home sensors are connected
-  // limits.expected - approach set in limits.c. limits.expected stores what the pins in LIMIT_PIN
-  // should be when the axes are moving and have not reached the home sensor
-  // limits.active - active bit is set in limits.active if axis is homing
-  // If home sensor is reached in LIMIT_PIN and the pin is different than
-  // that of limits.expected and the axis is homing as set in limits.active,
-  // then set the bit for that pin in must_stop, to indicate that the corresponding
-  // axis should stop
-
-  //Disable magazine gap checking if carousel has finished homing, but other axes are still homing
-  if( !(limits.ishoming & (1 << C_AXIS)) && limits.ishoming){
-    limits.mag_gap_check = 0 ;
+  int32_t position = sys.position[idx];
+  uint8_t index = segment_fold_index;
+  while (index != segment_buffer_tail) {
+    position += st_segment_axis_steps(&segment_buffer[index], idx);
+    if ( ++index == SEGMENT_BUFFER_SIZE ) { index = 0; }
   }
-  
-  uint8_t must_stop = (( (LIMIT_PIN) ^ limits.expected) & limits.active);
-  if (must_stop) {
-    st.step_outbits &= ~(must_stop >> LIMIT_BIT_SHIFT);
-    // If an axis is done homing, clear the corresponding bit in limits.ishoming     
-    limits.ishoming &= ~(must_stop >> LIMIT_BIT_SHIFT);
-
-    if (!limits.ishoming)
-      request_report(REQUEST_STATUS_REPORT | REQUEST_LIMIT_REPORT, LINENUMBER_EMPTY_BLOCK);
-    else
-      bit_true(sys.state, STATE_HOME_ADJUST);
-
-    //if limits made but not homing , servoing, or alarmed already: critical alarm.
-    if (!(sys.state & (STATE_ALARM | STATE_HOMING)) && !(sys.state & (STATE_ALARM | STATE_FORCESERVO)) &&
-         bit_isfalse(SYS_EXEC,EXEC_ALARM)) {
-      mc_reset(); // Initiate system kill.
-      // Indicate hard limit critical event, print limits
-      sys.alarm |= ALARM_HARD_LIMIT;
-      request_report(REQUEST_LIMIT_REPORT, (EXEC_ALARM | EXEC_CRIT_EVENT));
-    }
+  if (st.exec_segment != NULL) { position += st_segment_axis_steps(st.exec_segment, idx); }
+  return(position);
+}
+
+// Copies the real-time machine position in steps. Safe to call from anywhere.
+void st_get_position(int32_t *position)
+{
+  uint8_t sreg = SREG;
+  cli(); // Keep the stepper ISR from completing a segment mid-copy.
+  uint8_t idx;
+  for (idx=0; idx<N_AXIS; idx++) { position[idx] = st_get_axis_position(idx); }
+  SREG = sreg;
+}
+
+// Returns true while the stepper ISR is enabled, i.e. from st_wake_up() until st_go_idle().
+uint8_t st_is_running()
+{
+  return (TIMSK4 & (1<<OCIE4A));
+}
+
+// Called first thing by the sensor edge interrupts. An edge that interrupts the stepper ISR may
+// catch it mid-step with the position tally half updated. In that case the edge is flagged and
+// handed back to the stepper ISR, which services it as soon as the tick's position is complete.
+// Returns true if the edge was deferred.
+uint8_t st_defer_edge(uint8_t source)
+{
+  if (busy) {
+    st.edge_pending |= source;
+    return true;
   }
+  return false;
 }
 
+// Services deferred sensor edges. Called with interrupts disabled.
+static void st_service_edges()
+{
+  uint8_t source = st.edge_pending;
+  st.edge_pending = 0;
+  if (source & EDGE_SOURCE_LIMITS) { limits_pin_change(); }
+  if (source & EDGE_SOURCE_MAGAZINE) { magazine_pin_change(); }
+}
 
 // Called from ISR(TIMER4_COMPA_vect) - needs to be very efficient 
 // This checks if the desired force value is met (typically before bumping a key).
@@ -361,11 +541,11 @@ void st_force_check()
   // Stop servoing when max gripping distance is reached, but do not throw
   // an alarm. Cutter can decide whether or not it wants to continue
   // if the desired force is not reached.
-  const bool max_reached = (sys.position[Z_AXIS] >= max_servo_steps);
+  const bool max_reached = (st_get_axis_position(Z_AXIS) >= max_servo_steps);
 
   if (positive_stop || negative_stop || max_reached) {
     limits.isservoing = 0;
-    request_report(REQUEST_STATUS_REPORT | REQUEST_LIMIT_REPORT, LINENUMBER_EMPTY_BLOCK);    
+    request_report(REQUEST_STATUS_REPORT | REQUEST_LIMIT_REPORT, 0);    
   }
 
 }
@@ -415,10 +595,26 @@ void st_force_check()
    ISR is 5usec typical and 25usec maximum, well below requirement.
    NOTE: This ISR expects at least one step to be executed per segment.
 */
-// TODO: Replace direct updating of the int32 position counters in the ISR somehow. Perhaps use smaller
-// int8 variables and update position counters only when a segment completes. This can get complicated
-// with probing and homing cycles that require true real-time positions.
-ISR(TIMER4_COMPA_vect)
+// NOTE: The ISR no longer updates the int32 position counters on every step. Steps are tallied per axis
+// in the steps[] of the executing segment, which removes the direction branch and the 32-bit
+// read-modify-write per axis step. The segment prep folds the tallies of completed segments into
+// sys.position, off the step tick, so the tick ending a segment does no more work than before.
+// Code that needs the true real-time position, such as homing, probing and force servoing, must
+// use st_get_position() instead.
+// NOTE: To measure the worst case, build with ISR_TIMING_HISTOGRAM, send $T to clear the
+// histograms, run a move stepping all four axes at their max rate, then send $T again. MAX of the
+// [ISR STEP] line is the worst case, in usec, including nested interrupts and the ~40 cycle timing
+// overhead. No before/after figures are recorded here yet; they have to be taken on the target.
+// NOTE: The body is inlined once per ISR variant with a constant check mask, so the compiler drops
+// the checks a variant does not use. Variants are keyed on the sensor checks, not on sys.state.
+// Homing and probing need none of their own: what they add to a tick, the limit stop mask and the
+// servicing of the sensor edges latched by the pin change interrupts, is in every variant.
+// NOTE: Per step, counted from the AVR instruction timings and not measured, the cycle variant
+// saves the servo flag test (lds, tst, branch: 4 cycles) and spends about as much on the variant
+// dispatch (lds, tst, branch, rjmp: 4-5 cycles) against the single body baseline. The net is
+// 0 +/- 1 cycles per step, plus the gap flag test saved once per segment. To measure it, compare
+// the [ISR STEP] MAX of $T, as above, with a build defining STEP_ISR_SINGLE_VARIANT.
+static inline __attribute__((always_inline)) void st_step_tick(const uint8_t checks)
 {
   TIME_OFF(time_STEP_ISR); // Debug: Used to time ISR
   if (busy) {  // The busy-flag is used to avoid reentering this interrupt
@@ -487,30 +683,30 @@ ISR(TIMER4_COMPA_vect)
 
 
     } else {
-      // Segment buffer empty. Shutdown.
+      // Segment buffer empty. Shutdown. With planned motion left, segment prep fell behind.
+      if ((sys.state & (STATE_CYCLE | STATE_JOG)) && (plan_get_current_block() != NULL)) {
+        st_underrun_count++;
+      }
       st_go_idle();
       bit_true(SYS_EXEC,EXEC_CYCLE_STOP); // Flag main program for cycle end
+      cli();
+      if (st.edge_pending) { st_service_edges(); }
       TIME_ON(time_STEP_ISR);
       return; // Nothing to do but exit.
     }
   }
 
-  if(settings.mag_gap_enabled) {
-   // Monitor magazine probe to look for missing magazines on carousel
-   magazine_gap_monitor();
-  }
-
   // Reset step out bits.
   st.step_outbits = 0;
 
   // Execute step displacement profile by Bresenham line algorithm
+  uint16_t *segment_steps = st.exec_segment->steps;
   st.counter_x += st.steps[X_AXIS];
 
   if (st.counter_x > st.exec_block->step_event_count) {
     st.step_outbits |= (1<<X_STEP_BIT);
     st.counter_x -= st.exec_block->step_event_count;
-    if (st.exec_block->direction_bits & (1<<X_DIRECTION_BIT)) { sys.position[X_AXIS]--; }
-    else { sys.position[X_AXIS]++; }
+    segment_steps[X_AXIS]++;
   }
 
   st.counter_y += st.steps[Y_AXIS];
@@ -518,8 +714,7 @@ ISR(TIMER4_COMPA_vect)
   if (st.counter_y > st.exec_block->step_event_count) {
     st.step_outbits |= (1<<Y_STEP_BIT);
     st.counter_y -= st.exec_block->step_event_count;
-    if (st.exec_block->direction_bits & (1<<Y_DIRECTION_BIT)) { sys.position[Y_AXIS]--; }
-    else { sys.position[Y_AXIS]++; }
+    segment_steps[Y_AXIS]++;
   }
 
   st.counter_z += st.steps[Z_AXIS];
@@ -527,8 +722,7 @@ ISR(TIMER4_COMPA_vect)
   if (st.counter_z > st.exec_block->step_event_count) {
     st.step_outbits |= (1<<Z_STEP_BIT);
     st.counter_z -= st.exec_block->step_event_count;
-    if (st.exec_block->direction_bits & (1<<Z_DIRECTION_BIT)) { sys.position[Z_AXIS]--; }
-    else { sys.position[Z_AXIS]++; }
+    segment_steps[Z_AXIS]++;
   }
 
   st.counter_c += st.steps[C_AXIS];
@@ -536,37 +730,65 @@ ISR(TIMER4_COMPA_vect)
   if (st.counter_c > st.exec_block->step_event_count) {
     st.step_outbits |= (1<<C_STEP_BIT);
     st.counter_c -= st.exec_block->step_event_count;
-    if (st.exec_block->direction_bits & (1<<C_DIRECTION_BIT)) { sys.position[C_AXIS]--; }
-    else { sys.position[C_AXIS]++; }
+    segment_steps[C_AXIS]++;
   }
 
-  st_limit_check(); //Check for limits, including homing limits
+  // Stop any axes that have reached their limit. The mask is computed by the limit pin interrupts.
+  st.step_outbits &= ~limits.stop_mask;
 
-  if (limits.isservoing) 
+  if ((checks & ST_CHECK_FORCE) && limits.isservoing) 
     st_force_check();
 
-  // Check if probe is reached, if probing
-  if (probe.isprobing)
-    probe_check();
-
-  // Used to move to carousel magazine
-  probe_carousel_monitor();
+  // The e-stop input has no pin change interrupt, so it is polled here.
+  if (ESTOP_PIN & ESTOP_MASK) {
+    sys.alarm |= ALARM_ESTOP;
+    SYS_EXEC |= (EXEC_FEED_HOLD | EXEC_ALARM | EXEC_CRIT_EVENT);
+  }
 
   st.step_count--; // Decrement step events count
   if (st.step_count == 0) {
     // Segment is complete. Discard current segment and advance segment indexing.
-    if (st.exec_segment->do_status) { request_eol_report();  }
+    if (st.exec_segment->do_status) {
+      // A segment of a merged planner block may complete several lines. Report them in turn.
+      sysflags.eol_count += st.exec_segment->do_status-1;
+      request_eol_report();
+    }
+
+    st.exec_segment = NULL; // Its steps are folded into sys.position by st_fold_position().
 
-    st.exec_segment = NULL;
+    // Look for missing magazines on the carousel. Only needs checking as often as a segment.
+    if ((checks & ST_CHECK_MAG_GAP) && limits.mag_gap_check) { magazine_gap_check(); }
     if ( ++segment_buffer_tail == SEGMENT_BUFFER_SIZE) { segment_buffer_tail = 0; }
   }
 
   st.step_outbits ^= settings.step_invert_mask;  // Apply step port invert mask
   busy = false;
+
+  // Service sensor edges which arrived during this tick, now that the position is consistent.
+  cli();
+  if (st.edge_pending) { st_service_edges(); }
   TIME_ON(time_STEP_ISR);
   return;
 }
 
+// NOTE: The recorded duration includes any interrupts nested after the sei() in the body, since
+// those count against the time budget of the tick too.
+ISR(TIMER4_COMPA_vect)
+{
+  ISR_TIMING_START();
+  #ifdef STEP_ISR_SINGLE_VARIANT
+    st_step_tick(ST_CHECK_FORCE | ST_CHECK_MAG_GAP);
+  #else
+    // NOTE: Ordered by how often each mode runs, as the dispatch tests them in turn.
+    switch (st.isr_variant) {
+      case ST_ISR_CYCLE: st_step_tick(0); break;
+      case ST_ISR_MAG_GAP: st_step_tick(ST_CHECK_MAG_GAP); break;
+      default: st_step_tick(ST_CHECK_FORCE | ST_CHECK_MAG_GAP); break; // ST_ISR_FORCE_SERVO
+    }
+  #endif
+  ISR_TIMING_STOP(ISR_TIMING_STEP); // Every exit of the body leaves interrupts disabled.
+}
+
 
 /* The Stepper Port Reset Interrupt: Timer0 OVF interrupt handles the falling edge of the step
    pulse. This should always trigger before the next Timer4 COMPA interrupt and independently
@@ -601,9 +823,19 @@ ISR(TIMER0_OVF_vect)
 // Reset and clear stepper subsystem variables
 void st_reset()
 {
+  ST_PREP_LOCK();
+
   // Initialize stepper driver idle state.
   st_go_idle();
 
+  // Keep the steps of a segment cut short, e.g. by homing or probing.
+  if (st.exec_segment != NULL) {
+    uint8_t sreg = SREG;
+    cli();
+    st_fold_segment(st.exec_segment);
+    SREG = sreg;
+  }
+
   memset(&prep, 0, sizeof(prep));
   memset(&st, 0, sizeof(st));
   st.exec_segment = NULL;
@@ -612,8 +844,10 @@ void st_reset()
   segment_buffer_tail = 0;
   segment_buffer_head = 0; // empty = tail
   segment_next_head = 1;
+  segment_fold_index = 0;
   busy = false;
 
+  ST_PREP_UNLOCK();
 }
 
 void keyme_init() 
@@ -788,24 +1022,297 @@ void stepper_init()
   #ifdef STEP_PULSE_DELAY
     TIMSK0 |= (1<<OCIE0A); // Enable Timer0 Compare Match A interrupt
   #endif
+
+  #ifdef SEGMENT_PREP_ISR
+    // Timer1 Compare B: Segment prep interrupt. Timer1 is run by the systick, which clears it
+    // every millisecond on compare A. Compare B fires halfway between.
+    OCR1B = 125;
+    TIMSK1 |= (1<<OCIE1B);
+  #endif
+
   //Setup KeyMe specific ports
   keyme_init();
 
 }
 
 
+#ifdef PLANNER_MERGE_MARKS
+// Loads the next merged line end of the prepped planner block, as the steps remaining in the
+// block once it is passed. The planner marks line ends by path length along the merged block.
+static void st_merge_load_mark()
+{
+  if (prep.merge_count) {
+    uint32_t steps = lround(pl_block->step_event_count*(plan_get_merge_mark()/pl_block->merge_length));
+    prep.merge_steps = pl_block->step_event_count - min(steps, pl_block->step_event_count);
+  }
+}
+
+// Returns the number of merged line ends passed, once the block has n_steps_remaining left.
+static uint8_t st_merge_passed(uint32_t n_steps_remaining)
+{
+  uint8_t passed = 0;
+  while (prep.merge_count && (n_steps_remaining <= prep.merge_steps)) {
+    plan_discard_merge_mark();
+    prep.merge_count--;
+    passed++;
+    st_merge_load_mark();
+  }
+  return(passed);
+}
+#endif
+
+
+#ifdef NATIVE_ARCS
+// Loads the arc of a new planner block. Returns the longest chord within the arc tolerance, the
+// same length mc_arc() chops arcs into, in (mm).
+static float st_arc_load()
+{
+  uint8_t idx;
+  for (idx=0; idx<N_AXIS; idx++) {
+    st_arc.steps[idx] = 0;
+    st_arc.end[idx] = pl_block->steps[idx];
+    if (pl_block->direction_bits & get_direction_mask(idx)) { st_arc.end[idx] = -st_arc.end[idx]; }
+  }
+  st_arc.vec[0] = pl_block->arc_vec[0];
+  st_arc.vec[1] = pl_block->arc_vec[1];
+  st_arc.theta = 0.0;
+  st_arc.count = 0;
+  float radius = sqrt(st_arc.vec[0]*st_arc.vec[0] + st_arc.vec[1]*st_arc.vec[1]);
+  float chord_sqr = settings.arc_tolerance*(2*radius - settings.arc_tolerance);
+  if (chord_sqr <= 0.0) { return(2*radius); } // Tolerance beyond the arc. Any chord will do.
+  return(2*sqrt(chord_sqr));
+}
+
+/* Prepares the stepper block of the next arc segment, a chord from the last chord end to the
+   arc point at the given share of the block remaining, and returns the chord step events. Each
+   arc segment runs its own chord, so the segment is pointed to a stepper block of its own.
+   The radius vector is turned by the angle since the last chord end, with the same small angle
+   approximation and N_ARC_CORRECTION exact correction mc_arc() uses, and the last chord of the
+   arc always ends exactly on the block target.
+   Chord ends are rounded to whole steps from the block start, so the round-off never adds up.
+   NOTE: A chord without steps, possible when crawling, is run as a single idle step event. */
+static uint16_t st_arc_chord(segment_t *prep_segment, float remaining)
+{
+  int32_t target[N_AXIS];
+  uint8_t axis_0 = pl_block->arc_axes & 0x0f;
+  uint8_t axis_1 = pl_block->arc_axes >> 4;
+  uint8_t idx;
+  if (remaining > 0.0) {
+    float theta = pl_block->arc_angle*(1.0-remaining);
+    if (st_arc.count < N_ARC_CORRECTION) {
+      float theta_per_segment = theta-st_arc.theta;
+      float cos_T = 2.0 - theta_per_segment*theta_per_segment;
+      float sin_T = theta_per_segment*0.16666667*(cos_T + 4.0);
+      cos_T *= 0.5;
+      float r_axisi = st_arc.vec[0]*sin_T + st_arc.vec[1]*cos_T;
+      st_arc.vec[0] = st_arc.vec[0]*cos_T - st_arc.vec[1]*sin_T;
+      st_arc.vec[1] = r_axisi;
+      st_arc.count++;
+    } else {
+      float cos_Ti = cos(theta);
+      float sin_Ti = sin(theta);
+      st_arc.vec[0] = pl_block->arc_vec[0]*cos_Ti - pl_block->arc_vec[1]*sin_Ti;
+      st_arc.vec[1] = pl_block->arc_vec[0]*sin_Ti + pl_block->arc_vec[1]*cos_Ti;
+      st_arc.count = 0;
+    }
+    st_arc.theta = theta;
+    for (idx=0; idx<N_AXIS; idx++) { target[idx] = lround(st_arc.end[idx]*(1.0-remaining)); }
+    target[axis_0] = lround((st_arc.vec[0]-pl_block->arc_vec[0])*settings.steps_per_mm[axis_0]);
+    target[axis_1] = lround((st_arc.vec[1]-pl_block->arc_vec[1])*settings.steps_per_mm[axis_1]);
+  } else {
+    memcpy(target, st_arc.end, sizeof(target));
+  }
+
+  if ( ++prep.st_block_index == (SEGMENT_BUFFER_SIZE-1) ) { prep.st_block_index = 0; }
+  prep_segment->st_block_index = prep.st_block_index;
+  st_prep_block = &st_block_buffer[prep.st_block_index];
+  st_prep_block->direction_bits = 0;
+  uint32_t step_event_count = 1;
+  for (idx=0; idx<N_AXIS; idx++) {
+    int32_t steps = target[idx]-st_arc.steps[idx];
+    if (steps < 0) {
+      st_prep_block->direction_bits |= get_direction_mask(idx);
+      steps = -steps;
+    }
+    st_prep_block->steps[idx] = steps;
+    step_event_count = max(step_event_count, (uint32_t)steps);
+    st_arc.steps[idx] = target[idx];
+  }
+  #ifndef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+    st_prep_block->step_event_count = step_event_count;
+  #else
+    for (idx=0; idx<N_AXIS; idx++) { st_prep_block->steps[idx] <<= MAX_AMASS_LEVEL; }
+    st_prep_block->step_event_count = step_event_count << MAX_AMASS_LEVEL;
+  #endif
+  return(step_event_count);
+}
+#endif
+
+
+/* Unit conversions of the segment generator. Profiles are computed from the planner's float
+   block data in mm and mm/min, once per block load or re-plan, and then converted. Everything
+   computed per segment is in the generator's own units, integer with FIXED_POINT_SEGMENT_PREP.
+*/
+#ifdef FIXED_POINT_SEGMENT_PREP
+// Sets the conversions of a new planner block.
+static void st_prep_load_units()
+{
+  prep.req_mm_increment = REQ_STEP_INCREMENT;
+  prep.mm_per_dist = 1.0/(prep.step_per_mm*FXP_DIST_ONE);
+  prep.speed_scalar = prep.step_per_mm*(DT_SEGMENT*FXP_ONE);
+  prep.acceleration = pl_block->acceleration*prep.speed_scalar*DT_SEGMENT;
+  prep.cruise_carry = 0;
+}
+
+// Distance from the end of the block, from mm. Rounding never puts it past the block start.
+static prep_dist_t st_prep_dist(float mm)
+{
+  float dist = mm*(prep.step_per_mm*FXP_DIST_ONE);
+  if (dist <= 0.0) { return(0); }
+  if (dist >= prep.steps_remaining) { return(prep.steps_remaining); }
+  return(dist);
+}
+
+// Remaining distance of the block in mm, for the planner.
+static float st_prep_mm(prep_dist_t dist) { return(dist*prep.mm_per_dist); }
+
+static prep_speed_t st_prep_speed(float speed) { return(prep.speed_scalar*speed); }
+
+// Speed in mm/min, for the planner.
+static float st_planner_speed(prep_speed_t speed)
+{
+  if (speed) { return(speed/prep.speed_scalar); }
+  return(0.0);
+}
+
+// Distance remaining in the block at the start of the segment.
+static prep_dist_t st_prep_block_dist() { return(prep.steps_remaining); }
+
+// Steps remaining in the block at a distance from its end.
+static prep_steps_t st_prep_steps(prep_dist_t dist) { return(dist); }
+
+// Cruise distance over time_var at the maximum speed.
+// NOTE: The cruise distance repeats every segment, and so would its round-off, which is over
+// 0.5% at slow feeds. The part below Q8 is carried instead.
+static prep_dist_t st_cruise_travel(prep_time_t time_var)
+{
+  uint64_t cruise_dist = (uint64_t)prep.maximum_speed*time_var + prep.cruise_carry; // (Q24 steps)
+  prep.cruise_carry = cruise_dist & ((1UL << (2*FXP_SHIFT-FXP_DIST_SHIFT))-1);
+  return(cruise_dist >> (2*FXP_SHIFT-FXP_DIST_SHIFT));
+}
+
+// Returns the CPU cycles per step of a segment running step_dist over dt, and carries the time
+// of the partial step at its end to the next segment.
+// NOTE: Segments longer than 2^24 cycles (~1sec @ 16MHz) are simply run at the slowest rate.
+static uint32_t st_segment_cycles(prep_time_t dt, prep_steps_t step_dist, prep_steps_t partial_dist)
+{
+  uint32_t cycles;
+  uint32_t dt_cycles = FXP_MUL(dt, CYCLES_PER_SEGMENT, FXP_SHIFT) + prep.dt_remainder;
+  if (dt_cycles < (1UL << (32-FXP_DIST_SHIFT))) {
+    cycles = ((dt_cycles << FXP_DIST_SHIFT) + (step_dist-1))/step_dist; // (cycles/step)
+    prep.dt_remainder = (partial_dist*cycles) >> FXP_DIST_SHIFT;
+  } else {
+    cycles = 0xffffffff;
+    prep.dt_remainder = 0;
+  }
+  return(cycles);
+}
+
+#else
+
+static void st_prep_load_units()
+{
+  prep.req_mm_increment = REQ_MM_INCREMENT_SCALAR/prep.step_per_mm;
+  prep.acceleration = pl_block->acceleration;
+}
+
+static prep_dist_t st_prep_dist(float mm) { return(mm); }
+static float st_prep_mm(prep_dist_t dist) { return(dist); }
+static prep_speed_t st_prep_speed(float speed) { return(speed); }
+static float st_planner_speed(prep_speed_t speed) { return(speed); }
+static prep_dist_t st_prep_block_dist() { return(pl_block->millimeters); }
+
+// NOTE: Steps are computed by direct scalar conversion of the millimeter distance remaining in
+// the block, rather than incrementally tallying the steps executed per segment. This helps in
+// removing floating point round-off issues of several additions. However, since floats have
+// only 7.2 significant digits, long moves with extremely high step counts can exceed the
+// precision of floats, which can lead to lost steps. Fortunately, this scenario is highly
+// unlikely and unrealistic in CNC machines supported by Grbl (i.e. exceeding 10 meters axis
+// travel at 200 step/mm).
+static prep_steps_t st_prep_steps(prep_dist_t dist) { return(prep.step_per_mm*dist); }
+
+static prep_dist_t st_cruise_travel(prep_time_t time_var) { return(prep.maximum_speed*time_var); }
+
+static uint32_t st_segment_cycles(prep_time_t dt, prep_steps_t step_dist, prep_steps_t partial_dist)
+{
+  float inv_rate = (dt + prep.dt_remainder)/step_dist; // Compute adjusted step rate inverse
+  prep.dt_remainder = partial_dist*inv_rate; // Update segment partial step time
+  return(ceil( (TICKS_PER_MICROSECOND*1000000*60)*inv_rate )); // (cycles/step)
+}
+#endif
+
+
+// Starts an S-curve ramp from the current speed at start_mm, reaching target_speed at end_mm. The
+// ramp time is that of a constant acceleration ramp over the same distance.
+static void st_s_curve_begin(prep_dist_t start_mm, prep_dist_t end_mm, prep_speed_t target_speed)
+{
+  prep_speed_t speed_sum = prep.current_speed+target_speed;
+  prep.ramp_start = start_mm;
+  prep.ramp_entry_speed = prep.current_speed;
+  prep.ramp_delta_speed = (prep_delta_t)target_speed-(prep_delta_t)prep.current_speed;
+  prep.ramp_time = 0;
+  if (speed_sum > 0) { prep.ramp_duration = PREP_TIME(2*(start_mm-end_mm), speed_sum); }
+  else { prep.ramp_duration = 0; }
+}
+
+
+// Advances the S-curve ramp by time_var, updating the current speed and the distance remaining.
+// Returns false, without advancing, if the ramp ends at end_mm within time_var.
+static uint8_t st_s_curve_advance(prep_time_t time_var, prep_dist_t end_mm, prep_dist_t *mm_remaining)
+{
+  prep_time_t t = prep.ramp_time+time_var;
+  if (t >= prep.ramp_duration) { return(false); }
+  prep_time_t tau = PREP_RATIO(t, prep.ramp_duration);
+  prep_time_t tau_sqr = PREP_SHAPE(tau, tau);
+  // Distance is the integral of the speed: v0*t + dv*t*(tau^2 - tau^3/2)
+  prep_speed_t avg_speed = prep.ramp_entry_speed +
+                           PREP_DELTA(prep.ramp_delta_speed, PREP_SHAPE(tau_sqr, PREP_ONE-tau/2));
+  prep_dist_t mm_var = PREP_TRAVEL(t, avg_speed);
+  if (prep.ramp_start <= end_mm + mm_var) { return(false); } // Round-off at the very end of the ramp.
+  *mm_remaining = prep.ramp_start-mm_var;
+  prep.current_speed = prep.ramp_entry_speed +
+                       PREP_DELTA(prep.ramp_delta_speed, PREP_SHAPE(tau_sqr, 3*PREP_ONE-2*tau));
+  prep.ramp_time = t;
+  return(true);
+}
+
+
 // Called by planner_recalculate() when the executing block is updated by the new plan.
 void st_update_plan_block_parameters()
 {
   if (pl_block != NULL) { // Ignore if at start of a new block.
     prep.flag_partial_block = true;
-    pl_block->entry_speed_sqr = prep.current_speed*prep.current_speed; // Update entry speed.
+    float current_speed = st_planner_speed(prep.current_speed);
+    pl_block->entry_speed_sqr = current_speed*current_speed; // Update entry speed.
     pl_block = NULL; // Flag st_prep_segment() to load new velocity profile.
   }
 }
 
 
-/* Prepares step segment buffer. Continuously called from main program.
+// Ends the velocity profile short of the end of the block, at the end of a feed hold. The rest
+// of the block is left with whole steps, to resume from.
+static void st_prep_stop(uint32_t n_steps_remaining)
+{
+  prep.current_speed = 0;
+  prep.dt_remainder = 0;
+  prep.steps_remaining = PREP_WHOLE_STEPS(n_steps_remaining);
+  pl_block->millimeters = n_steps_remaining/prep.step_per_mm; // Update with full steps.
+  plan_cycle_reinitialize();
+  sys.state = STATE_QUEUED;
+}
+
+
+/* Prepares step segment buffer. Called through st_prep_buffer() and the segment prep interrupt.
 
    The segment buffer is an intermediary buffer interface between the execution of steps
    by the stepper algorithm and the velocity profiles generated by the planner. The stepper
@@ -816,12 +1323,17 @@ void st_update_plan_block_parameters()
    the segment buffer is sized and computed such that no operation in the main program takes
    longer than the time it takes the stepper algorithm to empty it before refilling it.
    Currently, the segment buffer conservatively holds roughly up to 40-50 msec of steps.
-   NOTE: Computation units are in steps, millimeters, and minutes.
+   NOTE: Computation units are in steps, millimeters, and minutes, or the fixed-point units
+   with FIXED_POINT_SEGMENT_PREP. Distances are measured from the end of the block and never
+   go negative, so comparisons are arranged to never underflow the unsigned fixed-point ones.
 */
-void st_prep_buffer()
+static void st_prep_segments()
 {
   while (segment_buffer_tail != segment_next_head) { // Check if we need to fill the buffer.
 
+    // Fold the completed segments before any stepper block or segment is reused.
+    st_fold_position();
+
     // Determine if we need to load a new planner block or if the block has been replanned.
     if (pl_block == NULL) {
       pl_block = plan_get_current_block(); // Query planner for a queued block
@@ -829,48 +1341,64 @@ void st_prep_buffer()
 
       // Check if the segment buffer completed the last planner block. If so, load the Bresenham
       // data for the block. If not, we are still mid-block and the velocity profile was updated.
-      if (prep.flag_partial_block) {
-        prep.flag_partial_block = false; // Reset flag
-      } else {
-        // Increment stepper common data index to store new planner block data.
-        if ( ++prep.st_block_index == (SEGMENT_BUFFER_SIZE-1) ) { prep.st_block_index = 0; }
-
-        // Prepare and copy Bresenham algorithm segment data from the new planner block, so that
-        // when the segment buffer completes the planner block, it may be discarded when the
-        // segment buffer finishes the prepped block, but the stepper ISR is still executing it.
-        st_prep_block = &st_block_buffer[prep.st_block_index];
-        st_prep_block->direction_bits = pl_block->direction_bits;
-
-        #ifndef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
-          st_prep_block->steps[X_AXIS] = pl_block->steps[X_AXIS];
-          st_prep_block->steps[Y_AXIS] = pl_block->steps[Y_AXIS];
-          st_prep_block->steps[Z_AXIS] = pl_block->steps[Z_AXIS];
-          st_prep_block->steps[C_AXIS] = pl_block->steps[C_AXIS];
-          st_prep_block->step_event_count = pl_block->step_event_count;
-        #else
-          // With AMASS enabled, simply bit-shift multiply all Bresenham data by the max AMASS
-          // level, such that we never divide beyond the original data anywhere in the algorithm.
-          // If the original data is divided, we can lose a step from integer roundoff.
-          st_prep_block->steps[X_AXIS] = pl_block->steps[X_AXIS] << MAX_AMASS_LEVEL;
-          st_prep_block->steps[Y_AXIS] = pl_block->steps[Y_AXIS] << MAX_AMASS_LEVEL;
-          st_prep_block->steps[Z_AXIS] = pl_block->steps[Z_AXIS] << MAX_AMASS_LEVEL;
-          st_prep_block->steps[C_AXIS] = pl_block->steps[C_AXIS] << MAX_AMASS_LEVEL;
-          st_prep_block->step_event_count = pl_block->step_event_count << MAX_AMASS_LEVEL;
+      // NOTE: The flag is reset once the velocity profile is computed.
+      if (!prep.flag_partial_block) {
+        #ifdef NATIVE_ARCS
+          float arc_chord = 0.0;
+          if (pl_block->flags & PL_FLAG_ARC) {
+            // Arc segments each run a chord of their own. See st_arc_chord().
+            arc_chord = st_arc_load();
+          } else
         #endif
+        {
+          // Increment stepper common data index to store new planner block data.
+          if ( ++prep.st_block_index == (SEGMENT_BUFFER_SIZE-1) ) { prep.st_block_index = 0; }
+
+          // Prepare and copy Bresenham algorithm segment data from the new planner block, so that
+          // when the segment buffer completes the planner block, it may be discarded when the
+          // segment buffer finishes the prepped block, but the stepper ISR is still executing it.
+          st_prep_block = &st_block_buffer[prep.st_block_index];
+          st_prep_block->direction_bits = pl_block->direction_bits;
+
+          #ifndef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+            st_prep_block->steps[X_AXIS] = pl_block->steps[X_AXIS];
+            st_prep_block->steps[Y_AXIS] = pl_block->steps[Y_AXIS];
+            st_prep_block->steps[Z_AXIS] = pl_block->steps[Z_AXIS];
+            st_prep_block->steps[C_AXIS] = pl_block->steps[C_AXIS];
+            st_prep_block->step_event_count = pl_block->step_event_count;
+          #else
+            // With AMASS enabled, simply bit-shift multiply all Bresenham data by the max AMASS
+            // level, such that we never divide beyond the original data anywhere in the algorithm.
+            // If the original data is divided, we can lose a step from integer roundoff.
+            st_prep_block->steps[X_AXIS] = pl_block->steps[X_AXIS] << MAX_AMASS_LEVEL;
+            st_prep_block->steps[Y_AXIS] = pl_block->steps[Y_AXIS] << MAX_AMASS_LEVEL;
+            st_prep_block->steps[Z_AXIS] = pl_block->steps[Z_AXIS] << MAX_AMASS_LEVEL;
+            st_prep_block->steps[C_AXIS] = pl_block->steps[C_AXIS] << MAX_AMASS_LEVEL;
+            st_prep_block->step_event_count = pl_block->step_event_count << MAX_AMASS_LEVEL;
+          #endif
+        }
 
-        // Initialize segment buffer data for generating the segments.
-        prep.steps_remaining = pl_block->step_event_count;
-        prep.step_per_mm = prep.steps_remaining/pl_block->millimeters;
-        prep.req_mm_increment = REQ_MM_INCREMENT_SCALAR/prep.step_per_mm;
-
-        prep.dt_remainder = 0.0; // Reset for new planner block
-
-        if (sys.state == STATE_HOLD) {
-          // Override planner block entry speed and enforce deceleration during feed hold.
-          prep.current_speed = prep.exit_speed;
-          pl_block->entry_speed_sqr = prep.exit_speed*prep.exit_speed;
+        if (sys.state == STATE_HOLD || prep.flag_decel_override) {
+          // Override planner block entry speed and enforce deceleration during feed hold, or
+          // continue a deceleration forced by a feed override reduction. The exit speed is still
+          // in the units of the previous block.
+          float exit_speed = st_planner_speed(prep.exit_speed);
+          pl_block->entry_speed_sqr = exit_speed*exit_speed;
         }
-        else { prep.current_speed = sqrt(pl_block->entry_speed_sqr); }
+
+        // Initialize segment buffer data for generating the segments.
+        prep.steps_remaining = PREP_WHOLE_STEPS(pl_block->step_event_count);
+        #ifdef PLANNER_MERGE_MARKS
+          prep.merge_count = pl_block->merge_count;
+          st_merge_load_mark();
+        #endif
+        prep.step_per_mm = pl_block->step_event_count/pl_block->millimeters;
+        st_prep_load_units();
+        #ifdef NATIVE_ARCS
+          prep.arc_chord = st_prep_dist(arc_chord);
+        #endif
+        prep.dt_remainder = 0; // Reset for new planner block
+        prep.current_speed = st_prep_speed(sqrt(pl_block->entry_speed_sqr));
       }
 
       /* ---------------------------------------------------------------------------------
@@ -879,7 +1407,10 @@ void st_prep_buffer()
          planner has updated it. For a commanded forced-deceleration, such as from a feed
          hold, override the planner velocities and decelerate to the target exit speed.
       */
-      prep.mm_complete = 0.0; // Default velocity profile complete at 0.0mm from end of block.
+      uint8_t last_ramp_type = prep.ramp_type; // Retained to continue an S-curve ramp on a re-plan.
+      prep_speed_t last_ramp_speed = prep.ramp_entry_speed+prep.ramp_delta_speed;
+      prep.mm_complete = 0; // Default velocity profile complete at the end of block.
+      prep.flag_decel_override = false;
       float inv_2_accel = 0.5/pl_block->acceleration;
       if (sys.state == STATE_HOLD) { // [Forced Deceleration to Zero Velocity]
         // Compute velocity profile parameters for a feed hold in-progress. This profile overrides
@@ -889,57 +1420,103 @@ void st_prep_buffer()
         float decel_dist = pl_block->millimeters - inv_2_accel*pl_block->entry_speed_sqr;
         if (decel_dist < 0.0) {
           // Deceleration through entire planner block. End of feed hold is not in this block.
-          prep.exit_speed = sqrt(pl_block->entry_speed_sqr-2*pl_block->acceleration*pl_block->millimeters);
+          prep.exit_speed =
+            st_prep_speed(sqrt(pl_block->entry_speed_sqr-2*pl_block->acceleration*pl_block->millimeters));
         } else {
-          prep.mm_complete = decel_dist; // End of feed hold.
-          prep.exit_speed = 0.0;
+          prep.mm_complete = st_prep_dist(decel_dist); // End of feed hold.
+          prep.exit_speed = 0;
         }
       } else { // [Normal Operation]
         // Compute or recompute velocity profile parameters of the prepped planner block.
         prep.ramp_type = RAMP_ACCEL; // Initialize as acceleration ramp.
-        prep.accelerate_until = pl_block->millimeters;
-        prep.exit_speed = plan_get_exec_block_exit_speed();
-        float exit_speed_sqr = prep.exit_speed*prep.exit_speed;
+        prep.accelerate_until = st_prep_block_dist();
+        float exit_speed = plan_get_exec_block_exit_speed();
+        float exit_speed_sqr = exit_speed*exit_speed;
+        prep.exit_speed = st_prep_speed(exit_speed);
         float intersect_distance =
                 0.5*(pl_block->millimeters+inv_2_accel*(pl_block->entry_speed_sqr-exit_speed_sqr));
-        if (intersect_distance > 0.0) {
+        if (pl_block->entry_speed_sqr > pl_block->nominal_speed_sqr) { // Only after feed override reductions.
+          float accelerate_until =
+                  pl_block->millimeters-inv_2_accel*(pl_block->entry_speed_sqr-pl_block->nominal_speed_sqr);
+          float decelerate_after = inv_2_accel*(pl_block->nominal_speed_sqr-exit_speed_sqr);
+          if (accelerate_until <= decelerate_after) { // Deceleration-only type
+            // Too fast to slow to the planned exit speed in this block. Decelerate through it and
+            // enter the next block at the speed reached.
+            prep.ramp_type = RAMP_DECEL;
+            prep.maximum_speed = prep.current_speed;
+            prep.exit_speed =
+              st_prep_speed(sqrt(pl_block->entry_speed_sqr-2*pl_block->acceleration*pl_block->millimeters));
+            prep.flag_decel_override = true;
+          } else { // Decelerate to the new nominal speed, then cruise or cruise-decelerate.
+            prep.ramp_type = RAMP_DECEL_OVERRIDE;
+            prep.accelerate_until = st_prep_dist(accelerate_until);
+            prep.decelerate_after = st_prep_dist(decelerate_after);
+            prep.maximum_speed = st_prep_speed(sqrt(pl_block->nominal_speed_sqr));
+          }
+        } else if (intersect_distance > 0.0) {
           if (intersect_distance < pl_block->millimeters) { // Either trapezoid or triangle types
             // NOTE: For acceleration-cruise and cruise-only types, following calculation will be 0.0.
-            prep.decelerate_after = inv_2_accel*(pl_block->nominal_speed_sqr-exit_speed_sqr);
-            if (prep.decelerate_after < intersect_distance) { // Trapezoid type
-              prep.maximum_speed = sqrt(pl_block->nominal_speed_sqr);
+            float decelerate_after = inv_2_accel*(pl_block->nominal_speed_sqr-exit_speed_sqr);
+            if (decelerate_after < intersect_distance) { // Trapezoid type
+              prep.decelerate_after = st_prep_dist(decelerate_after);
+              prep.maximum_speed = st_prep_speed(sqrt(pl_block->nominal_speed_sqr));
               if (pl_block->entry_speed_sqr == pl_block->nominal_speed_sqr) {
                 // Cruise-deceleration or cruise-only type.
                 prep.ramp_type = RAMP_CRUISE;
               } else {
                 // Full-trapezoid or acceleration-cruise types
-                prep.accelerate_until -= inv_2_accel*(pl_block->nominal_speed_sqr-pl_block->entry_speed_sqr);
+                prep.accelerate_until = st_prep_dist(pl_block->millimeters -
+                  inv_2_accel*(pl_block->nominal_speed_sqr-pl_block->entry_speed_sqr));
+                if (prep.accelerate_until < prep.decelerate_after) {
+                  prep.accelerate_until = prep.decelerate_after; // Guard rounding into the decel ramp.
+                }
               }
             } else { // Triangle type
-              prep.accelerate_until = intersect_distance;
-              prep.decelerate_after = intersect_distance;
-              prep.maximum_speed = sqrt(2.0*pl_block->acceleration*intersect_distance+exit_speed_sqr);
+              prep.accelerate_until = st_prep_dist(intersect_distance);
+              prep.decelerate_after = prep.accelerate_until;
+              prep.maximum_speed =
+                st_prep_speed(sqrt(2.0*pl_block->acceleration*intersect_distance+exit_speed_sqr));
             }
           } else { // Deceleration-only type
             prep.ramp_type = RAMP_DECEL;
-            // prep.decelerate_after = pl_block->millimeters;
             prep.maximum_speed = prep.current_speed;
           }
         } else { // Acceleration-only type
-          prep.accelerate_until = 0.0;
-          // prep.decelerate_after = 0.0;
+          prep.accelerate_until = 0;
           prep.maximum_speed = prep.exit_speed;
         }
       }
 
+      prep.s_curve = (pl_block->jerk > 0.0);
+      if (prep.s_curve) {
+        // Start the S-curve ramp the profile begins with. If a re-plan left the acceleration ramp
+        // under way unchanged, continue it rather than restart it from zero acceleration.
+        prep_dist_t block_dist = st_prep_block_dist();
+        if (prep.ramp_type == RAMP_ACCEL) {
+          prep_dist_t ramp_end = prep.ramp_start -
+                                 PREP_TRAVEL(prep.ramp_duration, prep.ramp_entry_speed+last_ramp_speed)/2;
+          if (prep.flag_partial_block && last_ramp_type == RAMP_ACCEL &&
+              last_ramp_speed == prep.maximum_speed && prep.decelerate_after <= ramp_end &&
+              ramp_end < block_dist) {
+            prep.accelerate_until = ramp_end;
+          } else {
+            st_s_curve_begin(block_dist, prep.accelerate_until, prep.maximum_speed);
+          }
+        } else if (prep.ramp_type == RAMP_DECEL) {
+          st_s_curve_begin(block_dist, prep.mm_complete, prep.exit_speed);
+        } else if (prep.ramp_type == RAMP_DECEL_OVERRIDE) {
+          st_s_curve_begin(block_dist, prep.accelerate_until, prep.maximum_speed);
+        }
+      }
+      prep.flag_partial_block = false; // Reset flag
     }
 
     // Initialize new segment
     segment_t *prep_segment = &segment_buffer[segment_buffer_head];
 
-
     // Set new segment to point to the current segment data block.
     prep_segment->st_block_index = prep.st_block_index;
+    memset(prep_segment->steps, 0, sizeof(prep_segment->steps));
 
     /*------------------------------------------------------------------------------------
         Compute the average velocity of this new segment by determining the total distance
@@ -955,57 +1532,106 @@ void st_prep_buffer()
       the end of planner block (typical) or mid-block at the end of a forced deceleration,
       such as from a feed hold.
     */
-    float dt_max = DT_SEGMENT; // Maximum segment time
-    float dt = 0.0; // Initialize segment time
-    float time_var = dt_max; // Time worker variable
-    float mm_var; // mm-Distance worker variable
-    float speed_var; // Speed worker variable
-    float mm_remaining = pl_block->millimeters; // New segment distance from end of block.
-    float minimum_mm = mm_remaining-prep.req_mm_increment; // Guarantee at least one step.
-    if (minimum_mm < 0.0) { minimum_mm = 0.0; }
+    prep_time_t dt_max = PREP_DT_SEGMENT; // Maximum segment time
+    prep_time_t dt = 0; // Initialize segment time
+    prep_time_t time_var = dt_max; // Time worker variable
+    #ifdef NATIVE_ARCS
+      // Keep arc segments, which each run a single chord, within the arc tolerance.
+      if (pl_block->flags & PL_FLAG_ARC) {
+        prep_speed_t arc_speed = max(prep.current_speed, prep.maximum_speed);
+        if (arc_speed > 0) {
+          prep_time_t arc_dt = PREP_TIME(prep.arc_chord, arc_speed);
+          if (arc_dt > 0 && arc_dt < dt_max) { dt_max = time_var = arc_dt; }
+        }
+      }
+    #endif
+    prep_dist_t mm_var; // Distance worker variable
+    prep_speed_t speed_var; // Speed worker variable
+    prep_dist_t mm_remaining = st_prep_block_dist(); // New segment distance from end of block.
+    prep_dist_t minimum_mm = 0; // Guarantee at least one step.
+    if (mm_remaining > prep.req_mm_increment) { minimum_mm = mm_remaining-prep.req_mm_increment; }
 
     do {
       switch (prep.ramp_type) {
         case RAMP_ACCEL:
           // NOTE: Acceleration ramp only computes during first do-while loop.
-          speed_var = pl_block->acceleration*time_var;
-          mm_remaining -= time_var*(prep.current_speed + 0.5*speed_var);
-          if (mm_remaining < prep.accelerate_until) { // End of acceleration ramp.
-            // Acceleration-cruise, acceleration-deceleration ramp junction, or end of block.
-            mm_remaining = prep.accelerate_until; // NOTE: 0.0 at EOB
-            time_var = 2.0*(pl_block->millimeters-mm_remaining)/(prep.current_speed+prep.maximum_speed);
-            if (mm_remaining == prep.decelerate_after) { prep.ramp_type = RAMP_DECEL; }
-            else { prep.ramp_type = RAMP_CRUISE; }
-            prep.current_speed = prep.maximum_speed;
-          } else { // Acceleration only.
-            prep.current_speed += speed_var;
+          if (prep.s_curve) { // S-curve acceleration
+            if (st_s_curve_advance(time_var, prep.accelerate_until, &mm_remaining)) { break; }
+            time_var = prep.ramp_duration-prep.ramp_time;
+            mm_remaining = prep.accelerate_until;
+          } else {
+            speed_var = PREP_SPEED_CHANGE(prep.acceleration, time_var);
+            mm_var = PREP_TRAVEL(time_var, prep.current_speed + speed_var/2);
+            if (mm_remaining >= prep.accelerate_until + mm_var) { // Acceleration only.
+              mm_remaining -= mm_var;
+              prep.current_speed += speed_var;
+              break;
+            }
+            mm_remaining = prep.accelerate_until; // NOTE: 0 at EOB
+            time_var = PREP_TIME(2*(st_prep_block_dist()-mm_remaining), prep.current_speed+prep.maximum_speed);
+          }
+          // End of acceleration ramp.
+          // Acceleration-cruise, acceleration-deceleration ramp junction, or end of block.
+          prep.current_speed = prep.maximum_speed;
+          if (mm_remaining == prep.decelerate_after) {
+            prep.ramp_type = RAMP_DECEL;
+            if (prep.s_curve) { st_s_curve_begin(mm_remaining, prep.mm_complete, prep.exit_speed); }
           }
+          else { prep.ramp_type = RAMP_CRUISE; }
           break;
         case RAMP_CRUISE:
-          // NOTE: mm_var used to retain the last mm_remaining for incomplete segment time_var calculations.
-          mm_var = mm_remaining - prep.maximum_speed*time_var;
-          if (mm_var < prep.decelerate_after) { // End of cruise.
+          mm_var = st_cruise_travel(time_var);
+          if (mm_remaining < prep.decelerate_after + mm_var) { // End of cruise.
             // Cruise-deceleration junction or end of block.
-            time_var = (mm_remaining - prep.decelerate_after)/prep.maximum_speed;
-            mm_remaining = prep.decelerate_after; // NOTE: 0.0 at EOB
+            time_var = PREP_TIME(mm_remaining - prep.decelerate_after, prep.maximum_speed);
+            mm_remaining = prep.decelerate_after; // NOTE: 0 at EOB
             prep.ramp_type = RAMP_DECEL;
+            if (prep.s_curve) { st_s_curve_begin(mm_remaining, prep.mm_complete, prep.exit_speed); }
           } else { // Cruising only.
-            mm_remaining = mm_var;
+            mm_remaining -= mm_var;
           }
           break;
+        case RAMP_DECEL_OVERRIDE:
+          // NOTE: Like the acceleration ramp, only computes during first do-while loop.
+          if (prep.s_curve) { // S-curve deceleration
+            if (st_s_curve_advance(time_var, prep.accelerate_until, &mm_remaining)) { break; }
+            time_var = prep.ramp_duration-prep.ramp_time;
+          } else {
+            speed_var = PREP_SPEED_CHANGE(prep.acceleration, time_var);
+            if (prep.current_speed > prep.maximum_speed + speed_var) {
+              mm_var = PREP_TRAVEL(time_var, prep.current_speed - speed_var/2);
+              if (mm_remaining > prep.accelerate_until + mm_var) { // Deceleration only.
+                mm_remaining -= mm_var;
+                prep.current_speed -= speed_var;
+                break;
+              }
+            }
+            time_var = PREP_TIME(2*(mm_remaining-prep.accelerate_until), prep.current_speed+prep.maximum_speed);
+          }
+          // End of deceleration to the new nominal speed. Cruise or cruise-deceleration follows.
+          mm_remaining = prep.accelerate_until;
+          prep.current_speed = prep.maximum_speed;
+          prep.ramp_type = RAMP_CRUISE;
+          break;
         default: // case RAMP_DECEL:
-          // NOTE: mm_var used as a misc worker variable to prevent errors when near zero speed.
-          speed_var = pl_block->acceleration*time_var; // Used as delta speed (mm/min)
+          if (prep.s_curve) { // S-curve deceleration
+            if (st_s_curve_advance(time_var, prep.mm_complete, &mm_remaining)) { break; }
+            time_var = prep.ramp_duration-prep.ramp_time; // End of block or end of forced-deceleration.
+            mm_remaining = prep.mm_complete;
+            prep.current_speed = prep.exit_speed;
+            break;
+          }
+          speed_var = PREP_SPEED_CHANGE(prep.acceleration, time_var); // Used as delta speed
           if (prep.current_speed > speed_var) { // Check if at or below zero speed.
-            // Compute distance from end of segment to end of block.
-            mm_var = mm_remaining - time_var*(prep.current_speed - 0.5*speed_var); // (mm)
-            if (mm_var > prep.mm_complete) { // Deceleration only.
-              mm_remaining = mm_var;
+            // Compute distance traveled over the segment time.
+            mm_var = PREP_TRAVEL(time_var, prep.current_speed - speed_var/2);
+            if (mm_remaining > prep.mm_complete + mm_var) { // Deceleration only.
+              mm_remaining -= mm_var;
               prep.current_speed -= speed_var;
               break; // Segment complete. Exit switch-case statement. Continue do-while loop.
             }
           } // End of block or end of forced-deceleration.
-          time_var = 2.0*(mm_remaining-prep.mm_complete)/(prep.current_speed+prep.exit_speed);
+          time_var = PREP_TIME(2*(mm_remaining-prep.mm_complete), prep.current_speed+prep.exit_speed);
           mm_remaining = prep.mm_complete;
       }
       dt += time_var; // Add computed ramp time to total segment time.
@@ -1014,7 +1640,7 @@ void st_prep_buffer()
         if (mm_remaining > minimum_mm) { // Check for very slow segments with zero steps.
           // Increase segment time to ensure at least one step in segment. Override and loop
           // through distance calculations until minimum_mm or mm_complete.
-          dt_max += DT_SEGMENT;
+          dt_max += PREP_DT_SEGMENT;
           time_var = dt_max - dt;
         } else {
           break; // **Complete** Exit loop. Segment execution time maxed.
@@ -1025,31 +1651,18 @@ void st_prep_buffer()
 
     /* -----------------------------------------------------------------------------------
        Compute segment step rate, steps to execute, and apply necessary rate corrections.
-       NOTE: Steps are computed by direct scalar conversion of the millimeter distance
-       remaining in the block, rather than incrementally tallying the steps executed per
-       segment. This helps in removing floating point round-off issues of several additions.
-       However, since floats have only 7.2 significant digits, long moves with extremely
-       high step counts can exceed the precision of floats, which can lead to lost steps.
-       Fortunately, this scenario is highly unlikely and unrealistic in CNC machines
-       supported by Grbl (i.e. exceeding 10 meters axis travel at 200 step/mm).
     */
-    float steps_remaining = prep.step_per_mm*mm_remaining; // Convert mm_remaining to steps
-    float n_steps_remaining = ceil(steps_remaining); // Round-up current steps remaining
-    float last_n_steps_remaining = ceil(prep.steps_remaining); // Round-up last steps remaining
+    prep_steps_t steps_remaining = st_prep_steps(mm_remaining);
+    uint32_t n_steps_remaining = PREP_CEIL_STEPS(steps_remaining); // Round-up current steps remaining
+    uint32_t last_n_steps_remaining = PREP_CEIL_STEPS(prep.steps_remaining); // Round-up last steps remaining
     prep_segment->n_step = last_n_steps_remaining-n_steps_remaining; // Compute number of steps to execute.
 
     // Bail if we are at the end of a feed hold and don't have a step to execute.
     if (prep_segment->n_step == 0) {
       if (sys.state == STATE_HOLD) {
-
         // Less than one step to decelerate to zero speed, but already very close. AMASS
         // requires full steps to execute. So, just bail.
-        prep.current_speed = 0.0;
-        prep.dt_remainder = 0.0;
-        prep.steps_remaining = n_steps_remaining;
-        pl_block->millimeters = prep.steps_remaining/prep.step_per_mm; // Update with full steps.
-        plan_cycle_reinitialize();
-        sys.state = STATE_QUEUED;
+        st_prep_stop(n_steps_remaining);
         return; // Segment not generated, but current step data still retained.
       }
     }
@@ -1062,12 +1675,20 @@ void st_prep_buffer()
     // adjusts the whole segment rate to keep step output exact. These rate adjustments are
     // typically very small and do not adversely effect performance, but ensures that Grbl
     // outputs the exact acceleration and velocity profiles as computed by the planner.
-    dt += prep.dt_remainder; // Apply previous segment partial step execute time
-    float inv_rate = dt/(last_n_steps_remaining - steps_remaining); // Compute adjusted step rate inverse
-    prep.dt_remainder = (n_steps_remaining - steps_remaining)*inv_rate; // Update segment partial step time
-
-    // Compute CPU cycles per step for the prepped segment.
-    uint32_t cycles = ceil( (TICKS_PER_MICROSECOND*1000000*60)*inv_rate ); // (cycles/step)
+    uint32_t cycles;
+    #ifdef NATIVE_ARCS
+    if (pl_block->flags & PL_FLAG_ARC) {
+      // Arc segments run the chord to the arc point reached, evenly over the segment time. The
+      // chord ends are exact, so there is no partial step time to carry.
+      prep_segment->n_step = st_arc_chord(prep_segment,
+                               (float)steps_remaining/PREP_WHOLE_STEPS(pl_block->step_event_count));
+      cycles = st_segment_cycles(dt, PREP_WHOLE_STEPS(prep_segment->n_step), 0);
+    } else
+    #endif
+    {
+      cycles = st_segment_cycles(dt, PREP_WHOLE_STEPS(last_n_steps_remaining) - steps_remaining,
+                                 PREP_WHOLE_STEPS(n_steps_remaining) - steps_remaining);
+    }
 
     #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
       // Compute step timing and multi-axis smoothing level.
@@ -1107,28 +1728,29 @@ void st_prep_buffer()
     // Setup initial conditions for next segment.
     if (mm_remaining > prep.mm_complete) {
       // Normal operation. Block incomplete. Distance remaining in block to be executed.
-      pl_block->millimeters = mm_remaining;
+      pl_block->millimeters = st_prep_mm(mm_remaining);
       prep.steps_remaining = steps_remaining;
-      prep_segment->do_status = 0;
+      #ifdef PLANNER_MERGE_MARKS
+        prep_segment->do_status = st_merge_passed(n_steps_remaining);
+      #else
+        prep_segment->do_status = 0;
+      #endif
     } else {
       // End of planner block or forced-termination. No more distance to be executed.
       //mark which line this segment belongs to
       prep_segment->do_status = REQUEST_STATUS_REPORT;
-      if (mm_remaining > 0.0) { // At end of forced-termination.
+      if (mm_remaining > 0) { // At end of forced-termination.
         // Reset prep parameters for resuming and then bail.
         // NOTE: Currently only feed holds qualify for this scenario. May change with overrides.
-        prep.current_speed = 0.0;
-        prep.dt_remainder = 0.0;
-        prep.steps_remaining = ceil(steps_remaining);
-        pl_block->millimeters = prep.steps_remaining/prep.step_per_mm; // Update with full steps.
-        plan_cycle_reinitialize();
-        sys.state = STATE_QUEUED; // End cycle.
-
+        st_prep_stop(n_steps_remaining); // End cycle.
         return; // Bail!
 // TODO: Try to move QUEUED setting into cycle re-initialize.
 
       } else { // End of planner block
         // The planner block is complete. All steps are set to be executed in the segment buffer.
+        #ifdef PLANNER_MERGE_MARKS
+          prep_segment->do_status += st_merge_passed(0); // Line ends rounded onto the block end
+        #endif
         pl_block = NULL;
         plan_discard_current_block();
       }
@@ -1138,6 +1760,39 @@ void st_prep_buffer()
 }
 
 
+// Called by the main program. With the segment prep interrupt, whichever of the two comes
+// second leaves the work to the first.
+void st_prep_buffer()
+{
+  #ifdef SEGMENT_PREP_ISR
+    if (st_prep_locked) { return; }
+    ST_PREP_LOCK();
+    st_prep_segments();
+    ST_PREP_UNLOCK();
+  #else
+    st_prep_segments();
+  #endif
+}
+
+
+#ifdef SEGMENT_PREP_ISR
+// Segment prep interrupt. Tops up the segment buffer once every millisecond, whatever the main
+// program is doing. Other interrupts are enabled during the prep, which takes far longer than
+// a step tick.
+// NOTE: The step ISR re-enables interrupts while busy. A prep nested in a step tick would hold
+// the tick open, and the step ISRs arriving meanwhile would find it busy and drop their steps.
+// Such a prep is skipped and left to the next compare, 1ms later.
+ISR(TIMER1_COMPB_vect)
+{
+  if (st_prep_locked || busy) { return; }
+  ST_PREP_LOCK();
+  sei();
+  st_prep_segments();
+  cli();
+  ST_PREP_UNLOCK();
+}
+#endif
+
 
 /*
    TODO: With feedrate overrides, increases to the override value will not significantly
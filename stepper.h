@@ -39,12 +39,29 @@ void st_wake_up();
 // Immediately disables steppers
 void st_go_idle();
 
+// Picks the step ISR body for the sensor checks armed in limits. Call after arming one.
+void st_select_isr_variant();
+
 // Reset the stepper subsystem variables       
 void st_reset();
              
 // Reloads step segment buffer. Called continuously by runtime execution system.
 void st_prep_buffer();
 
+// Times the steppers ran out of segments with planned motion left. Reported with the status.
+extern volatile uint16_t st_underrun_count;
+
+// Keeps the segment prep interrupt out while the main program changes the planner or segment
+// prep state, or uses the SPI bus. Locks nest.
+#ifdef SEGMENT_PREP_ISR
+  extern volatile uint8_t st_prep_locked;
+  #define ST_PREP_LOCK() (st_prep_locked++)
+  #define ST_PREP_UNLOCK() (st_prep_locked--)
+#else
+  #define ST_PREP_LOCK()
+  #define ST_PREP_UNLOCK()
+#endif
+
 // Called by planner_recalculate() when the executing block is updated by the new plan.
 void st_update_plan_block_parameters();
 
@@ -57,6 +74,22 @@ void adjustForceSensorPWM();
 //disable stepper output (0 to enable)
 void st_disable(uint8_t disable, uint8_t mask);
 
+// Copies the real-time machine position in steps, including steps of the executing segment.
+void st_get_position(int32_t *position);
+
+// Real-time position of one axis in steps. Only for use with interrupts disabled, e.g. in an ISR.
+int32_t st_get_axis_position(uint8_t idx);
+
+// Returns true while the stepper ISR is enabled.
+uint8_t st_is_running();
+
+// Sources of sensor edges that may be deferred to the stepper ISR.
+#define EDGE_SOURCE_LIMITS   bit(0)
+#define EDGE_SOURCE_MAGAZINE bit(1)
+
+// Called by the sensor edge interrupts. Returns true if the edge is deferred to the stepper ISR.
+uint8_t st_defer_edge(uint8_t source);
+
 void st_start_shutdown_timer(void);
 void st_stop_shutdown_timer(void);
 
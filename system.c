@@ -33,6 +33,8 @@
 #include "probe.h"
 #include "ad5121.h"
 #include "print.h"
+#include "magazine.h"
+#include "frame.h"
 
 uint32_t masterclock=0;
 //uint16_t voltage_result[VOLTAGE_SENSOR_COUNT];
@@ -263,6 +265,10 @@ uint8_t system_execute_line(char *line)
       if ( line[++char_counter] != 0 ) { return(STATUS_INVALID_STATEMENT); }
       return STATUS_ALT_REPORT(REQUEST_VOLTAGE_REPORT);
       break;
+    case 'T': // Print and clear ISR timing histograms. Allowed in any state.
+      if ( line[++char_counter] != 0 ) { return(STATUS_INVALID_STATEMENT); }
+      return STATUS_ALT_REPORT(REQUEST_ISR_TIMING_REPORT);
+      break;
     case 'R':
       if ( line[++char_counter] != 0 ) { return(STATUS_INVALID_STATEMENT); }
       IO_RESET_PORT |= IO_RESET_MASK;  //reset IO.  Will re-enable in loop
@@ -278,18 +284,12 @@ uint8_t system_execute_line(char *line)
       break;
       /* END KEYME SPECIFIC */
 
-//  case 'J' : break;  // Jogging methods
-    // TODO: Here jogging can be placed for execution as a seperate subprogram. It does not need to be
-    // susceptible to other runtime commands except for e-stop. The jogging function is intended to
-    // be a basic toggle on/off with controlled acceleration and deceleration to prevent skipped
-    // steps. The user would supply the desired feedrate, axis to move, and direction. Toggle on would
-    // start motion and toggle off would initiate a deceleration to stop. One could 'feather' the
-    // motion by repeatedly toggling to slow the motion to the desired location. Location data would
-    // need to be updated real-time and supplied to the user through status queries.
-    //   More controlled exact motions can be taken care of by inputting G0 or G1 commands, which are
-    // handled by the planner. It would be possible for the jog subprogram to insert blocks into the
-    // block buffer without having the planner plan them. It would need to manage de/ac-celerations
-    // on its own carefully. This approach could be effective and possibly size/memory efficient.
+    case 'J' : // Jogging [IDLE/JOG]
+      // Execute only when idle or already jogging, so jogs can be streamed back to back. The
+      // '$J=' prefix is passed on to the g-code parser, which uses it to recognize the jog.
+      if ( !(sys.state == STATE_IDLE || sys.state == STATE_JOG) ) { return(STATUS_IDLE_ERROR); }
+      if ( line[char_counter+1] != '=' ) { return(STATUS_INVALID_STATEMENT); }
+      return(gc_execute_line(line));
     default :
       // Block any system command that requires the state as IDLE/ALARM. (i.e. EEPROM, homing)
       if ( !(sys.state == STATE_IDLE || sys.state == STATE_ALARM) ) { return(STATUS_IDLE_ERROR); }
@@ -376,6 +376,23 @@ uint8_t system_execute_line(char *line)
           }
           return STATUS_QUIET_OK;
           break;
+#ifdef BINARY_FRAMING
+        case 'K' : // Switch to the binary framed protocol. See frame.h.
+          if ( line[++char_counter] != 0 ) { return(STATUS_INVALID_STATEMENT); }
+          if (frame_mode) { return(STATUS_INVALID_STATEMENT); } // Would restart the sequence numbers.
+          frame_start();
+          break;
+#endif
+#ifdef MAGAZINE_MAP_SIZE
+        case 'M' : // Print or learn the carousel magazine map.
+          if ( line[++char_counter] == 0 ) { magazine_report_map(); }
+          else { // Calibration sweep [IDLE Only] Prevents motion during ALARM.
+            if ( line[char_counter] != 'C' || line[++char_counter] != 0 ) { return(STATUS_INVALID_STATEMENT); }
+            if (sys.state != STATE_IDLE) { return(STATUS_IDLE_ERROR); }
+            return(magazine_map_calibrate());
+          }
+          break;
+#endif
         case 'I' : // Print or store build info. [IDLE/ALARM]
           if ( line[++char_counter] == 0 ) {
             if (!(settings_read_build_info(line))) {
@@ -436,13 +453,18 @@ uint8_t system_execute_line(char *line)
 
 
 // * line num stuff *
-#define STLT_SIZE BLOCK_BUFFER_SIZE*2
+// Every planned block can hold a line number, including the ones spilled to SPI SRAM.
+#ifdef PLANNER_SPILL_SIZE
+  #define STLT_SIZE (BLOCK_BUFFER_SIZE*2+PLANNER_SPILL_SIZE)
+#else
+  #define STLT_SIZE BLOCK_BUFFER_SIZE*2
+#endif
 
 typedef struct {
   linenumber_t lines[STLT_SIZE];
   linenumber_t last_line;
-  uint8_t head;
-  uint8_t tail;
+  uint16_t head;
+  uint16_t tail;
 } st_linetrack_t;
 static st_linetrack_t st_lt;
 
@@ -452,31 +474,32 @@ void linenumber_init() {
   st_lt.head = 1;
   st_lt.tail = 0;
   memset(st_lt.lines,BLOCK_BUFFER_SIZE,sizeof(st_lt.lines));
+  sysflags.eol_count = 0;
 }
 
 
-uint8_t linenumber_insert(linenumber_t line_number)
+uint16_t linenumber_insert(linenumber_t line_number)
 {
   if (st_lt.head!=st_lt.tail){
     st_lt.lines[st_lt.head] = line_number;
     if (++st_lt.head>=STLT_SIZE) { st_lt.head = 0;}
   }
   //calculate and return number of items in queue.
-  uint8_t head = st_lt.head;
+  uint16_t head = st_lt.head;
   if (head<=st_lt.tail){ head+=STLT_SIZE;}
   return head-st_lt.tail-1;
 }
 
-uint8_t linenumber_next(){
-  uint8_t read_idx = st_lt.tail;
+uint16_t linenumber_next(){
+  uint16_t read_idx = st_lt.tail;
   if (++read_idx>=STLT_SIZE) { read_idx=0; }
   return read_idx;
 }
-uint8_t ln_head() { return st_lt.head;}
+uint16_t ln_head() { return st_lt.head;}
 
 
 linenumber_t linenumber_get(){
-  uint8_t read_idx = linenumber_next();
+  uint16_t read_idx = linenumber_next();
   if (read_idx != st_lt.head) {
     st_lt.tail = read_idx;
     st_lt.last_line = st_lt.lines[read_idx];
@@ -485,7 +508,7 @@ linenumber_t linenumber_get(){
 }
 
 linenumber_t linenumber_peek(){
-  uint8_t read_idx = linenumber_next();
+  uint16_t read_idx = linenumber_next();
   if (read_idx != st_lt.head) {
     return st_lt.lines[read_idx];
   }
@@ -52,12 +52,14 @@
 #define EXEC_RESET          bit(4) // bitmask 00010000
 #define EXEC_ALARM          bit(5) // bitmask 00100000
 #define EXEC_CRIT_EVENT     bit(6) // bitmask 01000000
+#define EXEC_MOTION_OVERRIDE bit(7) // bitmask 10000000
 
 #define REQUEST_STATUS_REPORT  bit(0)
 #define REQUEST_LIMIT_REPORT   bit(1)
 #define REQUEST_COUNTER_REPORT bit(2)
 #define REQUEST_VOLTAGE_REPORT bit(3)
 #define REQUEST_EDGE_REPORT    bit(4)
+#define REQUEST_ISR_TIMING_REPORT bit(5)
 
 // Define system state bit map. The state variable primarily tracks the individual functions
 // of Grbl to manage each without overlapping. It is also used as a messaging flag for
@@ -70,8 +72,8 @@
 #define STATE_CYCLE      bit(4) // Cycle is running
 #define STATE_HOLD       bit(5) // Executing feed hold
 #define STATE_FORCESERVO bit(6) // Force servo process
-#define STATE_HOME_ADJUST bit(7) // Update the minimum homing rate when some axes complete homing cycle
 #define STATE_PROBING    bit(8)
+#define STATE_JOG        bit(9) // Jogging motion. Only jog blocks are planned while set.
 
 // Define Grbl alarm codes. Listed most to least serious
 #define ALARM_SOFT_LIMIT  bit(0) // soft limits exceeded
@@ -86,6 +88,7 @@
 // Define system flags
 #define SYSFLAG_EOL_REPORT bit(0)  // Block is done executing, report linenum
 #define SYSFLAG_AUTOSTART  bit(1)  // autostart is active
+#define SYSFLAG_JOG_CANCEL bit(2)  // jog is decelerating to a stop, flush jog blocks when done
 
 // Define global system variables
 typedef struct {
@@ -94,13 +97,16 @@ typedef struct {
   uint16_t old_state;            // Keep track of state changes
   uint8_t flags;                 // see SYSFLAG_xxx above
   uint8_t alarm;                 // see ALARM_xxx above. which alarm(s) are active
-  int32_t position[N_AXIS];      // Real-time machine (aka home) position vector in steps.
+  int32_t position[N_AXIS];      // Machine (aka home) position vector in steps. Updated at the end of
+                                 // each step segment. Use st_get_position() for the real-time position.
                                  // NOTE: This may need to be a volatile variable, if problems arise.
   int32_t probe_position[N_AXIS]; // Last probe position in machine coordinates and steps.
   uint8_t lock_mask;             // Mask which determines the state of axis 'locking' (aka braking)
   uint8_t limit_state;           // State of XYZC limit pins
   uint8_t old_limit_state;       // Keep track of limit state changes
   uint8_t last_estop_state;      // ESTOP tracking
+  uint8_t f_override;            // Feed rate override value in percent, as applied to the plan
+  uint8_t r_override;            // Rapids override value in percent, as applied to the plan
 } system_t;
 extern system_t sys;
 
@@ -108,6 +114,11 @@ typedef struct {
   volatile uint8_t execute;      // Global system runtime executor bitflag variable. See EXEC bitmasks.
   volatile uint8_t limits;                 //limit
   volatile uint8_t report_rqsts;   //requestsd reports
+  volatile uint8_t f_override;     // Feed rate override requested over serial. See EXEC_MOTION_OVERRIDE.
+  volatile uint8_t r_override;     // Rapids override requested over serial.
+  volatile uint8_t jog_cancel;     // Jog cancel requested over serial. Serviced by the runtime protocol.
+  volatile uint8_t carousel_stop;  // Carousel probe tripped. Serviced by the runtime protocol.
+  volatile uint8_t eol_count;      // Completed lines left to report after the current one. See PLANNER_MERGE_MARKS.
 } sys_flags_t;
 extern volatile sys_flags_t sysflags;
 
@@ -161,7 +172,7 @@ typedef uint32_t linenumber_t;
 
 
 void linenumber_init();
-uint8_t linenumber_insert(linenumber_t line_number);
+uint16_t linenumber_insert(linenumber_t line_number);
 linenumber_t linenumber_get();
 linenumber_t linenumber_peek();
 
@@ -4,7 +4,8 @@
   System tick implementation. Global sys_tick value is updated.
   Callbacks can be registed to be called after a certain time.
 
-  sys_tick uses Timer1. Timer1 should not be used anywhere else.
+  sys_tick uses Timer1. Timer1 should not be used anywhere else, but for
+  the segment prep interrupt on compare B (SEGMENT_PREP_ISR).
 
 */
 #include "systick.h"
@@ -12,49 +13,81 @@
 
 #define MAX_CALLBACKS 32
 
-callback_t systick_callbacks_array[MAX_CALLBACKS];
-static uint8_t systick_len;  // Length of callback array 
+// Min-heap on callback_time. The next callback due is always at the root.
+static callback_t systick_callbacks[MAX_CALLBACKS];
+static uint8_t systick_len;  // Number of scheduled callbacks
 
-// Helper function for qsort. Used in systick_sort_callback_array
-int cmp(const void * a, const void * b)
+// sys_tick is updated by the timer interrupt, and a 64-bit read takes several instructions
+static uint64_t systick_now()
 {
-  callback_t *cb_a = (callback_t *)a;
-  callback_t *cb_b = (callback_t *)b;
-  
-  return (cb_a->callback_time - cb_b->callback_time);
+  uint8_t sreg = SREG;
+  cli();
+  uint64_t now = sys_tick;
+  SREG = sreg;
+  return(now);
+}
 
+static void systick_swap(uint8_t a, uint8_t b)
+{
+  callback_t temp = systick_callbacks[a];
+  systick_callbacks[a] = systick_callbacks[b];
+  systick_callbacks[b] = temp;
 }
 
-// Sort the callback array according to lowest callback time
-void systick_sort_callback_array()
+static void systick_sift_up(uint8_t idx)
 {
-  qsort(systick_callbacks_array, systick_len, sizeof(callback_t), cmp); 
+  while (idx) {
+    uint8_t parent = (idx-1) >> 1;
+    if (systick_callbacks[parent].callback_time <= systick_callbacks[idx].callback_time) { return; }
+    systick_swap(parent, idx);
+    idx = parent;
+  }
 }
 
-void systick_service_callbacks()
+static void systick_sift_down(uint8_t idx)
 {
-  if (!systick_len) {
-    return;
+  for (;;) {
+    uint8_t child = 2*idx+1;
+    if (child >= systick_len) { return; }
+    if ((child+1 < systick_len) &&
+        (systick_callbacks[child+1].callback_time < systick_callbacks[child].callback_time)) { child++; }
+    if (systick_callbacks[idx].callback_time <= systick_callbacks[child].callback_time) { return; }
+    systick_swap(idx, child);
+    idx = child;
   }
+}
 
-  // Sort the callback array
-  systick_sort_callback_array();
-  
-  // Count the number of expired callbacks
-  uint8_t idx = 0;
+// Takes a callback out of the heap. The last one fills its place and moves to where it belongs.
+static void systick_remove(uint8_t idx)
+{
+  systick_len--;
+  if (idx == systick_len) { return; }
+  systick_callbacks[idx] = systick_callbacks[systick_len];
+  systick_sift_down(idx);
+  systick_sift_up(idx);
+}
 
-  while (systick_callbacks_array[idx].callback_time <= sys_tick && idx < systick_len) {
-    idx++;
+void systick_service_callbacks()
+{
+  if (!systick_len) {
+    return;
   }
 
-  while (idx > 0) {
-    // Call the callback function
-    systick_callbacks_array[0].cb_function();
-
-    // Shift all entries in the callback array to the left and decrement the index
-    memmove(&systick_callbacks_array[0], &systick_callbacks_array[1], sizeof(callback_t) * (systick_len - idx));
-    systick_len--;
-    idx--;
+  uint64_t now = systick_now();
+  while (systick_len && (systick_callbacks[0].callback_time <= now)) {
+    callback_t cb = systick_callbacks[0];
+
+    // Reschedule or remove before the call, so the callback is free to register or cancel
+    if (cb.period) {
+      // From the due time, so periodic calls don't drift. Skip the ones overdue after a stall.
+      systick_callbacks[0].callback_time += cb.period;
+      if (systick_callbacks[0].callback_time <= now) { systick_callbacks[0].callback_time = now+cb.period; }
+      systick_sift_down(0);
+    } else {
+      systick_remove(0);
+    }
+
+    cb.cb_function();
   }
 }
 
@@ -77,7 +110,7 @@ void systick_init()
   // Enable the compare interrupt in Timer Interrupt Mask Register
   bit_true(TIMSK1, 1 << OCIE1A);
 
-  // Initialize length of the callback array
+  // Clear the callback schedule
   systick_len = 0; 
 
 }
@@ -89,20 +122,35 @@ ISR(TIMER1_COMPA_vect)
   sys_tick++;
 }
 
-// Schedule a callback
-void systick_register_callback(uint32_t ms_later, void (*func)())
+uint8_t systick_register_periodic_callback(uint32_t ms_later, uint16_t period, void (*func)())
 {
- 
-  uint64_t callback_time = sys_tick + ms_later;
-
-  callback_t to_insert;
-  to_insert.callback_time = callback_time;
-  to_insert.cb_function = func;
-
-  // Insert callback into callbacks array
-  systick_callbacks_array[systick_len] = to_insert;
+  if (systick_len == MAX_CALLBACKS) { return(false); }
+
+  callback_t *cb = &systick_callbacks[systick_len];
+  cb->callback_time = systick_now() + ms_later;
+  cb->period = period;
+  cb->cb_function = func;
+  systick_len++;
+  systick_sift_up(systick_len-1);
+  return(true);
+}
 
-  // Increase the length of the callback array
-  systick_len++; 
+// Schedule a callback
+uint8_t systick_register_callback(uint32_t ms_later, void (*func)())
+{
+  return(systick_register_periodic_callback(ms_later, 0, func));
+}
 
+void systick_cancel_callback(void (*func)())
+{
+  // Removal reorders the heap, so start over after each one
+  uint8_t idx = 0;
+  while (idx < systick_len) {
+    if (systick_callbacks[idx].cb_function == func) {
+      systick_remove(idx);
+      idx = 0;
+    } else {
+      idx++;
+    }
+  }
 }
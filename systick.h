@@ -2,9 +2,12 @@
   Not part of Grbl. KeyMe specific.
  
   System tick implementation. Global sys_tick value is updated.
-  Callbacks can be registed to be called after a certain time.
+  Callbacks can be registed to be called after a certain time, once or
+  periodically. They are kept in a min-heap on their due time, so an idle
+  pass only compares the next due time.
   
-  sys_tick uses Timer1. Timer1 should not be used anywhere else.
+  sys_tick uses Timer1. Timer1 should not be used anywhere else, but for
+  the segment prep interrupt on compare B (SEGMENT_PREP_ISR).
  
 */
 
@@ -15,12 +18,24 @@
 
 typedef struct {
   uint64_t callback_time;
+  uint16_t period;  // ms between calls, 0 for a single call
   void (*cb_function)();
 } callback_t;
 
 uint64_t sys_tick;
 void systick_init();
-void systick_register_callback(uint32_t, void(*)());
+
+// Schedules a single call ms_later from now. Returns false if the schedule is full.
+uint8_t systick_register_callback(uint32_t ms_later, void(*)());
+
+// Schedules a call ms_later from now and then every period ms, until cancelled. Calls that
+// fall due while the main program is held up are skipped rather than bunched up.
+uint8_t systick_register_periodic_callback(uint32_t ms_later, uint16_t period, void(*)());
+
+// Removes every scheduled call of the function
+void systick_cancel_callback(void(*)());
+
+// Calls the callbacks that are due. Called by the main program.
 void systick_service_callbacks();
 
 #endif